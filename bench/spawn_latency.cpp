@@ -0,0 +1,93 @@
+/**
+ * Covariant Script Libmozart++ Process Support
+ *
+ * Spawn latency benchmark: measures process_builder::start() + wait against
+ * a growing parent RSS for every spawn backend.
+ *
+ * Usage: spawn_latency [iterations] [rss_mib ...]
+ *   iterations  spawns per (backend, RSS) pair, default 200
+ *   rss_mib     parent heap sizes to test, default 0 256 1024
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Copyright (C) 2017-2026 Michael Lee(李登淳)
+ *
+ * Email:   mikecovlee@163.com
+ * Github:  https://github.com/mikecovlee
+ * Website: http://covscript.org.cn
+ */
+
+#include <mozart++/process>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char *backend_name(mpp::spawn_backend b)
+{
+	switch (b) {
+	case mpp::spawn_backend::automatic:
+		return "automatic";
+	case mpp::spawn_backend::fork:
+		return "fork";
+	}
+	return "?";
+}
+
+static double measure(mpp::spawn_backend backend, int iterations)
+{
+	mpp::process_builder builder;
+#ifdef MOZART_PLATFORM_WIN32
+	builder.command("cmd").arguments(std::vector<std::string> {"/c", "exit"});
+#else
+	builder.command("true");
+#endif
+	builder.backend(backend);
+
+	const auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		mpp::process p = builder.start();
+		p.collect_wait();
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - begin;
+	return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 200;
+	std::vector<size_t> sizes_mib = {0, 256, 1024};
+	if (argc > 1)
+		iterations = std::max(1, std::atoi(argv[1]));
+	if (argc > 2) {
+		sizes_mib.clear();
+		for (int i = 2; i < argc; ++i)
+			sizes_mib.push_back(static_cast<size_t>(std::strtoull(argv[i], nullptr, 10)));
+	}
+
+	std::printf("%10s  %-10s  %14s\n", "rss_mib", "backend", "us_per_spawn");
+	std::vector<char> ballast;
+	for (size_t mib : sizes_mib) {
+		// Touch every page so the heap is resident, not just reserved.
+		ballast.assign(mib * 1024 * 1024, 1);
+		for (auto backend : {mpp::spawn_backend::automatic, mpp::spawn_backend::fork}) {
+			const double us = measure(backend, iterations);
+			std::printf("%10zu  %-10s  %14.1f\n", mib, backend_name(backend), us);
+		}
+	}
+	return ballast.empty() ? 0 : (ballast[0] == 1 ? 0 : 1);
+}
@@ -15,23 +15,141 @@
 #pragma once
 
 #include "io.hpp"
+#include "lines.hpp"
 
 #include <algorithm>
 #include <istream>
 #include <limits>
+#include <memory>
 #include <ostream>
 #include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <cerrno>
+
+#ifndef MOZART_PLATFORM_WIN32
+#include <sys/uio.h>
+#endif
 
 namespace mpp {
+	/**
+	 * Output streambuf over a raw descriptor.  Unbuffered by default: each
+	 * write reaches the fd at once, which interactive children rely on.
+	 * With a non-zero buffer size small writes are collected in a put area
+	 * that is flushed when full, on sync() (std::flush / std::endl) and on
+	 * destruction; writes too large for the free space skip the copy and go
+	 * out together with the pending bytes in one writev().
+	 */
 	class fdoutbuf : public std::streambuf {
 	private:
 		mpp::fd_type _fd;
 		bool _valid = true;
+		std::unique_ptr<char[]> _buffer;
+		size_t _buffer_size = 0;
+
+		/**
+		 * Write a then b completely.  Returns false on error, with the
+		 * unwritten remainder dropped.
+		 */
+		bool write_all(const char *a, size_t na, const char *b, size_t nb)
+		{
+#ifdef MOZART_PLATFORM_WIN32
+			for (auto part : {std::make_pair(a, na), std::make_pair(b, nb)}) {
+				const char *p = part.first;
+				size_t n = part.second;
+				while (n > 0) {
+					// WriteFile accepts DWORD (32-bit); limit chunks to avoid
+					// silent truncation on very large writes (> 4 GiB).
+					constexpr size_t max_chunk =
+					    static_cast<size_t>(std::numeric_limits<DWORD>::max());
+					mpp::ssize_t written = mpp::write(_fd, p, std::min(n, max_chunk));
+					if (written <= 0) return false;
+					p += written;
+					n -= static_cast<size_t>(written);
+				}
+			}
+			return true;
+#else
+			struct iovec iov[2] = {
+				{const_cast<char *>(a), na},
+				{const_cast<char *>(b), nb}
+			};
+			struct iovec *v = iov;
+			int cnt = 2;
+			while (cnt > 0) {
+				if (v->iov_len == 0) {
+					++v;
+					--cnt;
+					continue;
+				}
+				mpp::ssize_t written = ::writev(_fd, v, cnt);
+				if (written < 0 && errno == EINTR) continue;
+				if (written <= 0) return false;
+				size_t done = static_cast<size_t>(written);
+				while (cnt > 0 && done >= v->iov_len) {
+					done -= v->iov_len;
+					++v;
+					--cnt;
+				}
+				if (cnt > 0) {
+					v->iov_base = static_cast<char *>(v->iov_base) + done;
+					v->iov_len -= done;
+				}
+			}
+			return true;
+#endif
+		}
+
+		/** Write out the put area; it is emptied even on error. */
+		bool flush_buffer(const char *extra = nullptr, size_t nextra = 0)
+		{
+			const size_t pending = static_cast<size_t>(pptr() - pbase());
+			if (_buffer)
+				setp(_buffer.get(), _buffer.get() + _buffer_size);
+			return write_all(_buffer.get(), pending, extra, nextra);
+		}
 
 	public:
-		explicit fdoutbuf(mpp::fd_type fd)
+		explicit fdoutbuf(mpp::fd_type fd, size_t buffer_size = 0)
 			: _fd(fd)
 		{
+			set_buffer_size(buffer_size);
+		}
+
+		fdoutbuf(const fdoutbuf &) = delete;
+
+		fdoutbuf &operator=(const fdoutbuf &) = delete;
+
+		~fdoutbuf() override
+		{
+			if (_valid)
+				flush_buffer();
+		}
+
+		/**
+		 * Resize the put area (0 = unbuffered).  Pending bytes are
+		 * written out first.
+		 */
+		void set_buffer_size(size_t size)
+		{
+			if (_buffer && _valid)
+				flush_buffer();
+			_buffer.reset(size > 0 ? new char[size] : nullptr);
+			_buffer_size = size;
+			setp(_buffer.get(), _buffer.get() + size);
+		}
+
+		size_t buffer_size() const
+		{
+			return _buffer_size;
+		}
+
+		/** Bytes written to the stream but not yet to the fd. */
+		std::string_view pending() const
+		{
+			return std::string_view(pbase(), static_cast<size_t>(pptr() - pbase()));
 		}
 
 		/**
@@ -40,11 +158,13 @@ namespace mpp {
 		 * stale handle (which could be unsafe on Windows if the handle
 		 * value has been reused by the OS).  After invalidation,
 		 * overflow() returns EOF and xsputn() returns 0, which causes
-		 * the owning std::ostream to set failbit / badbit.
+		 * the owning std::ostream to set failbit / badbit.  Bytes still
+		 * buffered are discarded: sync() first to keep them.
 		 */
 		void invalidate()
 		{
 			_valid = false;
+			setp(nullptr, nullptr);
 		}
 
 	protected:
@@ -52,6 +172,16 @@ namespace mpp {
 		{
 			if (!_valid)
 				return EOF;
+			if (_buffer) {
+				// The put area is full: send it, then start over with c.
+				if (!flush_buffer())
+					return EOF;
+				if (c != EOF) {
+					*pptr() = traits_type::to_char_type(c);
+					pbump(1);
+				}
+				return traits_type::not_eof(c);
+			}
 			if (c != EOF) {
 				char z = c;
 				if (mpp::write(_fd, &z, 1) != 1) {
@@ -67,9 +197,32 @@ namespace mpp {
 			if (!_valid)
 				return 0;
 			if (num <= 0) return 0;
+			const size_t n = static_cast<size_t>(num);
+			if (_buffer && n <= static_cast<size_t>(epptr() - pptr())) {
+				std::memcpy(pptr(), s, n);
+				pbump(static_cast<int>(n));
+				return num;
+			}
+			// Unbuffered, or it does not fit: pending bytes and s in one go.
+			return write_all_or_part(s, n);
+		}
+
+		int sync() override
+		{
+			if (!_valid)
+				return _buffer && pptr() != pbase() ? -1 : 0;
+			return flush_buffer() ? 0 : -1;
+		}
+
+	private:
+		std::streamsize write_all_or_part(const char *s, size_t n)
+		{
+			if (_buffer)
+				return flush_buffer(s, n) ? static_cast<std::streamsize>(n) : 0;
+			// Keep the partial count when unbuffered, as before.
 			std::streamsize total = 0;
-			while (total < num) {
-				size_t chunk = static_cast<size_t>(num - total);
+			while (static_cast<size_t>(total) < n) {
+				size_t chunk = n - static_cast<size_t>(total);
 #ifdef MOZART_PLATFORM_WIN32
 				// WriteFile accepts DWORD (32-bit); limit chunks to avoid
 				// silent truncation on very large writes (> 4 GiB).
@@ -93,12 +246,28 @@ namespace mpp {
 		// a valid streambuf before any I/O occurs.
 		fdoutbuf _buf;
 	public:
-		explicit fdostream(fd_type fd)
-			: std::ostream(nullptr), _buf(fd)
+		explicit fdostream(fd_type fd, size_t buffer_size = 0)
+			: std::ostream(nullptr), _buf(fd, buffer_size)
 		{
 			rdbuf(&_buf);
 		}
 
+		/** See fdoutbuf::set_buffer_size(). */
+		void set_buffer_size(size_t size)
+		{
+			_buf.set_buffer_size(size);
+		}
+
+		size_t buffer_size() const
+		{
+			return _buf.buffer_size();
+		}
+
+		std::string_view pending() const
+		{
+			return _buf.pending();
+		}
+
 		/**
 		 * Mark the underlying fd as no longer valid.  After this call,
 		 * writes to the stream are safely refused (the underlying
@@ -130,19 +299,150 @@ namespace mpp {
 		static constexpr size_t PUTBACK_SIZE = 4;
 
 		/**
-		 * size of the data buffer
+		 * default size of the data buffer
 		 */
 		static constexpr size_t BUFFER_SIZE = 1024;
 
-		char _buffer[BUFFER_SIZE + PUTBACK_SIZE] {0};
+		/**
+		 * smallest free space drain() reads into
+		 */
+		static constexpr size_t DRAIN_CHUNK = 64 * 1024;
+
+		/**
+		 * smallest buffer read_line() reads into
+		 */
+		static constexpr size_t LINE_CHUNK = 64 * 1024;
+
+		std::unique_ptr<char[]> _buffer;
+		size_t _buffer_size = 0;
 
 	public:
-		explicit fdinbuf(mpp::fd_type fd)
+		explicit fdinbuf(mpp::fd_type fd, size_t buffer_size = 0)
 			: _fd(fd)
 		{
-			setg(_buffer + PUTBACK_SIZE,     // beginning of putback area
-			     _buffer + PUTBACK_SIZE,     // read position
-			     _buffer + PUTBACK_SIZE);    // end position
+			set_buffer_size(buffer_size);
+		}
+
+		fdinbuf(const fdinbuf &) = delete;
+
+		fdinbuf &operator=(const fdinbuf &) = delete;
+
+		/**
+		 * Resize the data buffer (0 = BUFFER_SIZE), which is the most one
+		 * underflow() asks the fd for.  Unread bytes are kept, and the
+		 * buffer never shrinks below them.
+		 */
+		void set_buffer_size(size_t size)
+		{
+			if (size == 0)
+				size = BUFFER_SIZE;
+			const size_t unread = _buffer ? static_cast<size_t>(egptr() - gptr()) : 0;
+			size = std::max(size, unread);
+			std::unique_ptr<char[]> buffer(new char[size + PUTBACK_SIZE]);
+			if (unread > 0)
+				std::memcpy(buffer.get() + PUTBACK_SIZE, gptr(), unread);
+			_buffer = std::move(buffer);
+			_buffer_size = size;
+			setg(_buffer.get() + PUTBACK_SIZE,           // beginning of putback area
+			     _buffer.get() + PUTBACK_SIZE,           // read position
+			     _buffer.get() + PUTBACK_SIZE + unread); // end position
+		}
+
+		size_t buffer_size() const
+		{
+			return _buffer_size;
+		}
+
+		/**
+		 * Append everything up to EOF to @p out: first the bytes already
+		 * buffered, then straight from the fd into the string's own
+		 * storage, which grows geometrically (by at least DRAIN_CHUNK),
+		 * with no intermediate copy.  @p size_hint, the expected total
+		 * when known, pre-sizes the string so it never regrows.  Returns
+		 * the number of bytes appended.
+		 */
+		size_t drain(std::string &out, size_t size_hint = 0)
+		{
+			const size_t start = out.size();
+			out.append(gptr(), static_cast<size_t>(egptr() - gptr()));
+			setg(_buffer.get() + PUTBACK_SIZE,
+			     _buffer.get() + PUTBACK_SIZE,
+			     _buffer.get() + PUTBACK_SIZE);
+			size_t filled = out.size();
+			out.resize(std::max(filled + DRAIN_CHUNK, start + size_hint + 1));
+			for (;;) {
+				if (filled == out.size())
+					out.resize(std::max(filled + DRAIN_CHUNK, out.size() * 2));
+				size_t want = out.size() - filled;
+#ifdef MOZART_PLATFORM_WIN32
+				want = std::min(want, static_cast<size_t>(std::numeric_limits<DWORD>::max()));
+#endif
+				mpp::ssize_t num = mpp::read(_fd, &out[filled], want);
+#ifndef MOZART_PLATFORM_WIN32
+				if (num < 0 && errno == EINTR)
+					continue;
+#endif
+				if (num <= 0)
+					break; // EOF, or an error: keep what arrived
+				filled += static_cast<size_t>(num);
+			}
+			out.resize(filled);
+			return filled - start;
+		}
+
+		/**
+		 * Read at most @p n bytes into @p p: the bytes already buffered,
+		 * or else one read() of the fd, which blocks only while nothing
+		 * is available.  Returns 0 at EOF (or on an error).
+		 */
+		size_t read_some(char *p, size_t n)
+		{
+			const size_t buffered = static_cast<size_t>(egptr() - gptr());
+			if (buffered > 0) {
+				const size_t k = std::min(n, buffered);
+				std::memcpy(p, gptr(), k);
+				gbump(static_cast<int>(k));
+				return k;
+			}
+#ifdef MOZART_PLATFORM_WIN32
+			n = std::min(n, static_cast<size_t>(std::numeric_limits<DWORD>::max()));
+#endif
+			for (;;) {
+				mpp::ssize_t num = mpp::read(_fd, p, n);
+#ifndef MOZART_PLATFORM_WIN32
+				if (num < 0 && errno == EINTR)
+					continue;
+#endif
+				return num > 0 ? static_cast<size_t>(num) : 0;
+			}
+		}
+
+		/**
+		 * Replace @p line with everything up to and including the next
+		 * '\n'.  The buffer is searched with find_newline() rather than
+		 * a character at a time, and grows to at least LINE_CHUNK first
+		 * so each read fetches many lines.  Returns false at EOF with
+		 * nothing read; an unterminated last line comes back as is.
+		 */
+		bool read_line(std::string &line)
+		{
+			line.clear();
+			if (_buffer_size < LINE_CHUNK)
+				set_buffer_size(LINE_CHUNK);
+			for (;;) {
+				const char *nl = find_newline(gptr(), egptr());
+				if (nl != nullptr) {
+					const size_t n = static_cast<size_t>(nl + 1 - gptr());
+					line.append(gptr(), n);
+					gbump(static_cast<int>(n));
+					return true;
+				}
+				const size_t n = static_cast<size_t>(egptr() - gptr());
+				line.append(gptr(), n);
+				gbump(static_cast<int>(n));
+				if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+					return !line.empty();
+			}
 		}
 
 	protected:
@@ -154,6 +454,8 @@ namespace mpp {
 				return traits_type::to_int_type(*gptr());
 			}
 
+			char *const base = _buffer.get();
+
 			// handle putback area
 			size_t backSize = gptr() - eback();
 			if (backSize > PUTBACK_SIZE) {
@@ -162,12 +464,12 @@ namespace mpp {
 
 			// copy up to PUTBACK_SIZE characters previously read into
 			// the putback area
-			std::memmove(_buffer + (PUTBACK_SIZE - backSize),
+			std::memmove(base + (PUTBACK_SIZE - backSize),
 			             gptr() - backSize,
 			             backSize);
 
-			// read at most BUFFER_SIZE new characters
-			int num = mpp::read(_fd, _buffer + PUTBACK_SIZE, BUFFER_SIZE);
+			// read at most _buffer_size new characters
+			mpp::ssize_t num = mpp::read(_fd, base + PUTBACK_SIZE, _buffer_size);
 			if (num <= 0) {
 				// it might be error happened somewhere or EOF encountered
 				// we simply return EOF
@@ -175,9 +477,9 @@ namespace mpp {
 			}
 
 			// reset buffer pointers
-			setg(_buffer + (PUTBACK_SIZE - backSize),
-			     _buffer + PUTBACK_SIZE,
-			     _buffer + PUTBACK_SIZE + num);
+			setg(base + (PUTBACK_SIZE - backSize),
+			     base + PUTBACK_SIZE,
+			     base + PUTBACK_SIZE + num);
 
 			// return next character
 			return traits_type::to_int_type(*gptr());
@@ -188,12 +490,41 @@ namespace mpp {
 	private:
 		fdinbuf _buf;
 	public:
-		explicit fdistream(fd_type fd)
-			: std::istream(nullptr), _buf(fd)
+		explicit fdistream(fd_type fd, size_t buffer_size = 0)
+			: std::istream(nullptr), _buf(fd, buffer_size)
 		{
 			rdbuf(&_buf);
 		}
 
+		/** See fdinbuf::set_buffer_size(). */
+		void set_buffer_size(size_t size)
+		{
+			_buf.set_buffer_size(size);
+		}
+
+		size_t buffer_size() const
+		{
+			return _buf.buffer_size();
+		}
+
+		/** See fdinbuf::drain(). */
+		size_t drain(std::string &out, size_t size_hint = 0)
+		{
+			return _buf.drain(out, size_hint);
+		}
+
+		/** See fdinbuf::read_some(). */
+		size_t read_some(char *p, size_t n)
+		{
+			return _buf.read_some(p, n);
+		}
+
+		/** See fdinbuf::read_line(). */
+		bool read_line(std::string &line)
+		{
+			return _buf.read_line(line);
+		}
+
 #ifdef MOZART_PLATFORM_WIN32
 
 		explicit fdistream(int cfd)
@@ -0,0 +1,132 @@
+/**
+ * Mozart++ Template Library: Foundation/Lines
+ *
+ * Licensed under Apache 2.0
+ *
+ * Copyright (C) 2017-2026 Michael Lee(李登淳)
+ *
+ * Email:   mikecovlee@163.com
+ * Github:  https://github.com/mikecovlee
+ * Website: http://covscript.org.cn
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MOZART_LINES_VECTOR_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MOZART_LINES_VECTOR_WIDTH 16
+#endif
+
+#if defined(MOZART_LINES_VECTOR_WIDTH) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace mpp {
+	namespace lines_impl {
+#ifdef MOZART_LINES_VECTOR_WIDTH
+		// Index of the lowest set bit of a non-zero compare mask.
+		inline unsigned lowest_bit(unsigned mask)
+		{
+#if defined(_MSC_VER) && !defined(__clang__)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return static_cast<unsigned>(index);
+#else
+			return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+		}
+#endif
+	}
+
+	/**
+	 * First '\n' in [p, end), or nullptr.  Compares 32 (AVX2) or 16
+	 * (SSE2) bytes per step when the target enables them at compile
+	 * time; the remainder, and other targets, go through memchr().
+	 * Inlined, so short lines pay no call for each search.
+	 */
+	inline const char *find_newline(const char *p, const char *end)
+	{
+#if MOZART_LINES_VECTOR_WIDTH == 32
+		const __m256i nl = _mm256_set1_epi8('\n');
+		while (end - p >= 32) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+			const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+			if (mask != 0)
+				return p + lines_impl::lowest_bit(mask);
+			p += 32;
+		}
+#elif MOZART_LINES_VECTOR_WIDTH == 16
+		const __m128i nl = _mm_set1_epi8('\n');
+		while (end - p >= 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+			if (mask != 0)
+				return p + lines_impl::lowest_bit(mask);
+			p += 16;
+		}
+#endif
+		if (p >= end)
+			return nullptr;
+		return static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+	}
+
+	/** @p line without a trailing '\r' (the rest of a "\r\n"). */
+	inline std::string_view chomp_cr(std::string_view line)
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		return line;
+	}
+
+	/**
+	 * Call @p fn(std::string_view) with each complete line of @p data,
+	 * without its "\n" or "\r\n".  Returns the bytes consumed, i.e. up
+	 * to and including the last '\n'; what follows is an unterminated
+	 * line the caller completes with more data or takes as is at EOF.
+	 */
+	template <typename F>
+	size_t for_each_line(std::string_view data, F &&fn)
+	{
+		const char *begin = data.data();
+		const char *p = begin;
+		const char *end = begin + data.size();
+		while (const char *nl = find_newline(p, end)) {
+			fn(chomp_cr(std::string_view(p, static_cast<size_t>(nl - p))));
+			p = nl + 1;
+		}
+		return static_cast<size_t>(p - begin);
+	}
+
+	/** Number of '\n' in @p data. */
+	inline size_t count_newlines(std::string_view data)
+	{
+		size_t n = 0;
+		const char *end = data.data() + data.size();
+		for (const char *p = data.data(); (p = find_newline(p, end)) != nullptr; ++p)
+			++n;
+		return n;
+	}
+
+	/**
+	 * Split @p data into lines as for_each_line() does, appending them
+	 * to @p out; an unterminated last line is included.  A counting pass
+	 * sizes @p out first, which costs less than regrowing it.
+	 */
+	inline void split_lines(std::string_view data, std::vector<std::string> &out)
+	{
+		out.reserve(out.size() + count_newlines(data) + 1);
+		const size_t used = for_each_line(data, [&out](std::string_view line) {
+			out.emplace_back(line);
+		});
+		if (used < data.size())
+			out.emplace_back(chomp_cr(data.substr(used)));
+	}
+}
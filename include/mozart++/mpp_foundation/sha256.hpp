@@ -0,0 +1,135 @@
+/**
+ * Mozart++ Template Library: Foundation/SHA-256
+ *
+ * Licensed under Apache 2.0
+ *
+ * Copyright (C) 2017-2026 Michael Lee(李登淳)
+ *
+ * Email:   mikecovlee@163.com
+ * Github:  https://github.com/mikecovlee
+ * Website: http://covscript.org.cn
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace mpp {
+	/**
+	 * Incremental SHA-256 (FIPS 180-4), for content addressing rather
+	 * than anything security-sensitive: update() any number of times,
+	 * then hex_digest() once.
+	 */
+	class sha256 {
+		uint32_t _state[8] = {
+			0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au,
+			0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u
+		};
+		unsigned char _block[64];
+		size_t _used = 0;
+		uint64_t _length = 0;
+
+		static uint32_t rotr(uint32_t x, unsigned n)
+		{
+			return (x >> n) | (x << (32 - n));
+		}
+
+		void compress(const unsigned char *p)
+		{
+			static const uint32_t k[64] = {
+				0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u, 0x3956c25bu, 0x59f111f1u, 0x923f82a4u, 0xab1c5ed5u,
+				0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u, 0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u,
+				0xe49b69c1u, 0xefbe4786u, 0x0fc19dc6u, 0x240ca1ccu, 0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+				0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u, 0xc6e00bf3u, 0xd5a79147u, 0x06ca6351u, 0x14292967u,
+				0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u, 0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u,
+				0xa2bfe8a1u, 0xa81a664bu, 0xc24b8b70u, 0xc76c51a3u, 0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+				0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u, 0x391c0cb3u, 0x4ed8aa4au, 0x5b9cca4fu, 0x682e6ff3u,
+				0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u, 0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u
+			};
+			uint32_t w[64];
+			for (int i = 0; i < 16; ++i)
+				w[i] = uint32_t(p[4 * i]) << 24 | uint32_t(p[4 * i + 1]) << 16 |
+				       uint32_t(p[4 * i + 2]) << 8 | uint32_t(p[4 * i + 3]);
+			for (int i = 16; i < 64; ++i) {
+				const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+				const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+				w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+			}
+			uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+			uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+			for (int i = 0; i < 64; ++i) {
+				const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+				const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+				h = g;
+				g = f;
+				f = e;
+				e = d + t1;
+				d = c;
+				c = b;
+				b = a;
+				a = t1 + t2;
+			}
+			_state[0] += a;
+			_state[1] += b;
+			_state[2] += c;
+			_state[3] += d;
+			_state[4] += e;
+			_state[5] += f;
+			_state[6] += g;
+			_state[7] += h;
+		}
+
+	public:
+		sha256 &update(const void *data, size_t n)
+		{
+			const unsigned char *p = static_cast<const unsigned char *>(data);
+			_length += n;
+			if (_used > 0) {
+				const size_t k = n < 64 - _used ? n : 64 - _used;
+				std::memcpy(_block + _used, p, k);
+				_used += k;
+				p += k;
+				n -= k;
+				if (_used < 64)
+					return *this;
+				compress(_block);
+				_used = 0;
+			}
+			for (; n >= 64; p += 64, n -= 64)
+				compress(p);
+			std::memcpy(_block, p, n);
+			_used = n;
+			return *this;
+		}
+
+		sha256 &update(std::string_view data)
+		{
+			return update(data.data(), data.size());
+		}
+
+		/** The digest as 64 lowercase hex digits; the object is spent after. */
+		std::string hex_digest()
+		{
+			const uint64_t bits = _length * 8;
+			const unsigned char pad = 0x80;
+			update(&pad, 1);
+			const unsigned char zero[64] = {};
+			update(zero, (_used <= 56 ? 56 : 120) - _used);
+			unsigned char len[8];
+			for (int i = 0; i < 8; ++i)
+				len[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+			update(len, 8);
+			static const char digits[] = "0123456789abcdef";
+			std::string out(64, '0');
+			for (int i = 0; i < 32; ++i) {
+				const unsigned byte = (_state[i / 4] >> (24 - 8 * (i % 4))) & 0xffu;
+				out[2 * i] = digits[byte >> 4];
+				out[2 * i + 1] = digits[byte & 0xfu];
+			}
+			return out;
+		}
+	};
+}
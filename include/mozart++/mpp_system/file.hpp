@@ -29,6 +29,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace mpp {
 
@@ -57,6 +58,12 @@ namespace mpp {
 		std::unique_ptr<fdistream> _istream;
 		std::unique_ptr<fdostream> _ostream;
 
+		// Read-ahead of line reads: the file's bytes from offset
+		// _ahead_pos on start at _ahead[_ahead_off].
+		std::string _ahead;
+		size_t _ahead_off = 0;
+		int64_t _ahead_pos = 0;
+
 #ifdef MOZART_PLATFORM_WIN32
 		HANDLE _handle = INVALID_HANDLE_VALUE;
 		int _uv_fd = -1;  // C runtime fd for libuv, created via _open_osfhandle
@@ -152,8 +159,68 @@ namespace mpp {
 		void advance_write(int64_t n)
 		{
 			_write_pos += n;
+			// The write may have changed bytes read ahead.
+			_ahead.clear();
+			_ahead_off = 0;
+		}
+
+		// ------------------------------------------------------------------
+		// Read-ahead (used by CNI readline / lines)
+		// ------------------------------------------------------------------
+
+		/**
+		 * Bytes of the file from read_position() on that a line read
+		 * fetched but has not consumed yet.  Dropped once the position
+		 * moves by other means or the file is written.
+		 */
+		std::string_view read_ahead()
+		{
+			sync_read_ahead();
+			return std::string_view(_ahead).substr(_ahead_off);
 		}
 
+		/**
+		 * Room for @p n more bytes after read_ahead(), to read the file
+		 * at read_position() + read_ahead().size() into; settle with
+		 * commit_read_ahead().  Consumed bytes are dropped first.
+		 */
+		char *extend_read_ahead(size_t n)
+		{
+			sync_read_ahead();
+			if (_ahead_off > 0) {
+				_ahead.erase(0, _ahead_off);
+				_ahead_off = 0;
+			}
+			const size_t size = _ahead.size();
+			_ahead.resize(size + n);
+			return &_ahead[size];
+		}
+
+		/** Keep @p used of the @p extended bytes extend_read_ahead() added. */
+		void commit_read_ahead(size_t extended, size_t used)
+		{
+			_ahead.resize(_ahead.size() - extended + used);
+		}
+
+		/** Consume the first @p n bytes of read_ahead(), advancing read_position(). */
+		void consume_read_ahead(size_t n)
+		{
+			_ahead_off += n;
+			_read_pos += static_cast<int64_t>(n);
+			_ahead_pos = _read_pos;
+		}
+
+	private:
+		void sync_read_ahead()
+		{
+			if (_ahead_pos != _read_pos) {
+				_ahead.clear();
+				_ahead_off = 0;
+				_ahead_pos = _read_pos;
+			}
+		}
+
+	public:
 		// ------------------------------------------------------------------
 		// Native handle access
 		// ------------------------------------------------------------------
@@ -17,19 +17,30 @@
 #include <mozart++/core>
 #include <mozart++/fdstream>
 #include <optional>
+#include <functional>
 #include <unordered_map>
 #include <algorithm>
+#include <deque>
 #include <cassert>
 #include <chrono>
 #include <sstream>
 #include <thread>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <atomic>
+#include <utility>
+#include <cerrno>
+#include <cstring>
 
 #include <uv.h>
 
+#ifdef MOZART_PLATFORM_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace mpp_impl {
 	using mpp::fd_type;
 	using mpp::FD_INVALID;
@@ -48,6 +59,80 @@ namespace mpp_impl {
 		}
 	};
 
+	/**
+	 * How the *nix implementation obtains the child process.
+	 *
+	 *   automatic: spawn without copying the parent's address space
+	 *              (Linux: clone(CLONE_VM | CLONE_VFORK)), falling back to
+	 *              fork() where that is unavailable.
+	 *   fork:      always use fork().  Kept for diagnostics and benchmarks.
+	 *
+	 * Ignored on Win32, where CreateProcess never copies the parent.
+	 */
+	enum class spawn_backend {
+		automatic,
+		fork
+	};
+
+	/**
+	 * Prebuilt, immutable child environment in the platform's native layout
+	 * (envp array on *nix, sorted double-NUL block on Win32).  One block is
+	 * shared by every builder copy and spawn that uses it, and is rebuilt
+	 * only when the builder's overrides or the parent environment change.
+	 */
+	struct environment_block;
+	using environment_ptr = std::shared_ptr<const environment_block>;
+
+	/**
+	 * argv laid out in a single allocation: the null-terminated pointer
+	 * table followed by the NUL-terminated strings it points to.  Built
+	 * once per launch by spawn_spec instead of copying a vector<string>.
+	 */
+	class argv_block {
+		std::unique_ptr<char[]> _storage;
+		size_t _argc = 0;
+
+	public:
+		/** Lay out @p head followed by @p tail. */
+		argv_block(const std::vector<std::string> &head, const std::vector<std::string> &tail)
+			: _argc(head.size() + tail.size())
+		{
+			const size_t table = (_argc + 1) * sizeof(char *);
+			size_t bytes = table;
+			for (const auto &a : head)
+				bytes += a.size() + 1;
+			for (const auto &a : tail)
+				bytes += a.size() + 1;
+			// operator new[] storage is suitably aligned for the pointer table.
+			_storage.reset(new char[bytes]);
+			char **ptrs = reinterpret_cast<char **>(_storage.get());
+			char *p = _storage.get() + table;
+			size_t i = 0;
+			for (const auto *part : {&head, &tail}) {
+				for (const auto &a : *part) {
+					ptrs[i++] = p;
+					std::memcpy(p, a.data(), a.size());
+					p += a.size();
+					*p++ = '\0';
+				}
+			}
+			ptrs[_argc] = nullptr;
+		}
+
+		argv_block(const argv_block &) = delete;
+		argv_block &operator=(const argv_block &) = delete;
+
+		size_t size() const
+		{
+			return _argc;
+		}
+
+		const char *operator[](size_t i) const
+		{
+			return reinterpret_cast<char *const *>(_storage.get())[i];
+		}
+	};
+
 	struct process_startup {
 		std::vector<std::string> _cmdline;
 		std::optional<std::string> _shell_program;
@@ -55,6 +140,10 @@ namespace mpp_impl {
 		// When true (default), the child inherits the parent's environment,
 		// with _env entries applied as overrides.  When false only _env is used.
 		bool _inherit_env = true;
+		// Cached result of make_environment_block() for the fields above;
+		// reset whenever _env or _inherit_env change.  When null the
+		// environment is built at spawn time.
+		environment_ptr _env_block;
 		std::string _cwd = ".";
 		redirect_info _stdin;
 		redirect_info _stdout;
@@ -67,6 +156,36 @@ namespace mpp_impl {
 		bool _inherit_stderr = false;
 		// When true, the command is wrapped in a shell (sh -c / cmd /c).
 		bool _shell_mode = false;
+		spawn_backend _backend = spawn_backend::automatic;
+		// Absolute path of _cmdline[0] resolved ahead of time (spawn_spec).
+		// When non-empty the *nix backend execs it without a PATH search.
+		std::string _executable;
+		// Put area of process::in() in bytes; 0 keeps it unbuffered.
+		size_t _stdin_buffer = 0;
+		// Read buffer of process::out() / err() in bytes; 0 = fdinbuf default.
+		size_t _read_buffer = 0;
+		// Expected size of the captured stdout (0 = unknown), so
+		// communicate() can size its string once.
+		size_t _output_hint = 0;
+		// communicate() keeps only the first _keep_head and the last
+		// _keep_tail bytes of each stream when either is non-zero.
+		size_t _keep_head = 0;
+		size_t _keep_tail = 0;
+		// Send stdout / stderr to anonymous capture files instead of pipes
+		// (process_builder::capture_mapped()).  Inherited or redirected
+		// streams are not captured.
+		bool _capture_mapped = false;
+		// Captures whose _output_hint exceeds this go to a disk-backed
+		// file rather than memory; 0 keeps every capture in memory.
+		size_t _capture_memory_cap = 0;
+		// Directory of disk-backed captures; empty = the system temp dir.
+		std::string _capture_dir;
+		// Limits enforced by a timer on the default loop: run time and
+		// time without output, in ms (0 = none).
+		uint64_t _timeout_ms = 0;
+		uint64_t _idle_timeout_ms = 0;
+		// Between the SIGTERM of a limit and the SIGKILL; 0 = SIGKILL at once.
+		uint64_t _kill_grace_ms = 5000;
 	};
 
 	struct process_info {
@@ -91,15 +210,146 @@ namespace mpp_impl {
 		 * 0 means "not recorded" (platform limitation or legacy process_info).
 		 */
 		uint64_t _start_time = 0;
+		/**
+		 * Children started through the fork server (*nix): read end of the
+		 * channel the server reports the exit code on, since only the
+		 * server can reap them.  FD_INVALID for children we forked.
+		 */
+		fd_type _status_fd = FD_INVALID;
+		// Exit code received on _status_fd; the channel can be read once.
+		mutable std::optional<int> _remote_exit;
+		/**
+		 * Linux: pidfd of a child we forked.  Pins the child's identity for
+		 * signalling and becomes readable when it exits.  FD_INVALID where
+		 * pidfds are unavailable.
+		 */
+		fd_type _pidfd = FD_INVALID;
+		/**
+		 * Anonymous files the child's stdout / stderr were captured into
+		 * (process_startup::_capture_mapped).  FD_INVALID when the stream
+		 * was not captured; _capture_err is also FD_INVALID when stderr
+		 * was merged into the stdout capture.
+		 */
+		fd_type _capture_out = FD_INVALID;
+		fd_type _capture_err = FD_INVALID;
 	};
 
+	/**
+	 * Build the child environment described by startup._env and
+	 * startup._inherit_env.  Returns nullptr when the child simply inherits
+	 * the parent's environment unchanged (nothing to build).
+	 */
+	environment_ptr make_environment_block(const process_startup &startup);
+
+	/**
+	 * True while the parent environment still matches the snapshot @p env
+	 * was merged from (always true for non-inheriting blocks).
+	 */
+	bool environment_block_current(const environment_block &env);
+
+	/**
+	 * Make startup._env_block valid for the current parent environment,
+	 * rebuilding it only when missing or stale.
+	 */
+	inline void refresh_environment(process_startup &startup)
+	{
+		if (startup._inherit_env && startup._env.empty()) {
+			startup._env_block.reset();
+			return;
+		}
+		if (!startup._env_block || !environment_block_current(*startup._env_block))
+			startup._env_block = make_environment_block(startup);
+	}
+
+	/**
+	 * Fork server (*nix only).  A small helper process, forked while the
+	 * host is still lean and single-threaded, that creates children on our
+	 * behalf: spawn requests and the children's stdio descriptors travel
+	 * over a Unix socket, so the cost of creating a child no longer depends
+	 * on the size or thread count of this process.  While it runs, spawns
+	 * with spawn_backend::automatic go through it; if it dies they fall
+	 * back to spawning locally.
+	 *
+	 * fork_server_start() is idempotent and returns false where the server
+	 * is unsupported (Win32) or could not be started.
+	 */
+	bool fork_server_start();
+
+	void fork_server_stop();
+
+	bool fork_server_running();
+
+	/**
+	 * Resolve @p file against the parent's PATH the way the child would.
+	 * Returns true with @p resolved set to the path to exec; false when the
+	 * lookup has to be left to spawn time (relative PATH entries, missing
+	 * command, or a platform that searches PATH itself).
+	 */
+	bool resolve_executable(const std::string &file, std::string &resolved);
+
+	/**
+	 * The parent's current environment as name / value pairs; the first
+	 * of duplicate names wins, as it does for getenv().
+	 */
+	std::unordered_map<std::string, std::string> parent_environment();
+
+	/**
+	 * When @p argv is non-null it replaces startup._cmdline as the child's
+	 * argument list, so prepared specs never copy the startup info.
+	 */
 	void create_process_impl(const process_startup &startup,
 	                         process_info &info,
-	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr);
+	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                         const argv_block *argv = nullptr);
 
 	bool redirect_or_pipe(const redirect_info &r, fd_type fds[2]);
 
-	void create_process(const process_startup &startup, process_info &info);
+	/**
+	 * Create the stdio pipes described by @p startup (nothing for inherited
+	 * or redirected streams).  Throws, with nothing left open, on failure.
+	 */
+	void open_stdio(const process_startup &startup,
+	                fd_type *pstdin, fd_type *pstdout, fd_type *pstderr);
+
+	/** Roll back open_stdio(); redirect targets are left to their owner. */
+	void close_stdio(const process_startup &startup,
+	                 fd_type *pstdin, fd_type *pstdout, fd_type *pstderr);
+
+	void create_process(const process_startup &startup, process_info &info,
+	                    const argv_block *argv = nullptr);
+
+	/**
+	 * Start @p count children from one startup description.  Argument,
+	 * environment and PATH preparation is done once for the batch; that
+	 * is the whole saving with the default backend, whose launch returns
+	 * only after the child has exec'd, so the children still start one
+	 * after another.  With spawn_backend::fork every child is created
+	 * before any exec result is collected.  On return errors[i] is empty
+	 * when infos[i] describes a running child, and holds the failure
+	 * message otherwise.
+	 */
+	void create_processes(const process_startup &startup, size_t count,
+	                      std::vector<process_info> &infos,
+	                      std::vector<std::string> &errors,
+	                      const argv_block *argv = nullptr);
+
+	/**
+	 * Pipe joining two children of a pipeline.  Neither end is inherited by
+	 * unrelated children (*nix: close-on-exec; Win32: no HANDLE_FLAG_INHERIT);
+	 * each end is passed to its one child as a redirect target.
+	 */
+	bool create_chain_pipe(fd_type fds[2]);
+
+	/**
+	 * Start the stages of a | b | c: stage i's stdout feeds stage i+1's
+	 * stdin through a chain pipe, whose parent-side copies are closed as
+	 * soon as the child holding them is running, so the parent only keeps
+	 * the first stdin and the last stdout / stderr.  Redirects of the
+	 * joined streams in @p stages are overridden.  On failure the stages
+	 * already started are killed and reaped before the error is rethrown.
+	 */
+	void create_pipeline(std::vector<process_startup> &stages,
+	                     std::vector<process_info> &infos);
 
 	void close_process(process_info &info);
 
@@ -121,6 +371,86 @@ namespace mpp_impl {
 	bool wait_timeout_ms(const process_info &info, int timeout_ms, int &exit_code,
 	                     int poll_interval_ms = 5);
 
+	/**
+	 * Descriptor that becomes readable once the child has exited, so the
+	 * event loop can wait for it without a blocked thread: the pidfd, or
+	 * the fork server's status channel.  FD_INVALID when there is none
+	 * (Win32, or *nix without pidfd support).
+	 */
+	fd_type exit_notify_fd(const process_info &info);
+
+	/**
+	 * Make writes to a pipe whose reader has gone fail with EPIPE instead
+	 * of killing this process: SIGPIPE is set to SIG_IGN unless the host
+	 * already installed a disposition of its own.  No-op on Win32.
+	 */
+	void ignore_sigpipe();
+
+	/**
+	 * CPUs this process may actually use, at least 1: the affinity mask
+	 * (Linux sched_getaffinity, Win32 process affinity), further capped
+	 * by a cgroup CPU quota (v2 cpu.max, v1 cpu.cfs_quota_us) rounded up.
+	 * Other *nix report the online processors.
+	 */
+	unsigned available_cpus();
+
+	/**
+	 * Copy @p length bytes (everything up to EOF when negative) of file
+	 * @p src, starting at @p offset, into the pipe @p dst, without
+	 * touching the file position.  Linux moves the pages with splice()
+	 * and never copies them through user space; elsewhere, or when splice
+	 * refuses the pair, it falls back to pread() / write().  A full pipe
+	 * is waited on for at most @p deadline_ms (< 0 waits indefinitely).
+	 * Returns the bytes moved; fewer than asked means EOF, the reader
+	 * went away, or the deadline passed.  Throws on any other IO error.
+	 * Win32 reads and writes in chunks and checks the deadline between
+	 * them, as a write to a full anonymous pipe cannot time out.
+	 */
+	uint64_t pump_file(fd_type src, uint64_t offset, int64_t length,
+	                   fd_type dst, int deadline_ms);
+
+	/**
+	 * Read at most @p n bytes from pipe @p fd without blocking.  Returns
+	 * the byte count, 0 at EOF (a read error counts as EOF), or -1 when
+	 * nothing is available yet.
+	 */
+	mpp::ssize_t read_nonblock(fd_type fd, char *buf, size_t n);
+
+	/**
+	 * Write at most @p n bytes to pipe @p fd without blocking.  Returns
+	 * the byte count (0 when the pipe is full), or -1 once the reader has
+	 * gone or on any other error.
+	 */
+	mpp::ssize_t write_nonblock(fd_type fd, const char *buf, size_t n);
+
+	/**
+	 * Wait at most @p timeout_ms (< 0: no limit) for pipe @p fd to become
+	 * readable, or writable when @p for_write.  Returns false on timeout.
+	 * EOF and a closed reader count as ready.  Win32 cannot wait on an
+	 * anonymous pipe and polls it every millisecond instead.
+	 */
+	bool wait_pipe(fd_type fd, bool for_write, int timeout_ms);
+
+	/**
+	 * Anonymous, read-write file to capture a child's output into.  In
+	 * memory (Linux: memfd_create) unless startup._capture_memory_cap is
+	 * set and startup._output_hint exceeds it; then disk-backed in
+	 * startup._capture_dir (Linux: O_TMPFILE, other *nix: an unlinked
+	 * temporary file).  Win32 always uses a delete-on-close temporary
+	 * file.  Never inherited by unrelated children.  Throws on failure.
+	 */
+	fd_type create_capture_file(const process_startup &startup);
+
+	/**
+	 * Map everything written to capture file @p fd so far, read-only.
+	 * @p mapping receives the platform mapping handle (Win32) to pass
+	 * back to unmap_capture().  An empty capture maps nothing (data is
+	 * null, size 0).  Throws on failure.
+	 */
+	void map_capture(fd_type fd, const char *&data, size_t &size, fd_type &mapping);
+
+	void unmap_capture(const char *data, size_t size, fd_type mapping);
+
 	/**
 	 * Return the OS-level process ID (integer PID on *nix, dwProcessId on Win32).
 	 */
@@ -141,28 +471,215 @@ namespace mpp_impl {
 namespace mpp {
 	namespace detail {
 
+		struct exit_watch;
+		struct pipe_reader;
+		struct pipe_writer;
+		struct frame_writer;
+		struct output_reader;
+
+		/**
+		 * Bounded capture of one output stream: the first head_limit bytes
+		 * plus a ring of the last tail_limit bytes, whatever the child
+		 * writes in total (process_builder::keep_output()).  Memory stays
+		 * at head_limit + tail_limit.
+		 */
+		struct output_window {
+			size_t head_limit = 0;
+			size_t tail_limit = 0;
+			std::string head;
+			std::string ring;
+			// Next write position in ring once it has wrapped.
+			size_t ring_pos = 0;
+			uint64_t total = 0;
+
+			output_window(size_t head_bytes, size_t tail_bytes)
+				: head_limit(head_bytes), tail_limit(tail_bytes) {}
+
+			void append(const char *p, size_t n)
+			{
+				total += n;
+				if (head.size() < head_limit) {
+					const size_t k = std::min(n, head_limit - head.size());
+					head.append(p, k);
+					p += k;
+					n -= k;
+				}
+				if (n == 0 || tail_limit == 0)
+					return;
+				if (n >= tail_limit) {
+					ring.assign(p + (n - tail_limit), tail_limit);
+					ring_pos = 0;
+					return;
+				}
+				if (ring.size() < tail_limit) {
+					const size_t k = std::min(n, tail_limit - ring.size());
+					ring.append(p, k);
+					p += k;
+					n -= k;
+				}
+				while (n > 0) {
+					const size_t k = std::min(n, tail_limit - ring_pos);
+					ring.replace(ring_pos, k, p, k);
+					ring_pos = (ring_pos + k) % tail_limit;
+					p += k;
+					n -= k;
+				}
+			}
+
+			bool truncated() const
+			{
+				return total > head.size() + ring.size();
+			}
+
+			/** The kept bytes in order: head, then the tail oldest first. */
+			std::string take()
+			{
+				std::string out = std::move(head);
+				out.reserve(out.size() + ring.size());
+				out.append(ring, ring_pos, std::string::npos);
+				out.append(ring, 0, ring_pos);
+				ring.clear();
+				ring_pos = 0;
+				return out;
+			}
+		};
+
 		/**
-		 * Opaque async-work state backed by libuv's thread pool (uv_queue_work).
+		 * Opaque state of one asynchronous wait, output drain or stdin feed.
 		 *
-		 * Replaces the previous std::async / std::future implementation, which
-		 * spawned a fresh OS thread per operation.  libuv reuses a fixed-size
-		 * thread pool (default 4 threads), integrates with the CovScript event
-		 * loop, and lets poll_*() methods drive completion via uv_run() without
-		 * syscalls on the hot path.
+		 * On Unix the work is done on the loop thread wherever the platform
+		 * allows: a wait watches the child's pidfd, or the fork server's
+		 * status pipe, with a uv_poll_t (exit_watch), and pipes are read and
+		 * written through non-blocking uv_pipe_t handles (pipe_reader,
+		 * pipe_writer).  Elsewhere, or when such a handle cannot be set up,
+		 * req goes to libuv's thread pool (uv_queue_work): the work callback
+		 * blocks on a pool thread and the after-work callback runs on the
+		 * loop thread from uv_run().  Either path ends in complete_work(), so
+		 * poll_*() only runs the loop and checks done, with no syscall on the
+		 * hot path.
 		 *
-		 * Instances are allocated on the heap and owned by std::unique_ptr inside
-		 * member_holder.  The work callback runs on a libuv thread-pool thread;
-		 * the after-work callback runs on the loop thread when uv_run() is called.
+		 * Instances are allocated on the heap and owned by std::unique_ptr
+		 * inside member_holder.
 		 */
 		struct async_work {
 			uv_work_t req;
+			// Set while a waiter polls exit_notify_fd() instead of using req.
+			exit_watch *watch = nullptr;
+			// Set while a reader drains its pipe on the loop thread instead
+			// of using req.
+			pipe_reader *reader = nullptr;
+			// Set while a writer feeds `input` to the child on the loop
+			// thread instead of using req.
+			pipe_writer *writer = nullptr;
 			mpp_impl::process_info *info = nullptr;
-			std::istream *stream = nullptr;
+			mpp::fdistream *stream = nullptr;
 			std::atomic<bool> done{false};
 			int exit_code = 0;
 			std::string output;
+			// Expected size of output, to size the string once (0 = unknown).
+			size_t size_hint = 0;
+			// Set when the output is bounded: it collects into the window
+			// instead, and output receives window->take() at EOF.
+			std::unique_ptr<output_window> window;
+			// Bytes the child wrote, and whether output holds only part
+			// of them; set when the output is complete.
+			uint64_t total = 0;
+			bool truncated = false;
+			// communicate(input): the payload, and the stdin descriptor the
+			// work took over from the process (closed once written).
+			std::string input;
+			mpp_impl::fd_type fd = FD_INVALID;
+			// process::on_settle() hook, called on the loop thread once
+			// the work is done; null or empty when nobody listens.
+			const std::function<void()> *notify = nullptr;
+			// Stamp of the last output for the idle watchdog
+			// (process_builder::idle_timeout()); null when not watched.
+			std::atomic<uint64_t> *activity = nullptr;
 		};
 
+		/** Monotonic milliseconds; safe to call from any thread. */
+		inline uint64_t monotonic_ms()
+		{
+			return uv_hrtime() / 1000000;
+		}
+
+		/** Tell the idle watchdog behind @p stamp, if any, that output arrived. */
+		inline void note_output(std::atomic<uint64_t> *stamp)
+		{
+			if (stamp != nullptr)
+				stamp->store(monotonic_ms(), std::memory_order_relaxed);
+		}
+
+		/** Mark @p w done and tell its process's on_settle() listener. */
+		inline void complete_work(async_work *w)
+		{
+			w->done.store(true, std::memory_order_release);
+			if (w->notify != nullptr && *w->notify)
+				(*w->notify)();
+		}
+
+		inline void wake_timer_close_cb(uv_handle_t *h)
+		{
+			delete reinterpret_cast<uv_timer_t *>(h);
+		}
+
+		/**
+		 * Run the loop until @p ready() holds, for at most @p timeout_ms
+		 * (< 0: no limit, 0: one non-blocking round).  UV_RUN_ONCE sleeps
+		 * in the poller, so pipe data and pool completions are handled the
+		 * moment they arrive, and a timer wakes it at the deadline; the
+		 * short sleep only covers a loop with nothing active left, which
+		 * would otherwise return at once.  Returns ready().
+		 */
+		template <typename F>
+		bool run_until(F &&ready, int timeout_ms)
+		{
+			if (ready())
+				return true;
+			if (timeout_ms == 0) {
+				uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+				return ready();
+			}
+			if (timeout_ms < 0) {
+				while (!ready()) {
+					if (uv_run(uv_default_loop(), UV_RUN_ONCE) == 0 && !ready())
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				return true;
+			}
+			const uint64_t deadline = monotonic_ms() + static_cast<uint64_t>(timeout_ms);
+			auto *timer = new uv_timer_t;
+			uv_timer_init(uv_default_loop(), timer);
+			bool done;
+			while (!(done = ready())) {
+				const uint64_t now = monotonic_ms();
+				if (now >= deadline)
+					break;
+				// Re-armed every round: the loop's cached clock may fire it early.
+				uv_update_time(uv_default_loop());
+				uv_timer_start(timer, [](uv_timer_t *) {}, deadline - now, 0);
+				uv_run(uv_default_loop(), UV_RUN_ONCE);
+			}
+			uv_close(reinterpret_cast<uv_handle_t *>(timer), wake_timer_close_cb);
+			return done;
+		}
+
+		/** Block on the loop until @p w completes. */
+		inline void run_until_done(async_work *w)
+		{
+			run_until([w] {
+				return w->done.load(std::memory_order_acquire);
+			}, -1);
+		}
+
+		/** As run_until_done(), for at most @p timeout_ms; returns whether @p w completed. */
+		inline bool run_until_done(async_work *w, int timeout_ms)
+		{
+			return run_until([w] {
+				return w->done.load(std::memory_order_acquire);
+			}, timeout_ms);
+		}
+
 // Work callbacks (stateless lambdas → implicit conversion to fn ptr).
 		inline void wait_work_cb(uv_work_t *req)
 		{
@@ -170,606 +687,3460 @@ namespace mpp {
 			w->exit_code = mpp_impl::wait_for(*w->info);
 		}
 
+		/** Settle total / truncated and move the kept bytes into output. */
+		inline void finish_output(async_work *w)
+		{
+			if (!w->window) {
+				w->total = w->output.size();
+				return;
+			}
+			w->total = w->window->total;
+			w->truncated = w->window->truncated();
+			w->output = w->window->take();
+			w->window.reset();
+		}
+
 		inline void read_work_cb(uv_work_t *req)
 		{
 			auto *w = static_cast<async_work *>(req->data);
 			assert(w->stream != nullptr);
-			std::ostringstream ss;
-			ss << w->stream->rdbuf();
-			w->output = ss.str();
+			if (w->window || w->activity != nullptr) {
+				// A read at a time, so the idle watchdog sees output arrive.
+				char buf[16 * 1024];
+				size_t n;
+				if (!w->window)
+					w->output.reserve(w->size_hint);
+				while ((n = w->stream->read_some(buf, sizeof(buf))) > 0) {
+					note_output(w->activity);
+					if (w->window)
+						w->window->append(buf, n);
+					else
+						w->output.append(buf, n);
+				}
+			}
+			else {
+				w->stream->drain(w->output, w->size_hint);
+			}
+			finish_output(w);
 		}
 
 		inline void after_work_cb(uv_work_t *req, int /*status*/)
 		{
 			auto *w = static_cast<async_work *>(req->data);
-			w->done.store(true, std::memory_order_release);
+			complete_work(w);
 		}
 
-	} // namespace detail
-} // namespace mpp
+		inline void write_work_cb(uv_work_t *req)
+		{
+			auto *w = static_cast<async_work *>(req->data);
+			size_t total = 0;
+			while (total < w->input.size()) {
+				mpp::ssize_t n = mpp::write(w->fd, w->input.data() + total,
+				                            w->input.size() - total);
+				if (n <= 0) break; // EPIPE: the child stopped reading
+				total += static_cast<size_t>(n);
+			}
+			mpp_impl::close_fd(w->fd);
+			w->fd = FD_INVALID;
+		}
 
-namespace mpp {
-	using mpp_impl::redirect_info;
-	using mpp_impl::process_info;
-	using mpp_impl::process_startup;
-	using mpp_impl::fd_type;
+		inline void after_write_cb(uv_work_t *req, int status)
+		{
+			auto *w = static_cast<async_work *>(req->data);
+			if (status == UV_ECANCELED && w->fd != FD_INVALID) {
+				mpp_impl::close_fd(w->fd);
+				w->fd = FD_INVALID;
+			}
+			complete_work(w);
+		}
 
-	// Thread safety: mpp::process is not thread-safe. All methods must be
-	// called from the same thread that drives the libuv event loop
-	// (uv_default_loop()). Multi-threaded access requires external
-	// synchronization.
+		/**
+		 * As write_work_cb, but w->fd stays open for the next request
+		 * (worker_pool without a frame_writer); truncated is set when the
+		 * child stopped reading.
+		 */
+		inline void frame_work_cb(uv_work_t *req)
+		{
+			auto *w = static_cast<async_work *>(req->data);
+			size_t total = 0;
+			while (total < w->input.size()) {
+				mpp::ssize_t n = mpp::write(w->fd, w->input.data() + total,
+				                            w->input.size() - total);
+				if (n <= 0) break;
+				total += static_cast<size_t>(n);
+			}
+			w->truncated = total < w->input.size();
+		}
 
-	class process {
-		friend class process_builder;
+		inline void after_frame_cb(uv_work_t *req, int status)
+		{
+			auto *w = static_cast<async_work *>(req->data);
+			if (status == UV_ECANCELED)
+				w->truncated = true;
+			complete_work(w);
+		}
 
-	private:
-		struct member_holder {
-			process_info _info;
-			fdostream _stdin;
-			fdistream _stdout;
-			fdistream _stderr;
-			// Use optional to distinguish "not yet waited" from exit code 0 or negative.
-			std::optional<int> _exit_code;
-			// Set to true once we observe via OS poll that the process has exited,
-			// so subsequent has_exited() calls skip the OS round-trip.
-			bool _observed_exited = false;
-			// Async work states backed by libuv uv_queue_work, replacing the
-			// previous std::async / std::future implementation.  Each pointer
-			// is non-null when the corresponding async operation is in flight.
-			std::unique_ptr<detail::async_work> _out_work;
-			std::unique_ptr<detail::async_work> _err_work;
-			std::unique_ptr<detail::async_work> _wait_work;
+		/**
+		 * Event-driven consumer of one output stream (process::on_stdout_chunk(),
+		 * on_stdout_line(), ...).  Reads happen on the loop (Unix) or as one
+		 * blocking read per pool job, and the callbacks always run on the
+		 * loop thread from uv_run().  Owned by member_holder.
+		 */
+		struct output_subscription {
+			static constexpr size_t chunk_size = 64 * 1024;
 
-			// Helper: wait for a single work item to finish (or cancel it),
-			// then release the unique_ptr.
-			static void await_work(std::unique_ptr<detail::async_work> &w)
+			uv_work_t req;
+			// Set while a uv_pipe_t reads on the loop instead of req.
+			output_reader *reader = nullptr;
+			mpp_impl::fd_type fd = FD_INVALID;
+			std::function<void(std::string_view)> on_chunk;
+			std::function<void(std::string_view)> on_line;
+			// As async_work::activity.
+			std::atomic<uint64_t> *activity = nullptr;
+			// Bytes the stream had buffered, handed out with the first read.
+			std::string backlog;
+			// Unterminated last line, completed by a later chunk or EOF.
+			std::string partial;
+			std::unique_ptr<char[]> buf;
+			mpp::ssize_t nread = 0;
+			// A pool read is in flight: req belongs to the pool.
+			bool queued = false;
+			bool started = false;
+			bool paused = false;
+			bool eof = false;
+
+			void deliver(const char *p, size_t n)
 			{
-				if (!w) return;
-				uv_cancel(reinterpret_cast<uv_req_t *>(&w->req));
-				int spin_count = 0;
-				while (!w->done.load(std::memory_order_acquire)) {
-					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
-					if (++spin_count % 3000 == 0) {
-						MOZART_LOGCR("await_work spinning for too long -- "
-						             "work item not responding to cancellation");
+				if (!backlog.empty()) {
+					std::string b = std::move(backlog);
+					backlog.clear();
+					deliver(b.data(), b.size());
+				}
+				if (n == 0)
+					return;
+				if (on_chunk)
+					on_chunk(std::string_view(p, n));
+				if (!on_line)
+					return;
+				const char *end = p + n;
+				if (!partial.empty()) {
+					const char *nl = mpp::find_newline(p, end);
+					if (nl == nullptr) {
+						partial.append(p, end);
+						return;
 					}
+					partial.append(p, nl);
+					std::string line = std::move(partial);
+					partial.clear();
+					on_line(mpp::chomp_cr(line));
+					p = nl + 1;
 				}
-				w.reset();
+				const size_t used = mpp::for_each_line(std::string_view(p, static_cast<size_t>(end - p)), on_line);
+				partial.append(p + used, end);
 			}
 
-			explicit member_holder(const process_info &info)
-				: _info(info), _stdin(_info._stdin),
-				  _stdout(_info._stdout), _stderr(_info._stderr) {}
-
-			~member_holder()
+			/** EOF: hand out the backlog and an unterminated last line. */
+			void finish()
 			{
-				// Cancel / join any in-flight async work before closing fds.
-				await_work(_wait_work);
-				await_work(_out_work);
-				await_work(_err_work);
-				mpp_impl::close_process(_info);
+				deliver(nullptr, 0);
+				if (on_line && !partial.empty()) {
+					std::string line = std::move(partial);
+					partial.clear();
+					on_line(mpp::chomp_cr(line));
+				}
+				eof = true;
 			}
 		};
 
-		std::unique_ptr<member_holder> _this;
+		inline void subscription_read_cb(uv_work_t *req)
+		{
+			auto *s = static_cast<output_subscription *>(req->data);
+			s->nread = mpp::read(s->fd, s->buf.get(), output_subscription::chunk_size);
+		}
 
-		explicit process(const process_info &info)
-			: _this(std::make_unique<member_holder>(info)) {}
+		inline bool queue_subscription_read(output_subscription *s);
 
-	public:
-		process() = delete;
+		inline void subscription_after_cb(uv_work_t *req, int status)
+		{
+			auto *s = static_cast<output_subscription *>(req->data);
+			s->queued = false;
+			if (status == UV_ECANCELED)
+				return; // the process let go
+			if (s->nread <= 0) {
+				s->finish();
+				return;
+			}
+			note_output(s->activity);
+			s->deliver(s->buf.get(), static_cast<size_t>(s->nread));
+			if (!s->paused && !queue_subscription_read(s))
+				s->finish();
+		}
 
-		process(const process &) = delete;
+		/** Read the next chunk on the pool.  Returns false if it cannot. */
+		inline bool queue_subscription_read(output_subscription *s)
+		{
+			if (!s->buf)
+				s->buf.reset(new char[output_subscription::chunk_size]);
+			if (uv_queue_work(uv_default_loop(), &s->req,
+			                  subscription_read_cb, subscription_after_cb) != 0)
+				return false;
+			s->queued = true;
+			return true;
+		}
 
-		process(process &&) = default;
+#ifdef MOZART_PLATFORM_UNIX
+		/**
+		 * uv_poll_t on the child's exit_notify_fd().  Owned by the loop: it
+		 * is freed by its close callback, and `work` is nulled when the
+		 * waiting process lets go first.
+		 */
+		struct exit_watch {
+			uv_poll_t handle;
+			async_work *work = nullptr;
+		};
 
-		process &operator=(process &&other) noexcept
+		inline void exit_watch_close_cb(uv_handle_t *h)
 		{
-			if (this != &other)
-				_this = std::move(other._this);
-			return *this;
+			delete static_cast<exit_watch *>(h->data);
 		}
 
-		process &operator=(const process &) = delete;
-
-	public:
-		~process() = default;
+		inline void exit_watch_cb(uv_poll_t *h, int status, int /*events*/)
+		{
+			auto *watch = static_cast<exit_watch *>(h->data);
+			async_work *w = watch->work;
+			uv_close(reinterpret_cast<uv_handle_t *>(h), exit_watch_close_cb);
+			if (w == nullptr)
+				return;
+			w->watch = nullptr;
+			// Polling failed: let a pool thread do the blocking wait.
+			if (status < 0 && uv_queue_work(h->loop, &w->req, wait_work_cb, after_work_cb) == 0)
+				return;
+			// The child has exited, so this reaps it without blocking.
+			w->exit_code = mpp_impl::wait_for(*w->info);
+			complete_work(w);
+		}
 
 		/**
-		 * Returns the write end of the child's stdin pipe.
-		 * Data written here becomes the child process's standard input.
-		 * Returns a reference to an internally-owned fdostream.
+		 * Wait for the exit of w->info through the loop when the platform
+		 * offers a descriptor for it.  Returns false to use the pool.
 		 */
-		std::ostream &in()
+		inline bool watch_exit(async_work *w)
 		{
-			return _this->_stdin;
+			const mpp_impl::fd_type fd = mpp_impl::exit_notify_fd(*w->info);
+			if (fd == mpp_impl::FD_INVALID)
+				return false;
+			auto *watch = new exit_watch;
+			if (uv_poll_init(uv_default_loop(), &watch->handle, fd) != 0) {
+				delete watch;
+				return false;
+			}
+			watch->handle.data = watch;
+			if (uv_poll_start(&watch->handle, UV_READABLE, exit_watch_cb) != 0) {
+				uv_close(reinterpret_cast<uv_handle_t *>(&watch->handle), exit_watch_close_cb);
+				return false;
+			}
+			watch->work = w;
+			w->watch = watch;
+			return true;
 		}
 
-		/**
-		 * Returns the read end of the child's stdout pipe.
-		 * Read from here to consume the child process's standard output.
-		 * Returns a reference to an internally-owned fdistream.
-		 */
-		std::istream &out()
+		/** Stop watching; the handle is released by the loop later. */
+		inline void unwatch_exit(async_work *w)
 		{
-			return _this->_stdout;
+			w->watch->work = nullptr;
+			uv_close(reinterpret_cast<uv_handle_t *>(&w->watch->handle), exit_watch_close_cb);
+			w->watch = nullptr;
 		}
 
 		/**
-		 * Returns the read end of the child's stderr pipe.
-		 * Read from here to consume the child process's standard error.
-		 * Returns a reference to an internally-owned fdistream.
+		 * Non-blocking reader draining one output pipe into work->output on
+		 * the loop thread.  libuv reads straight into the string's spare
+		 * room, which grows geometrically like fdinbuf::drain().  It reads
+		 * through a private dup of the pipe, so closing the handle leaves
+		 * the process's own descriptor alone.  Owned by the loop like
+		 * exit_watch.
 		 */
-		std::istream &err()
+		struct pipe_reader {
+			static constexpr size_t chunk_size = 64 * 1024;
+
+			uv_pipe_t handle;
+			async_work *work = nullptr;
+			// Bytes of work->output holding data; the rest is spare room.
+			size_t filled = 0;
+			// Bounded output: reads land here and go on to work->window.
+			std::unique_ptr<char[]> scratch;
+		};
+
+		inline void pipe_reader_close_cb(uv_handle_t *h)
 		{
-			return _this->_stderr;
+			delete static_cast<pipe_reader *>(h->data);
 		}
 
-		/**
-		 * Close the write end of the child's stdin pipe, signaling EOF to
-		 * the child process.  Idempotent — safe to call multiple times.
-		 * After this call, writing to in() has no effect.
-		 */
-		void close_stdin()
+		inline void pipe_reader_alloc_cb(uv_handle_t *h, size_t /*suggested*/, uv_buf_t *buf)
 		{
-			if (_this->_info._stdin_closed) return;
-			_this->_info._stdin_closed = true;
-			// Invalidate the stream buffer so subsequent writes are
-			// safely refused instead of hitting a stale/closed fd
-			// (the underlying streambuf returns EOF / 0, which sets
-			// the stream's failbit / badbit).
-			_this->_stdin.invalidate();
-			if (_this->_info._stdin != FD_INVALID) {
-				mpp_impl::close_fd(_this->_info._stdin);
-				_this->_info._stdin = FD_INVALID;
+			// Only called while reading, i.e. while work is attached.
+			auto *r = static_cast<pipe_reader *>(h->data);
+			if (r->work->window) {
+				if (!r->scratch)
+					r->scratch.reset(new char[pipe_reader::chunk_size]);
+				*buf = uv_buf_init(r->scratch.get(), pipe_reader::chunk_size);
+				return;
+			}
+			std::string &out = r->work->output;
+			// libuv keeps reading only while reads fill the buffer, so always
+			// hand out a whole pipe-sized chunk of the spare room.
+			if (out.size() - r->filled < pipe_reader::chunk_size)
+				out.resize(std::max(r->filled + pipe_reader::chunk_size, out.size() * 2));
+			*buf = uv_buf_init(&out[r->filled], pipe_reader::chunk_size);
+		}
+
+		inline void pipe_reader_finish(pipe_reader *r)
+		{
+			// The dup shares its file status flags with the process's
+			// descriptor: hand it back in blocking mode.
+			uv_os_fd_t fd;
+			if (uv_fileno(reinterpret_cast<uv_handle_t *>(&r->handle), &fd) == 0)
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+			uv_close(reinterpret_cast<uv_handle_t *>(&r->handle), pipe_reader_close_cb);
+		}
+
+		inline void pipe_reader_read_cb(uv_stream_t *s, ssize_t nread, const uv_buf_t *buf)
+		{
+			auto *r = static_cast<pipe_reader *>(s->data);
+			if (r->work == nullptr) {
+				return;
+			}
+			if (nread > 0) {
+				note_output(r->work->activity);
+				if (r->work->window)
+					r->work->window->append(buf->base, static_cast<size_t>(nread));
+				else
+					r->filled += static_cast<size_t>(nread);
+				return;
 			}
+			if (nread == 0) {
+				return; // EAGAIN
+			}
+			// EOF or error: the output is complete either way.
+			async_work *w = r->work;
+			if (!w->window)
+				w->output.resize(r->filled);
+			finish_output(w);
+			r->work = nullptr;
+			w->reader = nullptr;
+			pipe_reader_finish(r);
+			complete_work(w);
 		}
 
 		/**
-		 * Wait up to timeout_ms for the process to exit.
-		 * poll_interval_ms controls the sleep between polls on Unix (minimum 1 ms);
-		 * on Windows the OS signals process exit natively and this value is ignored.
-		 * Returns the exit code wrapped in optional if exited, or nullopt on timeout.
+		 * Drain @p fd into w->output on the loop thread, after whatever
+		 * @p stream has already buffered.  Returns false to use the pool.
 		 */
-		std::optional<int> wait_timeout_ms(int timeout_ms, int poll_interval_ms = 5)
+		inline bool read_pipe(async_work *w, mpp_impl::fd_type fd, mpp::fdistream &stream)
 		{
-			if (_this->_exit_code.has_value()) {
-				return _this->_exit_code;
+			const int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+			if (dup_fd < 0)
+				return false;
+			auto *r = new pipe_reader;
+			r->handle.data = r;
+			if (uv_pipe_init(uv_default_loop(), &r->handle, 0) != 0) {
+				::close(dup_fd);
+				delete r;
+				return false;
 			}
-			int code = 0;
-			if (mpp_impl::wait_timeout_ms(_this->_info, timeout_ms, code, poll_interval_ms)) {
-				_this->_exit_code = code;
-				return code;
+			if (uv_pipe_open(&r->handle, dup_fd) != 0) {
+				::close(dup_fd);
+				uv_close(reinterpret_cast<uv_handle_t *>(&r->handle), pipe_reader_close_cb);
+				return false;
 			}
-			return std::nullopt;
+			// Bytes an earlier read left in the stream buffer come first.
+			std::streambuf *sb = stream.rdbuf();
+			const std::streamsize buffered = sb->in_avail();
+			if (buffered > 0) {
+				w->output.resize(static_cast<size_t>(buffered));
+				sb->sgetn(&w->output[0], buffered);
+			}
+			if (w->window) {
+				w->window->append(w->output.data(), w->output.size());
+				w->output.clear();
+			}
+			r->filled = w->output.size();
+			// A chunk of room past the hint lets the EOF read land without
+			// regrowing.
+			if (!w->window && w->size_hint >= r->filled)
+				w->output.resize(w->size_hint + pipe_reader::chunk_size);
+			r->work = w;
+			if (uv_read_start(reinterpret_cast<uv_stream_t *>(&r->handle),
+			                  pipe_reader_alloc_cb, pipe_reader_read_cb) != 0) {
+				// The pool reader appends to what was taken from the stream.
+				w->output.resize(r->filled);
+				r->work = nullptr;
+				pipe_reader_finish(r);
+				return false;
+			}
+			w->reader = r;
+			return true;
+		}
+
+		/** Stop reading; the handle is released by the loop later. */
+		inline void unread_pipe(async_work *w)
+		{
+			w->reader->work = nullptr;
+			pipe_reader_finish(w->reader);
+			w->reader = nullptr;
 		}
 
 		/**
-		 * Submit a blocking mpp_impl::wait_for() to libuv's thread pool.
-		 * The result is collected via poll_wait() / collect_wait().
-		 * Idempotent: safe to call multiple times.
+		 * Non-blocking writer feeding work->input to the child on the loop
+		 * thread; libuv queues whatever the pipe cannot take yet and writes
+		 * it as the child reads.  The handle owns the stdin descriptor, so
+		 * closing it is what gives the child EOF.  Owned by the loop like
+		 * exit_watch.
 		 */
-		void begin_wait()
+		struct pipe_writer {
+			uv_pipe_t handle;
+			uv_write_t req;
+			async_work *work = nullptr;
+		};
+
+		inline void pipe_writer_close_cb(uv_handle_t *h)
 		{
-			if (_this->_exit_code.has_value() || _this->_wait_work) {
-				return;
-			}
-			auto w = std::make_unique<detail::async_work>();
-			w->req.data = w.get();
-			w->info = &_this->_info;
-			if (uv_queue_work(uv_default_loop(), &w->req,
-			                  detail::wait_work_cb, detail::after_work_cb) != 0) {
-				MOZART_LOGEV("begin_wait: uv_queue_work submission failed, "
-				             "falling back to synchronous path");
-				return; // submission failed, w is freed
+			delete static_cast<pipe_writer *>(h->data);
+		}
+
+		inline void pipe_writer_write_cb(uv_write_t *req, int /*status*/)
+		{
+			// Finished, or failed with EPIPE because the child exited
+			// without reading everything: stdin is done either way.
+			auto *wr = static_cast<pipe_writer *>(req->data);
+			if (wr->work == nullptr) {
+				return; // detached: the handle is already closing
 			}
-			_this->_wait_work = std::move(w);
+			async_work *w = wr->work;
+			wr->work = nullptr;
+			w->writer = nullptr;
+			uv_close(reinterpret_cast<uv_handle_t *>(&wr->handle), pipe_writer_close_cb);
+			complete_work(w);
 		}
 
 		/**
-		 * Non-blocking poll: drive the libuv loop to process pending
-		 * completion callbacks, then check whether the wait work is done.
-		 * Returns true when the process has exited (or was already collected).
-		 * Zero syscalls when no work is pending; caches result in _exit_code.
+		 * Write w->input to w->fd on the loop thread and close it after.
+		 * Returns false, with w->fd untouched, to use the pool.
 		 */
-		bool poll_wait()
+		inline bool write_pipe(async_work *w)
 		{
-			if (_this->_exit_code.has_value() || _this->_observed_exited) {
-				return true;
+			if (w->input.size() > std::numeric_limits<unsigned int>::max())
+				return false; // beyond one uv_buf_t
+			auto *wr = new pipe_writer;
+			wr->handle.data = wr;
+			wr->req.data = wr;
+			if (uv_pipe_init(uv_default_loop(), &wr->handle, 0) != 0) {
+				delete wr;
+				return false;
 			}
-			if (!_this->_wait_work) {
-				// No async wait started; fall back to a direct (syscall) check.
-				if (mpp_impl::process_exited(_this->_info)) {
-					_this->_observed_exited = true;
-					return true;
-				}
+			if (uv_pipe_open(&wr->handle, w->fd) != 0) {
+				uv_close(reinterpret_cast<uv_handle_t *>(&wr->handle), pipe_writer_close_cb);
 				return false;
 			}
-			// Drive the loop so the after-work callback (which sets `done`)
-			// gets a chance to fire.
-			uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-			if (_this->_wait_work->done.load(std::memory_order_acquire)) {
-				_this->_exit_code = _this->_wait_work->exit_code;
-				_this->_wait_work.reset();
-				_this->_observed_exited = true;
+			// From here on the handle owns the descriptor.
+			w->fd = FD_INVALID;
+			uv_buf_t buf = uv_buf_init(&w->input[0], static_cast<unsigned int>(w->input.size()));
+			if (uv_write(&wr->req, reinterpret_cast<uv_stream_t *>(&wr->handle),
+			             &buf, 1, pipe_writer_write_cb) != 0) {
+				// Typically EPIPE straight away: nothing more to deliver.
+				uv_close(reinterpret_cast<uv_handle_t *>(&wr->handle), pipe_writer_close_cb);
+				complete_work(w);
 				return true;
 			}
-			return false;
+			wr->work = w;
+			w->writer = wr;
+			return true;
 		}
 
 		/**
-		 * Block until the libuv wait work resolves (if it was started),
-		 * then cache and return the exit code.  Falls back to a direct
-		 * synchronous mpp_impl::wait_for() if begin_wait() was never called.
+		 * Stop writing: closing the handle drops any unwritten input and
+		 * closes stdin.  The writer is released by the loop later.
 		 */
-		int collect_wait()
+		inline void unwrite_pipe(async_work *w)
 		{
-			if (_this->_exit_code.has_value()) {
-				return _this->_exit_code.value();
+			w->writer->work = nullptr;
+			uv_close(reinterpret_cast<uv_handle_t *>(&w->writer->handle), pipe_writer_close_cb);
+			w->writer = nullptr;
+		}
+
+		/**
+		 * Long-lived writer on a private dup of a worker's stdin
+		 * (worker_pool).  Each request frame is queued with uv_write and
+		 * goes out as the child reads, so a frame larger than the pipe
+		 * buffer never blocks the caller while the child is itself
+		 * blocked writing a reply nobody reads yet.  Owned by the loop
+		 * like pipe_writer: the owner reads `failed` until it calls
+		 * close_frame_writer(), and the close callback frees it.
+		 */
+		struct frame_writer {
+			uv_pipe_t handle;
+			// A write failed: the child stopped reading.
+			bool failed = false;
+		};
+
+		struct frame_write {
+			uv_write_t req;
+			frame_writer *writer = nullptr;
+			std::string data;
+		};
+
+		inline void frame_writer_close_cb(uv_handle_t *h)
+		{
+			delete static_cast<frame_writer *>(h->data);
+		}
+
+		inline void frame_write_cb(uv_write_t *req, int status)
+		{
+			auto *fw = static_cast<frame_write *>(req->data);
+			// Cancelled writes are reported before the close callback, so
+			// the writer is still there to be told.
+			if (status < 0 && status != UV_ECANCELED)
+				fw->writer->failed = true;
+			delete fw;
+		}
+
+		/** Open a writer on a dup of @p fd; null to write through the pool. */
+		inline frame_writer *open_frame_writer(mpp_impl::fd_type fd)
+		{
+			const int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+			if (dup_fd < 0)
+				return nullptr;
+			auto *wr = new frame_writer;
+			wr->handle.data = wr;
+			if (uv_pipe_init(uv_default_loop(), &wr->handle, 0) != 0) {
+				::close(dup_fd);
+				delete wr;
+				return nullptr;
 			}
-			if (_this->_wait_work) {
-				// Drive the loop until the work completes.
-				while (!_this->_wait_work->done.load(std::memory_order_acquire)) {
-					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
-				}
-				_this->_exit_code = _this->_wait_work->exit_code;
-				_this->_wait_work.reset();
-				_this->_observed_exited = true;
-				return _this->_exit_code.value();
+			if (uv_pipe_open(&wr->handle, dup_fd) != 0) {
+				::close(dup_fd);
+				uv_close(reinterpret_cast<uv_handle_t *>(&wr->handle), frame_writer_close_cb);
+				return nullptr;
 			}
-			// Fallback: no async wait was started, do it synchronously.
-			_this->_exit_code = mpp_impl::wait_for(_this->_info);
-			return _this->_exit_code.value();
+			return wr;
 		}
 
-		bool has_exited()
+		/** Queue @p data behind earlier frames; false (and failed) if the pipe is gone. */
+		inline bool write_frame(frame_writer *wr, std::string data)
 		{
-			if (_this->_exit_code.has_value() || _this->_observed_exited) {
-				return true;
+			auto *fw = new frame_write;
+			fw->req.data = fw;
+			fw->writer = wr;
+			fw->data = std::move(data);
+			uv_buf_t buf;
+			buf.base = &fw->data[0];
+			buf.len = fw->data.size();
+			if (uv_write(&fw->req, reinterpret_cast<uv_stream_t *>(&wr->handle),
+			             &buf, 1, frame_write_cb) != 0) {
+				delete fw;
+				wr->failed = true;
+				return false;
 			}
-			// If an async wait is in progress, drive the loop and check.
-			if (_this->_wait_work) {
-				uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-				if (_this->_wait_work->done.load(std::memory_order_acquire)) {
-					_this->_exit_code = _this->_wait_work->exit_code;
-					_this->_wait_work.reset();
-					_this->_observed_exited = true;
-					return true;
-				}
+			return true;
+		}
+
+		/** Drop whatever is still queued and close the dup; freed by the loop later. */
+		inline void close_frame_writer(frame_writer *wr)
+		{
+			uv_close(reinterpret_cast<uv_handle_t *>(&wr->handle), frame_writer_close_cb);
+		}
+
+		/**
+		 * Non-blocking reader feeding an output_subscription on the loop
+		 * thread, through a private dup of the pipe like pipe_reader.
+		 * Owned by the loop like exit_watch.
+		 */
+		struct output_reader {
+			uv_pipe_t handle;
+			output_subscription *sub = nullptr;
+		};
+
+		inline void output_reader_close_cb(uv_handle_t *h)
+		{
+			delete static_cast<output_reader *>(h->data);
+		}
+
+		inline void output_reader_alloc_cb(uv_handle_t *h, size_t /*suggested*/, uv_buf_t *buf)
+		{
+			auto *r = static_cast<output_reader *>(h->data);
+			*buf = uv_buf_init(r->sub->buf.get(), output_subscription::chunk_size);
+		}
+
+		inline void output_reader_finish(output_reader *r)
+		{
+			// Hand the shared file status flags back in blocking mode.
+			uv_os_fd_t fd;
+			if (uv_fileno(reinterpret_cast<uv_handle_t *>(&r->handle), &fd) == 0)
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+			uv_close(reinterpret_cast<uv_handle_t *>(&r->handle), output_reader_close_cb);
+		}
+
+		inline void output_reader_read_cb(uv_stream_t *st, ssize_t nread, const uv_buf_t *buf)
+		{
+			auto *r = static_cast<output_reader *>(st->data);
+			if (r->sub == nullptr || nread == 0)
+				return;
+			if (nread > 0) {
+				note_output(r->sub->activity);
+				r->sub->deliver(buf->base, static_cast<size_t>(nread));
+				return;
+			}
+			// EOF or error: the stream is over either way.
+			output_subscription *s = r->sub;
+			r->sub = nullptr;
+			s->reader = nullptr;
+			output_reader_finish(r);
+			s->finish();
+		}
+
+		/** Read s->fd on the loop thread.  Returns false to use the pool. */
+		inline bool stream_pipe(output_subscription *s)
+		{
+			const int dup_fd = fcntl(s->fd, F_DUPFD_CLOEXEC, 0);
+			if (dup_fd < 0)
+				return false;
+			auto *r = new output_reader;
+			r->handle.data = r;
+			if (uv_pipe_init(uv_default_loop(), &r->handle, 0) != 0) {
+				::close(dup_fd);
+				delete r;
 				return false;
 			}
-			// No async wait: fall back to the OS-level non-blocking check.
-			if (mpp_impl::process_exited(_this->_info)) {
-				_this->_observed_exited = true;
-				return true;
+			if (uv_pipe_open(&r->handle, dup_fd) != 0) {
+				::close(dup_fd);
+				uv_close(reinterpret_cast<uv_handle_t *>(&r->handle), output_reader_close_cb);
+				return false;
 			}
-			return false;
+			if (!s->buf)
+				s->buf.reset(new char[output_subscription::chunk_size]);
+			r->sub = s;
+			if (uv_read_start(reinterpret_cast<uv_stream_t *>(&r->handle),
+			                  output_reader_alloc_cb, output_reader_read_cb) != 0) {
+				r->sub = nullptr;
+				output_reader_finish(r);
+				return false;
+			}
+			s->reader = r;
+			return true;
 		}
+#endif
 
-		void interrupt(bool force = false)
+		/**
+		 * Start feeding @p s, after whatever @p stream has already
+		 * buffered.  Returns false when no reader could be started.
+		 */
+		inline bool start_subscription(output_subscription *s, mpp::fdistream &stream)
 		{
-			mpp_impl::terminate_process(_this->_info, force);
+			std::streambuf *sb = stream.rdbuf();
+			const std::streamsize buffered = sb->in_avail();
+			if (buffered > 0) {
+				s->backlog.resize(static_cast<size_t>(buffered));
+				sb->sgetn(&s->backlog[0], buffered);
+			}
+			s->started = true;
+#ifdef MOZART_PLATFORM_UNIX
+			if (stream_pipe(s))
+				return true;
+#endif
+			return queue_subscription_read(s);
 		}
 
-		void interrupt_tree(bool force = false)
+		inline void pause_subscription(output_subscription *s)
 		{
-			mpp_impl::terminate_process_tree(_this->_info, force);
+			s->paused = true;
+#ifdef MOZART_PLATFORM_UNIX
+			if (s->reader != nullptr)
+				uv_read_stop(reinterpret_cast<uv_stream_t *>(&s->reader->handle));
+#endif
+		}
+
+		inline void resume_subscription(output_subscription *s)
+		{
+			if (!s->paused)
+				return;
+			s->paused = false;
+			if (s->eof)
+				return;
+#ifdef MOZART_PLATFORM_UNIX
+			if (s->reader != nullptr) {
+				uv_read_start(reinterpret_cast<uv_stream_t *>(&s->reader->handle),
+				              output_reader_alloc_cb, output_reader_read_cb);
+				return;
+			}
+#endif
+			if (!s->queued && !queue_subscription_read(s))
+				s->finish();
 		}
 
 		/**
-		 * Return the OS-level process ID.
+		 * Detach @p s from its reader without calling back again.  A pool
+		 * read in flight is cancelled or, once running, waited for.
 		 */
-		int pid() const
+		inline void stop_subscription(output_subscription *s)
 		{
-			return mpp_impl::get_pid(_this->_info);
+			s->on_chunk = nullptr;
+			s->on_line = nullptr;
+			s->paused = true;
+#ifdef MOZART_PLATFORM_UNIX
+			if (s->reader != nullptr) {
+				s->reader->sub = nullptr;
+				output_reader_finish(s->reader);
+				s->reader = nullptr;
+			}
+#endif
+			if (s->queued) {
+				uv_cancel(reinterpret_cast<uv_req_t *>(&s->req));
+				while (s->queued) {
+					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+					if (s->queued)
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
 		}
 
 		/**
-		 * Drain stdout and stderr simultaneously (to avoid pipe-full deadlocks)
-		 * and wait for the process to exit.
-		 *
-		 * Returns {stdout_string, stderr_string, exit_code}.
-		 * If a stream was not captured (inherit or merge mode), the
-		 * corresponding string will be empty.
+		 * One-shot timer enforcing a process's limits (process_builder::
+		 * timeout(), idle_timeout()).  Owned by the loop like exit_watch:
+		 * freed by its close callback, and owner is nulled when the
+		 * process lets go.
 		 */
-		struct communicate_result {
-			std::string out;
-			std::string err;
-			int exit_code = 0;
+		struct limit_timer {
+			uv_timer_t handle;
+			void *owner = nullptr;
 		};
 
-		/**
-		 * Submit reader work for stdout/stderr and a waiter work to libuv's
-		 * thread pool; returns immediately.  Must be followed by
-		 * end_communicate() before the next call.
-		 *
-		 * The async_work objects store raw pointers into member_holder
-		 * (e.g. w->stream = &impl->_stdout).  These pointers remain valid
-		 * because ~member_holder() calls await_work() on every outstanding
-		 * async_work before destroying any stream or fd member — the
-		 * async work is always joined before the pointee is freed.
-		 */
-		void begin_communicate()
+		inline void limit_timer_close_cb(uv_handle_t *h)
 		{
-			// Close stdin so the child sees EOF and can exit naturally.
-			close_stdin();
-			// Start the exit waiter in parallel with the IO readers.
-			begin_wait();
-			auto *impl = _this.get();
-			if (impl->_info._stdout != FD_INVALID && !impl->_out_work) {
-				auto w = std::make_unique<detail::async_work>();
-				w->req.data = w.get();
-				w->stream = &impl->_stdout;
-				if (uv_queue_work(uv_default_loop(), &w->req,
-				                  detail::read_work_cb, detail::after_work_cb) == 0) {
-					impl->_out_work = std::move(w);
-				}
-				else {
-					MOZART_LOGEV("begin_communicate: uv_queue_work submission "
-					             "failed for stdout reader");
-				}
-			}
-			if (impl->_info._stderr != FD_INVALID && !impl->_err_work) {
-				auto w = std::make_unique<detail::async_work>();
-				w->req.data = w.get();
-				w->stream = &impl->_stderr;
-				if (uv_queue_work(uv_default_loop(), &w->req,
-				                  detail::read_work_cb, detail::after_work_cb) == 0) {
-					impl->_err_work = std::move(w);
-				}
-				else {
-					MOZART_LOGEV("begin_communicate: uv_queue_work submission "
-					             "failed for stderr reader");
-				}
+			delete static_cast<limit_timer *>(h->data);
+		}
+
+	} // namespace detail
+} // namespace mpp
+
+namespace mpp {
+	using mpp_impl::redirect_info;
+	using mpp_impl::process_info;
+	using mpp_impl::process_startup;
+	using mpp_impl::fd_type;
+	using mpp_impl::spawn_backend;
+
+	/**
+	 * Read-only, memory-mapped view of a child's captured output
+	 * (process_builder::capture_mapped()).  The bytes stay in the capture
+	 * file's pages and are never copied into the process heap; the view
+	 * remains valid after the process object is gone.  Move-only.
+	 */
+	class mapped_output {
+		const char *_data = nullptr;
+		size_t _size = 0;
+		fd_type _mapping = FD_INVALID;
+
+		void release()
+		{
+			if (_data != nullptr)
+				mpp_impl::unmap_capture(_data, _size, _mapping);
+			_data = nullptr;
+			_size = 0;
+			_mapping = FD_INVALID;
+		}
+
+	public:
+		mapped_output() = default;
+
+		/** Map what was written to capture file @p fd (see mpp_impl::map_capture()). */
+		explicit mapped_output(fd_type fd)
+		{
+			if (fd != FD_INVALID)
+				mpp_impl::map_capture(fd, _data, _size, _mapping);
+		}
+
+		mapped_output(const mapped_output &) = delete;
+		mapped_output &operator=(const mapped_output &) = delete;
+
+		mapped_output(mapped_output &&other) noexcept
+			: _data(std::exchange(other._data, nullptr)),
+			  _size(std::exchange(other._size, 0)),
+			  _mapping(std::exchange(other._mapping, FD_INVALID)) {}
+
+		mapped_output &operator=(mapped_output &&other) noexcept
+		{
+			if (this != &other) {
+				release();
+				_data = std::exchange(other._data, nullptr);
+				_size = std::exchange(other._size, 0);
+				_mapping = std::exchange(other._mapping, FD_INVALID);
+			}
+			return *this;
+		}
+
+		~mapped_output()
+		{
+			release();
+		}
+
+		const char *data() const
+		{
+			return _data;
+		}
+
+		size_t size() const
+		{
+			return _size;
+		}
+
+		bool empty() const
+		{
+			return _size == 0;
+		}
+
+		std::string_view view() const
+		{
+			return std::string_view(_data, _size);
+		}
+
+		/**
+		 * Write the view to @p dst straight from the mapped pages, at
+		 * file offset @p offset (< 0: the current position, or the end in
+		 * append mode).  Returns the bytes written, which is size() unless
+		 * a write failed; throws if nothing could be written.
+		 */
+		size_t write_to(fd_type dst, int64_t offset = -1) const
+		{
+			size_t done = 0;
+			while (done < _size) {
+				const size_t chunk = std::min<size_t>(_size - done, 1u << 30);
+#ifdef MOZART_PLATFORM_WIN32
+				OVERLAPPED ov {};
+				if (offset >= 0) {
+					const uint64_t pos = static_cast<uint64_t>(offset) + done;
+					ov.Offset = static_cast<DWORD>(pos & 0xFFFFFFFFu);
+					ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+				}
+				DWORD n = 0;
+				if (!WriteFile(dst, _data + done, static_cast<DWORD>(chunk), &n,
+				               offset >= 0 ? &ov : nullptr) || n == 0)
+					break;
+#else
+				const ::ssize_t n = offset >= 0
+				                    ? ::pwrite(dst, _data + done, chunk, static_cast<off_t>(offset + done))
+				                    : ::write(dst, _data + done, chunk);
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;
+#endif
+				done += static_cast<size_t>(n);
+			}
+			if (done == 0 && _size != 0)
+				mpp::throw_ex<mpp::runtime_error>("mapped_output: write failed");
+			return done;
+		}
+	};
+
+	// Thread safety: mpp::process is not thread-safe. All methods must be
+	// called from the same thread that drives the libuv event loop
+	// (uv_default_loop()). Multi-threaded access requires external
+	// synchronization.
+
+	/** Which limit of a process_builder ended the child, if any. */
+	enum class limit_kind {
+		none,
+		// process_builder::timeout(): the run time ran out.
+		timeout,
+		// process_builder::idle_timeout(): no output for that long.
+		idle_timeout
+	};
+
+	class spawn_spec;
+
+	class pipeline_builder;
+
+	namespace detail {
+		class exit_selector;
+	}
+
+	class process {
+		friend class process_builder;
+		friend class spawn_spec;
+		friend class pipeline_builder;
+		friend class worker_pool;
+		friend class detail::exit_selector;
+
+	private:
+		struct member_holder {
+			process_info _info;
+			fdostream _stdin;
+			fdistream _stdout;
+			fdistream _stderr;
+			// Use optional to distinguish "not yet waited" from exit code 0 or negative.
+			std::optional<int> _exit_code;
+			// Set to true once we observe via OS poll that the process has exited,
+			// so subsequent has_exited() calls skip the OS round-trip.
+			bool _observed_exited = false;
+			// Async work states backed by libuv uv_queue_work, replacing the
+			// previous std::async / std::future implementation.  Each pointer
+			// is non-null when the corresponding async operation is in flight.
+			std::unique_ptr<detail::async_work> _in_work;
+			std::unique_ptr<detail::async_work> _out_work;
+			std::unique_ptr<detail::async_work> _err_work;
+			std::unique_ptr<detail::async_work> _wait_work;
+			// Event-driven readers (on_stdout_chunk() etc.); non-null once
+			// the stream was subscribed to.
+			std::unique_ptr<detail::output_subscription> _out_sub;
+			std::unique_ptr<detail::output_subscription> _err_sub;
+			// process_startup::_output_hint for the stdout reader.
+			size_t _output_hint = 0;
+			// process_startup::_keep_head / _keep_tail for both readers.
+			size_t _keep_head = 0;
+			size_t _keep_tail = 0;
+			// process::on_settle() listener; the works point at it.
+			std::function<void()> _on_settle;
+			// process_startup::_timeout_ms / _idle_timeout_ms / _kill_grace_ms.
+			uint64_t _timeout_ms = 0;
+			uint64_t _idle_timeout_ms = 0;
+			uint64_t _kill_grace_ms = 0;
+			// detail::monotonic_ms() at start, and when output last arrived.
+			uint64_t _started_ms = 0;
+			std::atomic<uint64_t> _last_output{0};
+			// Non-null while a limit is armed.
+			detail::limit_timer *_limit_timer = nullptr;
+			limit_kind _limit = limit_kind::none;
+			// The SIGTERM of _limit went out; the timer now counts the grace.
+			bool _terminating = false;
+
+			// Helper: wait for a single work item to finish (or cancel it),
+			// then release the unique_ptr.
+			static void await_work(std::unique_ptr<detail::async_work> &w)
+			{
+				if (!w) return;
+#ifdef MOZART_PLATFORM_UNIX
+				if (w->watch != nullptr || w->reader != nullptr || w->writer != nullptr) {
+					// Nothing runs on a pool thread: just detach from the loop.
+					if (w->watch != nullptr)
+						detail::unwatch_exit(w.get());
+					else if (w->reader != nullptr)
+						detail::unread_pipe(w.get());
+					else
+						detail::unwrite_pipe(w.get());
+					w.reset();
+					return;
+				}
+#endif
+				uv_cancel(reinterpret_cast<uv_req_t *>(&w->req));
+				int spin_count = 0;
+				while (!w->done.load(std::memory_order_acquire)) {
+					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					if (++spin_count % 3000 == 0) {
+						MOZART_LOGCR("await_work spinning for too long -- "
+						             "work item not responding to cancellation");
+					}
+				}
+				w.reset();
+			}
+
+			member_holder(const process_info &info, const process_startup *startup)
+				: _info(info),
+				  _stdin(_info._stdin, startup ? startup->_stdin_buffer : 0),
+				  _stdout(_info._stdout, startup ? startup->_read_buffer : 0),
+				  _stderr(_info._stderr, startup ? startup->_read_buffer : 0),
+				  _output_hint(startup ? startup->_output_hint : 0),
+				  _keep_head(startup ? startup->_keep_head : 0),
+				  _keep_tail(startup ? startup->_keep_tail : 0)
+			{
+				if (startup != nullptr && (startup->_timeout_ms > 0 || startup->_idle_timeout_ms > 0))
+					arm_limits(*startup);
+			}
+
+			~member_holder()
+			{
+				// Cancel / join any in-flight async work before closing fds;
+				// whoever listened is not told about that.
+				_on_settle = nullptr;
+				disarm_limits();
+				await_work(_wait_work);
+				await_work(_in_work);
+				await_work(_out_work);
+				await_work(_err_work);
+				if (_out_sub)
+					detail::stop_subscription(_out_sub.get());
+				if (_err_sub)
+					detail::stop_subscription(_err_sub.get());
+				// Deliver buffered stdin while the fd is still open.
+				if (!_info._stdin_closed)
+					_stdin.flush();
+				_stdin.invalidate();
+				mpp_impl::close_process(_info);
+			}
+
+			/**
+			 * Start the limit timer.  It is unreferenced, so it never keeps
+			 * a loop alive by itself, and fires only at a deadline: once
+			 * for timeout(), and once per idle_timeout() span in which
+			 * output keeps arriving.
+			 */
+			void arm_limits(const process_startup &startup)
+			{
+				auto *t = new detail::limit_timer;
+				if (uv_timer_init(uv_default_loop(), &t->handle) != 0) {
+					delete t;
+					MOZART_LOGEV("process: uv_timer_init failed, limits not enforced");
+					return;
+				}
+				t->handle.data = t;
+				t->owner = this;
+				uv_unref(reinterpret_cast<uv_handle_t *>(&t->handle));
+				_limit_timer = t;
+				_timeout_ms = startup._timeout_ms;
+				_idle_timeout_ms = startup._idle_timeout_ms;
+				_kill_grace_ms = startup._kill_grace_ms;
+				_started_ms = detail::monotonic_ms();
+				_last_output.store(_started_ms, std::memory_order_relaxed);
+				schedule_limits(_started_ms);
+			}
+
+			/** Stop the limit timer; the loop releases it later. */
+			void disarm_limits()
+			{
+				if (_limit_timer == nullptr)
+					return;
+				_limit_timer->owner = nullptr;
+				uv_close(reinterpret_cast<uv_handle_t *>(&_limit_timer->handle), detail::limit_timer_close_cb);
+				_limit_timer = nullptr;
+			}
+
+			void schedule_limits(uint64_t now)
+			{
+				uint64_t due = std::numeric_limits<uint64_t>::max();
+				if (_terminating)
+					due = now + _kill_grace_ms;
+				else {
+					if (_timeout_ms > 0)
+						due = _started_ms + _timeout_ms;
+					if (_idle_timeout_ms > 0)
+						due = std::min(due, _last_output.load(std::memory_order_relaxed) + _idle_timeout_ms);
+				}
+				// A fresh loop time keeps the timer from firing early; one
+				// that does anyway finds nothing due and is re-armed.
+				uv_update_time(uv_default_loop());
+				uv_timer_start(&_limit_timer->handle, on_limit_timer, due > now ? due - now : 1, 0);
+			}
+
+			bool exit_known() const
+			{
+				return _exit_code.has_value() || _observed_exited ||
+				       (_wait_work && _wait_work->done.load(std::memory_order_acquire));
+			}
+
+			static void on_limit_timer(uv_timer_t *h)
+			{
+				auto *self = static_cast<member_holder *>(static_cast<detail::limit_timer *>(h->data)->owner);
+				if (self != nullptr)
+					self->check_limits();
+			}
+
+			/**
+			 * A deadline came up: escalate when a limit really is reached,
+			 * SIGTERM to the process group first and SIGKILL once the
+			 * grace is over (at once when it is 0), or re-arm for the next
+			 * deadline.  Windows has no SIGTERM: both steps terminate.
+			 */
+			void check_limits()
+			{
+				if (exit_known() || mpp_impl::process_exited(_info)) {
+					disarm_limits();
+					return;
+				}
+				if (_terminating) {
+					mpp_impl::terminate_process_tree(_info, true);
+					disarm_limits();
+					return;
+				}
+				const uint64_t now = detail::monotonic_ms();
+				if (_timeout_ms > 0 && now >= _started_ms + _timeout_ms)
+					_limit = limit_kind::timeout;
+				else if (_idle_timeout_ms > 0 &&
+				         now >= _last_output.load(std::memory_order_relaxed) + _idle_timeout_ms)
+					_limit = limit_kind::idle_timeout;
+				else {
+					schedule_limits(now);
+					return;
+				}
+				if (_kill_grace_ms == 0) {
+					mpp_impl::terminate_process_tree(_info, true);
+					disarm_limits();
+					return;
+				}
+				mpp_impl::terminate_process_tree(_info, false);
+				_terminating = true;
+				schedule_limits(now);
+			}
+
+			/** Stamp for the readers to refresh, when an idle limit is armed. */
+			std::atomic<uint64_t> *idle_stamp()
+			{
+				return _limit_timer != nullptr && _idle_timeout_ms > 0 ? &_last_output : nullptr;
+			}
+		};
+
+		std::unique_ptr<member_holder> _this;
+
+		/**
+		 * @p startup, when given, supplies the stream buffering options
+		 * (_stdin_buffer, _read_buffer, _output_hint) and the capture
+		 * bounds (_keep_head, _keep_tail).
+		 */
+		explicit process(const process_info &info, const process_startup *startup = nullptr)
+			: _this(std::make_unique<member_holder>(info, startup)) {}
+
+	public:
+		process() = delete;
+
+		process(const process &) = delete;
+
+		process(process &&) = default;
+
+		process &operator=(process &&other) noexcept
+		{
+			if (this != &other)
+				_this = std::move(other._this);
+			return *this;
+		}
+
+		process &operator=(const process &) = delete;
+
+	public:
+		~process() = default;
+
+		/**
+		 * Returns the write end of the child's stdin pipe.
+		 * Data written here becomes the child process's standard input.
+		 * Returns a reference to an internally-owned fdostream.
+		 */
+		std::ostream &in()
+		{
+			return _this->_stdin;
+		}
+
+		/**
+		 * Returns the read end of the child's stdout pipe.
+		 * Read from here to consume the child process's standard output.
+		 * Returns a reference to an internally-owned fdistream.
+		 */
+		std::istream &out()
+		{
+			return _this->_stdout;
+		}
+
+		/**
+		 * Returns the read end of the child's stderr pipe.
+		 * Read from here to consume the child process's standard error.
+		 * Returns a reference to an internally-owned fdistream.
+		 */
+		std::istream &err()
+		{
+			return _this->_stderr;
+		}
+
+		/**
+		 * Close the write end of the child's stdin pipe, signaling EOF to
+		 * the child process.  Anything still buffered in in() is written
+		 * first.  Idempotent — safe to call multiple times.
+		 * After this call, writing to in() has no effect.
+		 */
+		void close_stdin()
+		{
+			if (_this->_info._stdin_closed) return;
+			_this->_stdin.flush();
+			_this->_info._stdin_closed = true;
+			// Invalidate the stream buffer so subsequent writes are
+			// safely refused instead of hitting a stale/closed fd
+			// (the underlying streambuf returns EOF / 0, which sets
+			// the stream's failbit / badbit).
+			_this->_stdin.invalidate();
+			if (_this->_info._stdin != FD_INVALID) {
+				mpp_impl::close_fd(_this->_info._stdin);
+				_this->_info._stdin = FD_INVALID;
+			}
+		}
+
+		/**
+		 * Stream a byte range of the open file @p src into the running
+		 * child's stdin: @p length bytes from @p offset, or everything up
+		 * to EOF when @p length is negative (see mpp_impl::pump_file()).
+		 * Anything buffered in in() is written first; stdin stays open,
+		 * so several ranges or files can follow each other.  Blocks for at
+		 * most @p deadline_ms while the pipe is full (< 0: no limit) and
+		 * returns the bytes moved — continue from offset + result after a
+		 * short count.  A child that stopped reading ends the pump early
+		 * (SIGPIPE is ignored, see mpp_impl::ignore_sigpipe()).
+		 * Throws if stdin is closed, redirected, or taken over by
+		 * begin_communicate(input).
+		 */
+		uint64_t pump(fd_type src, uint64_t offset, int64_t length = -1, int deadline_ms = -1)
+		{
+			auto *impl = _this.get();
+			if (impl->_info._stdin_closed || impl->_info._stdin == FD_INVALID)
+				mpp::throw_ex<mpp::runtime_error>("pump: child stdin is not an open pipe");
+			impl->_stdin.flush();
+			mpp_impl::ignore_sigpipe();
+			return mpp_impl::pump_file(src, offset, length, impl->_info._stdin, deadline_ms);
+		}
+
+		/**
+		 * Read at most @p max bytes of the child's stdout without going
+		 * through a worker thread: bytes already buffered in out() come
+		 * first, then whatever the pipe holds.  Waits at most
+		 * @p deadline_ms for data (< 0: no limit, 0: just poll).  Returns
+		 * the bytes read (possibly fewer than @p max), an empty string at
+		 * EOF, or nullopt on timeout.  Throws while begin_communicate()
+		 * owns the pipe.
+		 */
+		std::optional<std::string> read_stdout(size_t max, int deadline_ms = -1)
+		{
+			if (_this->_out_sub)
+				mpp::throw_ex<mpp::runtime_error>("read: stdout is subscribed to");
+			return read_output(_this->_info._stdout, _this->_stdout, _this->_out_work, max, deadline_ms,
+			                   _this->idle_stamp());
+		}
+
+		/** As read_stdout(), for stderr. */
+		std::optional<std::string> read_stderr(size_t max, int deadline_ms = -1)
+		{
+			if (_this->_err_sub)
+				mpp::throw_ex<mpp::runtime_error>("read: stderr is subscribed to");
+			return read_output(_this->_info._stderr, _this->_stderr, _this->_err_work, max, deadline_ms,
+			                   _this->idle_stamp());
+		}
+
+		/**
+		 * Write as much of @p data to the child's stdin as the pipe takes
+		 * without blocking, waiting at most @p deadline_ms for room
+		 * (< 0: no limit, 0: just try).  Anything buffered in in() is
+		 * written first.  Returns the bytes written — continue with the
+		 * rest after a short count — nullopt when the deadline passed
+		 * with nothing written, or -1 when stdin is closed or the child
+		 * stopped reading (SIGPIPE is ignored).
+		 */
+		std::optional<mpp::ssize_t> write_stdin(std::string_view data, int deadline_ms = -1)
+		{
+			auto *impl = _this.get();
+			if (impl->_info._stdin_closed || impl->_info._stdin == FD_INVALID)
+				return -1;
+			impl->_stdin.flush();
+			if (data.empty())
+				return 0;
+			mpp_impl::ignore_sigpipe();
+			const auto start = std::chrono::steady_clock::now();
+			for (;;) {
+				mpp::ssize_t n = mpp_impl::write_nonblock(impl->_info._stdin, data.data(), data.size());
+				if (n != 0)
+					return n;
+				int remaining = remaining_ms(start, deadline_ms);
+				if (remaining == 0 || !mpp_impl::wait_pipe(impl->_info._stdin, true, remaining))
+					return std::nullopt;
+			}
+		}
+
+		/**
+		 * Replace @p line with the child's next line of stdout, including
+		 * its '\n' (see fdinbuf::read_line()).  Blocks until a whole
+		 * line or EOF arrives; returns false at EOF with nothing read.
+		 * Throws while the stream is subscribed to or owned by
+		 * begin_communicate().
+		 */
+		bool read_line(std::string &line)
+		{
+			check_stdout_free("read_line");
+			return _this->_stdout.read_line(line);
+		}
+
+		/**
+		 * Read stdout to EOF in large blocks and split it into lines,
+		 * without their "\n" or "\r\n" (see mpp::split_lines()).
+		 */
+		std::vector<std::string> read_lines()
+		{
+			check_stdout_free("read_lines");
+			std::string data;
+			_this->_stdout.drain(data, _this->_output_hint);
+			std::vector<std::string> lines;
+			mpp::split_lines(data, lines);
+			return lines;
+		}
+
+		/**
+		 * Call @p fn with each chunk the child writes to stdout, as it
+		 * arrives.  The first subscription starts reading right away;
+		 * callbacks run on the loop thread from uv_run() on the default
+		 * loop, whether the caller's own or one inside a wait.  Bytes
+		 * out() has already buffered come with the first read.  From then
+		 * on the stream belongs to its callbacks: read_stdout() throws,
+		 * communicate() reports it empty.  Callbacks must not destroy
+		 * this process.  Throws while begin_communicate() owns the pipe.
+		 */
+		void on_stdout_chunk(std::function<void(std::string_view)> fn)
+		{
+			subscribe(_this->_out_sub, _this->_info._stdout, _this->_stdout, _this->_out_work).on_chunk = std::move(fn);
+		}
+
+		/**
+		 * Call @p fn with each line of stdout, without its "\n" or
+		 * "\r\n"; an unterminated last line comes at EOF.  Works
+		 * alongside on_stdout_chunk(), which sees each chunk first.
+		 */
+		void on_stdout_line(std::function<void(std::string_view)> fn)
+		{
+			subscribe(_this->_out_sub, _this->_info._stdout, _this->_stdout, _this->_out_work).on_line = std::move(fn);
+		}
+
+		/** As on_stdout_chunk(), for stderr (never called when merged). */
+		void on_stderr_chunk(std::function<void(std::string_view)> fn)
+		{
+			subscribe(_this->_err_sub, _this->_info._stderr, _this->_stderr, _this->_err_work).on_chunk = std::move(fn);
+		}
+
+		/** As on_stdout_line(), for stderr. */
+		void on_stderr_line(std::function<void(std::string_view)> fn)
+		{
+			subscribe(_this->_err_sub, _this->_info._stderr, _this->_stderr, _this->_err_work).on_line = std::move(fn);
+		}
+
+		/**
+		 * Stop reading stdout once the current chunk is delivered: the
+		 * pipe fills up and the child blocks on write until
+		 * resume_stdout().  No-op without a subscription.
+		 */
+		void pause_stdout()
+		{
+			if (_this->_out_sub)
+				detail::pause_subscription(_this->_out_sub.get());
+		}
+
+		void resume_stdout()
+		{
+			if (_this->_out_sub)
+				detail::resume_subscription(_this->_out_sub.get());
+		}
+
+		void pause_stderr()
+		{
+			if (_this->_err_sub)
+				detail::pause_subscription(_this->_err_sub.get());
+		}
+
+		void resume_stderr()
+		{
+			if (_this->_err_sub)
+				detail::resume_subscription(_this->_err_sub.get());
+		}
+
+		/**
+		 * True once every subscribed stream has reached EOF and its last
+		 * callback has returned (trivially true without subscriptions).
+		 */
+		bool output_done() const
+		{
+			return (!_this->_out_sub || _this->_out_sub->eof) &&
+			       (!_this->_err_sub || _this->_err_sub->eof);
+		}
+
+		/**
+		 * Wait for the child to exit, then map what it wrote to stdout
+		 * under process_builder::capture_mapped().  Empty when stdout was
+		 * not captured.  Each call maps the capture anew; the view outlives
+		 * this process object.
+		 */
+		mapped_output mapped_stdout()
+		{
+			collect_wait();
+			return mapped_output(_this->_info._capture_out);
+		}
+
+		/** As mapped_stdout(), for stderr (empty when merged into stdout). */
+		mapped_output mapped_stderr()
+		{
+			collect_wait();
+			return mapped_output(_this->_info._capture_err);
+		}
+
+		/**
+		 * Wait up to timeout_ms for the process to exit.
+		 * poll_interval_ms controls the sleep between polls on Unix (minimum 1 ms);
+		 * on Windows the OS signals process exit natively and this value is ignored.
+		 * With a limit armed (process_builder::timeout(), idle_timeout())
+		 * the wait runs the loop instead, so the limit is enforced meanwhile.
+		 * Returns the exit code wrapped in optional if exited, or nullopt on timeout.
+		 */
+		std::optional<int> wait_timeout_ms(int timeout_ms, int poll_interval_ms = 5)
+		{
+			if (_this->_exit_code.has_value()) {
+				return _this->_exit_code;
+			}
+			if (_this->_limit_timer != nullptr || _this->_wait_work) {
+				begin_wait();
+				if (_this->_wait_work) {
+					if (!detail::run_until_done(_this->_wait_work.get(), timeout_ms))
+						return std::nullopt;
+					return collect_wait();
+				}
+			}
+			int code = 0;
+			if (mpp_impl::wait_timeout_ms(_this->_info, timeout_ms, code, poll_interval_ms)) {
+				_this->_exit_code = code;
+				return code;
+			}
+			return std::nullopt;
+		}
+
+		/**
+		 * Call @p fn on the loop thread, from within uv_run(), each time a
+		 * begin_wait() or begin_communicate() work of this process
+		 * completes.  A scheduler with many children uses it to learn
+		 * which one to check with poll_wait() / poll_communicate() instead
+		 * of polling them all.  @p fn must not run the loop itself; an
+		 * empty @p fn removes the listener.
+		 */
+		void on_settle(std::function<void()> fn)
+		{
+			_this->_on_settle = std::move(fn);
+		}
+
+		/**
+		 * Start waiting for the child's exit in the background.  Where the
+		 * child has an exit_notify_fd() (Linux pidfd, fork server) the loop
+		 * polls it and no thread is tied up; otherwise a blocking
+		 * mpp_impl::wait_for() is submitted to libuv's thread pool.
+		 * The result is collected via poll_wait() / collect_wait().
+		 * Idempotent: safe to call multiple times.
+		 */
+		void begin_wait()
+		{
+			if (_this->_exit_code.has_value() || _this->_wait_work) {
+				return;
+			}
+			auto w = std::make_unique<detail::async_work>();
+			w->req.data = w.get();
+			w->info = &_this->_info;
+			w->notify = &_this->_on_settle;
+#ifdef MOZART_PLATFORM_UNIX
+			if (detail::watch_exit(w.get())) {
+				_this->_wait_work = std::move(w);
+				return;
+			}
+#endif
+			if (uv_queue_work(uv_default_loop(), &w->req,
+			                  detail::wait_work_cb, detail::after_work_cb) != 0) {
+				MOZART_LOGEV("begin_wait: uv_queue_work submission failed, "
+				             "falling back to synchronous path");
+				return; // submission failed, w is freed
+			}
+			_this->_wait_work = std::move(w);
+		}
+
+		/**
+		 * Non-blocking poll: drive the libuv loop to process pending
+		 * completion callbacks, then check whether the wait work is done.
+		 * Returns true when the process has exited (or was already collected).
+		 * Zero syscalls when no work is pending; caches result in _exit_code.
+		 */
+		bool poll_wait()
+		{
+			if (_this->_exit_code.has_value() || _this->_observed_exited) {
+				return true;
+			}
+			if (!_this->_wait_work) {
+				// No async wait started; fall back to a direct (syscall) check.
+				if (mpp_impl::process_exited(_this->_info)) {
+					_this->_observed_exited = true;
+					return true;
+				}
+				return false;
+			}
+			// Drive the loop so the after-work callback (which sets `done`)
+			// gets a chance to fire.
+			uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+			return take_wait();
+		}
+
+		/**
+		 * Block until the libuv wait work resolves (if it was started),
+		 * then cache and return the exit code.  Falls back to a direct
+		 * synchronous mpp_impl::wait_for() if begin_wait() was never called.
+		 */
+		int collect_wait()
+		{
+			if (_this->_exit_code.has_value()) {
+				return _this->_exit_code.value();
+			}
+			if (_this->_wait_work) {
+				// Drive the loop until the work completes.
+				detail::run_until_done(_this->_wait_work.get());
+				_this->_exit_code = _this->_wait_work->exit_code;
+				_this->_wait_work.reset();
+				_this->_observed_exited = true;
+				return _this->_exit_code.value();
+			}
+			// A limit is only enforced while the loop runs.
+			if (_this->_limit_timer != nullptr) {
+				begin_wait();
+				if (_this->_wait_work)
+					return collect_wait();
+			}
+			// Fallback: no async wait was started, do it synchronously.
+			_this->_exit_code = mpp_impl::wait_for(_this->_info);
+			return _this->_exit_code.value();
+		}
+
+		bool has_exited()
+		{
+			if (_this->_exit_code.has_value() || _this->_observed_exited) {
+				return true;
+			}
+			// If an async wait is in progress, drive the loop and check.
+			if (_this->_wait_work) {
+				uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+				return take_wait();
+			}
+			// No async wait: fall back to the OS-level non-blocking check.
+			if (mpp_impl::process_exited(_this->_info)) {
+				_this->_observed_exited = true;
+				return true;
+			}
+			return false;
+		}
+
+		void interrupt(bool force = false)
+		{
+			mpp_impl::terminate_process(_this->_info, force);
+		}
+
+		void interrupt_tree(bool force = false)
+		{
+			mpp_impl::terminate_process_tree(_this->_info, force);
+		}
+
+		/**
+		 * The limit (process_builder::timeout(), idle_timeout()) that made
+		 * us signal the child, or limit_kind::none.  Set the moment the
+		 * SIGTERM goes out, so it can precede the exit.
+		 */
+		limit_kind limit_reached() const
+		{
+			return _this->_limit;
+		}
+
+		/**
+		 * Return the OS-level process ID.
+		 */
+		int pid() const
+		{
+			return mpp_impl::get_pid(_this->_info);
+		}
+
+		/**
+		 * Drain stdout and stderr simultaneously (to avoid pipe-full deadlocks)
+		 * and wait for the process to exit.
+		 *
+		 * Returns {stdout_string, stderr_string, exit_code}.
+		 * If a stream was not captured (inherit or merge mode), the
+		 * corresponding string will be empty.
+		 */
+		struct communicate_result {
+			std::string out;
+			std::string err;
+			int exit_code = 0;
+			// Bytes the child wrote to stdout / stderr, and whether out /
+			// err hold only part of them (process_builder::keep_output()).
+			uint64_t out_total = 0;
+			uint64_t err_total = 0;
+			bool out_truncated = false;
+			bool err_truncated = false;
+			// The limit that ended the child, if any (limit_reached()).
+			limit_kind limit = limit_kind::none;
+		};
+
+		/**
+		 * Start draining stdout/stderr and waiting for exit; returns
+		 * immediately.  Must be followed by end_communicate() before the
+		 * next call.
+		 *
+		 * On Unix the pipes are read on the loop thread through
+		 * non-blocking uv_pipe_t handles and the exit is watched as in
+		 * begin_wait(), so a communicate() ties up no pool thread and any
+		 * number of children can be drained concurrently.  Windows (or a
+		 * failed handle setup) submits blocking readers to libuv's thread
+		 * pool instead.
+		 *
+		 * The async_work objects store raw pointers into member_holder
+		 * (e.g. w->stream = &impl->_stdout).  These pointers remain valid
+		 * because ~member_holder() calls await_work() on every outstanding
+		 * async_work before destroying any stream or fd member — the
+		 * async work is always joined before the pointee is freed.
+		 */
+		void begin_communicate()
+		{
+			// Close stdin so the child sees EOF and can exit naturally.
+			close_stdin();
+			begin_drain();
+		}
+
+		/**
+		 * Like begin_communicate(), but first feed @p input to the child's
+		 * stdin, concurrently with draining its output, and close stdin
+		 * once all of it is written (the Popen.communicate(input) contract).
+		 * Writing respects back-pressure: a child that reads slowly while
+		 * filling its stdout cannot deadlock against us.  A child that exits
+		 * without reading everything just ends the write (EPIPE is not an
+		 * error; SIGPIPE is ignored, see mpp_impl::ignore_sigpipe()).
+		 * Without a stdin pipe, or with empty input, this is
+		 * begin_communicate().
+		 */
+		void begin_communicate(std::string input)
+		{
+			auto *impl = _this.get();
+			if (input.empty() || impl->_info._stdin == FD_INVALID || impl->_in_work) {
+				begin_communicate();
+				return;
+			}
+			mpp_impl::ignore_sigpipe();
+			auto w = std::make_unique<detail::async_work>();
+			w->req.data = w.get();
+			w->notify = &impl->_on_settle;
+			// Bytes still buffered in in() go first, ahead of input.
+			const std::string_view pending = impl->_stdin.pending();
+			if (!pending.empty())
+				input.insert(0, pending.data(), pending.size());
+			w->input = std::move(input);
+			// The work takes stdin over; the stream refuses writes from now on.
+			w->fd = impl->_info._stdin;
+			impl->_info._stdin = FD_INVALID;
+			impl->_info._stdin_closed = true;
+			impl->_stdin.invalidate();
+#ifdef MOZART_PLATFORM_UNIX
+			if (detail::write_pipe(w.get())) {
+				impl->_in_work = std::move(w);
+				begin_drain();
+				return;
+			}
+#endif
+			if (uv_queue_work(uv_default_loop(), &w->req,
+			                  detail::write_work_cb, detail::after_write_cb) == 0) {
+				impl->_in_work = std::move(w);
+			}
+			else {
+				MOZART_LOGEV("begin_communicate: uv_queue_work submission "
+				             "failed for the stdin writer");
+				mpp_impl::close_fd(w->fd);
+			}
+			begin_drain();
+		}
+
+	private:
+		/**
+		 * Cache the exit code of a completed begin_wait() work, without
+		 * running the loop or a syscall.  True once the exit is known.
+		 */
+		bool take_wait()
+		{
+			if (_this->_exit_code.has_value() || _this->_observed_exited)
+				return true;
+			if (!_this->_wait_work || !_this->_wait_work->done.load(std::memory_order_acquire))
+				return false;
+			_this->_exit_code = _this->_wait_work->exit_code;
+			_this->_wait_work.reset();
+			_this->_observed_exited = true;
+			return true;
+		}
+
+		void begin_drain()
+		{
+			// Start the exit waiter in parallel with the IO readers.
+			begin_wait();
+			auto *impl = _this.get();
+			if (impl->_info._stdout != FD_INVALID && !impl->_out_work && !impl->_out_sub) {
+				impl->_out_work = begin_read(impl->_info._stdout, impl->_stdout, impl->_output_hint);
+			}
+			if (impl->_info._stderr != FD_INVALID && !impl->_err_work && !impl->_err_sub) {
+				impl->_err_work = begin_read(impl->_info._stderr, impl->_stderr, 0);
+			}
+		}
+
+		std::unique_ptr<detail::async_work>
+		begin_read(mpp_impl::fd_type fd, mpp::fdistream &stream, size_t size_hint)
+		{
+			auto w = std::make_unique<detail::async_work>();
+			w->req.data = w.get();
+			w->notify = &_this->_on_settle;
+			w->stream = &stream;
+			w->size_hint = size_hint;
+			w->activity = _this->idle_stamp();
+			if (_this->_keep_head > 0 || _this->_keep_tail > 0)
+				w->window = std::make_unique<detail::output_window>(_this->_keep_head, _this->_keep_tail);
+#ifdef MOZART_PLATFORM_UNIX
+			if (detail::read_pipe(w.get(), fd, stream)) {
+				return w;
+			}
+#else
+			(void) fd;
+#endif
+			if (uv_queue_work(uv_default_loop(), &w->req,
+			                  detail::read_work_cb, detail::after_work_cb) != 0) {
+				MOZART_LOGEV("begin_communicate: uv_queue_work submission "
+				             "failed for a reader");
+				return nullptr;
+			}
+			return w;
+		}
+
+		void check_stdout_free(const char *what) const
+		{
+			if (_this->_out_sub || _this->_out_work)
+				mpp::throw_ex<mpp::runtime_error>(std::string(what) + ": stdout is subscribed to or being communicated");
+		}
+
+		detail::output_subscription &
+		subscribe(std::unique_ptr<detail::output_subscription> &sub, mpp_impl::fd_type fd,
+		          mpp::fdistream &stream, const std::unique_ptr<detail::async_work> &work)
+		{
+			if (work)
+				mpp::throw_ex<mpp::runtime_error>("subscribe: pipe is owned by begin_communicate()");
+			if (!sub) {
+				sub = std::make_unique<detail::output_subscription>();
+				sub->req.data = sub.get();
+				sub->fd = fd;
+				sub->activity = _this->idle_stamp();
+				// Merged or redirected: there is nothing to read.
+				sub->eof = fd == FD_INVALID;
+			}
+			if (!sub->started && !sub->eof && !detail::start_subscription(sub.get(), stream))
+				mpp::throw_ex<mpp::runtime_error>("subscribe: unable to start an output reader");
+			return *sub;
+		}
+
+		// Milliseconds left of @p deadline_ms since @p start (-1: no limit).
+		static int remaining_ms(std::chrono::steady_clock::time_point start, int deadline_ms)
+		{
+			if (deadline_ms < 0)
+				return -1;
+			auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(
+			                 std::chrono::steady_clock::now() - start).count();
+			return spent >= deadline_ms ? 0 : static_cast<int>(deadline_ms - spent);
+		}
+
+		static std::optional<std::string>
+		read_output(mpp_impl::fd_type fd, mpp::fdistream &stream,
+		            const std::unique_ptr<detail::async_work> &work,
+		            size_t max, int deadline_ms, std::atomic<uint64_t> *activity)
+		{
+			if (work)
+				mpp::throw_ex<mpp::runtime_error>("read: pipe is owned by begin_communicate()");
+			std::string out;
+			if (max == 0)
+				return out;
+			// Bytes an earlier read through the stream left buffered.
+			std::streambuf *buf = stream.rdbuf();
+			std::streamsize buffered = buf->in_avail();
+			if (buffered > 0) {
+				out.resize(std::min(static_cast<size_t>(buffered), max));
+				out.resize(static_cast<size_t>(buf->sgetn(&out[0], static_cast<std::streamsize>(out.size()))));
+				return out;
+			}
+			if (fd == FD_INVALID)
+				return out;
+			out.resize(max);
+			const auto start = std::chrono::steady_clock::now();
+			for (;;) {
+				mpp::ssize_t n = mpp_impl::read_nonblock(fd, &out[0], max);
+				if (n >= 0) {
+					if (n > 0)
+						detail::note_output(activity);
+					out.resize(static_cast<size_t>(n));
+					return out;
+				}
+				int remaining = remaining_ms(start, deadline_ms);
+				if (remaining == 0 || !mpp_impl::wait_pipe(fd, false, remaining))
+					return std::nullopt;
+			}
+		}
+
+	public:
+		/**
+		 * Non-blocking poll: drive the libuv loop and return true when
+		 * the stdin writer (if any) and both readers have completed.
+		 * Safe to call from a yield loop without blocking the OS thread.
+		 */
+		bool poll_communicate()
+		{
+			uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+			bool in_ok = !_this->_in_work ||
+			             _this->_in_work->done.load(std::memory_order_acquire);
+			bool out_ok = !_this->_out_work ||
+			              _this->_out_work->done.load(std::memory_order_acquire);
+			bool err_ok = !_this->_err_work ||
+			              _this->_err_work->done.load(std::memory_order_acquire);
+			return in_ok && out_ok && err_ok;
+		}
+
+		/**
+		 * Collect reader results and wait for process exit.
+		 * Call after poll_communicate() returns true, or to block-wait directly.
+		 */
+		communicate_result end_communicate()
+		{
+			communicate_result result;
+			if (_this->_in_work) {
+				detail::run_until_done(_this->_in_work.get());
+				_this->_in_work.reset();
+			}
+			if (_this->_out_work) {
+				detail::run_until_done(_this->_out_work.get());
+				result.out = std::move(_this->_out_work->output);
+				result.out_total = _this->_out_work->total;
+				result.out_truncated = _this->_out_work->truncated;
+				_this->_out_work.reset();
+			}
+			if (_this->_err_work) {
+				detail::run_until_done(_this->_err_work.get());
+				result.err = std::move(_this->_err_work->output);
+				result.err_total = _this->_err_work->total;
+				result.err_truncated = _this->_err_work->truncated;
+				_this->_err_work.reset();
+			}
+			result.exit_code = collect_wait();
+			result.limit = _this->_limit;
+			return result;
+		}
+
+		/**
+		 * Blocking convenience wrapper (original semantics preserved):
+		 * begin + drive loop until both readers finish + collect.
+		 *
+		 * Delegates to end_communicate() which already drives uv_run and
+		 * collects results — no need to duplicate the wait loops here.
+		 */
+		communicate_result communicate()
+		{
+			begin_communicate();
+			return end_communicate();
+		}
+
+		/** Blocking communicate(input): see begin_communicate(input). */
+		communicate_result communicate(std::string input)
+		{
+			begin_communicate(std::move(input));
+			return end_communicate();
+		}
+
+	public:
+		static process exec(const std::string &command);
+
+		static process exec(const std::string &command,
+		                    const std::vector<std::string> &args);
+	};
+
+	/** A child reported by wait_any() / wait_all(). */
+	struct exited_child {
+		// Position of the child in the set passed in.
+		size_t index = 0;
+		int exit_code = 0;
+	};
+
+	namespace detail {
+		/**
+		 * The multiplexed wait behind wait_any() / wait_all().  Every
+		 * child's exit is watched by the loop (begin_wait(): its pidfd or
+		 * fork-server status pipe joins the loop's one epoll / kqueue set
+		 * where there is one), and an on_settle() listener, chained in
+		 * front of the caller's own, queues its index.  A wait then
+		 * sleeps in uv_run() and looks at the queued children only.
+		 * The callers' listeners are restored on destruction.
+		 */
+		class exit_selector {
+			const std::vector<process *> &_procs;
+			std::vector<std::function<void()>> _saved;
+			std::vector<char> _hooked;
+			std::vector<char> _reported;
+			// Indices whose works settled since the last collect().
+			std::vector<size_t> _settled;
+			std::vector<exited_child> _exited;
+			// Children not yet reported.
+			size_t _pending = 0;
+
+			void collect()
+			{
+				std::vector<size_t> batch;
+				batch.swap(_settled);
+				for (size_t i : batch) {
+					// A child whose communicate works settle shows up more
+					// than once, and before it has exited.
+					if (_reported[i] || !_procs[i]->take_wait())
+						continue;
+					_reported[i] = true;
+					--_pending;
+					_exited.push_back({i, _procs[i]->collect_wait()});
+				}
+			}
+
+		public:
+			explicit exit_selector(const std::vector<process *> &procs)
+				: _procs(procs), _saved(procs.size()), _hooked(procs.size()), _reported(procs.size())
+			{
+				for (size_t i = 0; i < procs.size(); ++i) {
+					process *p = procs[i];
+					if (p == nullptr)
+						continue;
+					++_pending;
+					if (p->take_wait()) {
+						_settled.push_back(i);
+						continue;
+					}
+					auto &listener = p->_this->_on_settle;
+					_saved[i] = std::move(listener);
+					listener = [this, i] {
+						_settled.push_back(i);
+						if (_saved[i])
+							_saved[i]();
+					};
+					_hooked[i] = true;
+					p->begin_wait();
+				}
+			}
+
+			exit_selector(const exit_selector &) = delete;
+
+			exit_selector &operator=(const exit_selector &) = delete;
+
+			~exit_selector()
+			{
+				for (size_t i = 0; i < _procs.size(); ++i)
+					if (_hooked[i])
+						_procs[i]->_this->_on_settle = std::move(_saved[i]);
+			}
+
+			/**
+			 * Run the loop until one child (@p all: every child) has
+			 * exited, for at most @p timeout_ms.  Returns whether it did.
+			 */
+			bool wait(bool all, int timeout_ms)
+			{
+				return run_until([this, all] {
+					collect();
+					return _pending == 0 || (!all && !_exited.empty());
+				}, timeout_ms);
+			}
+
+			/** The children reported so far, in the order they were seen to exit. */
+			std::vector<exited_child> take()
+			{
+				return std::move(_exited);
+			}
+		};
+	}
+
+	/**
+	 * Block until at least one child of @p procs has exited, for at most
+	 * @p timeout_ms (< 0: no limit, 0: just check), and return every
+	 * child that has by then, in the order they were seen to exit.  The
+	 * exits are watched through the loop and only the children that
+	 * signalled are looked at, so a wake costs O(ready) rather than a
+	 * syscall per child.  Null entries are skipped: null out the
+	 * children dealt with, as an exited child is reported again by each
+	 * call.  Empty on timeout or when no child is left.
+	 */
+	inline std::vector<exited_child> wait_any(const std::vector<process *> &procs, int timeout_ms = -1)
+	{
+		detail::exit_selector s(procs);
+		s.wait(false, timeout_ms);
+		return s.take();
+	}
+
+	/**
+	 * Block until every child of @p procs (null entries skipped) has
+	 * exited, for at most @p timeout_ms, and return them in the order
+	 * they were seen to exit: all of them, or those that made it when
+	 * the time ran out.
+	 */
+	inline std::vector<exited_child> wait_all(const std::vector<process *> &procs, int timeout_ms = -1)
+	{
+		detail::exit_selector s(procs);
+		s.wait(true, timeout_ms);
+		return s.take();
+	}
+
+	/**
+	 * Outcome of one child of process_builder::start_many(): the running
+	 * process, or the reason it could not be started.
+	 */
+	struct spawn_result {
+		std::optional<process> proc;
+		std::string error;
+
+		bool ok() const
+		{
+			return proc.has_value();
+		}
+	};
+
+	class process_builder {
+		friend class pipeline_builder;
+		friend class worker_pool;
+		friend class result_cache;
+
+	private:
+		process_startup _startup;
+
+		/**
+		 * Startup info for the next spawn: environment block refreshed and,
+		 * in shell mode, the command line wrapped for the shell.
+		 */
+		process_startup launch_startup()
+		{
+			// Reuse the cached environment block across spawns (and across
+			// copies of this builder) while it is still current.
+			mpp_impl::refresh_environment(_startup);
+			process_startup s = _startup;
+			if (s._shell_mode) {
+				if (s._cmdline.empty()) {
+					mpp::throw_ex<mpp::runtime_error>("no command specified");
+				}
+				std::string cmd;
+				for (size_t i = 0; i < s._cmdline.size(); ++i) {
+					if (i > 0) cmd += ' ';
+					cmd += s._cmdline[i];
+				}
+#ifdef MOZART_PLATFORM_WIN32
+				const std::string shell_program = s._shell_program.value_or("cmd");
+				s._cmdline = {shell_program, "/c", std::move(cmd)};
+#else
+				const std::string shell_program = s._shell_program.value_or("/bin/sh");
+				s._cmdline = {shell_program, "-c", std::move(cmd)};
+#endif
+			}
+			else if (s._cmdline.empty()) {
+				mpp::throw_ex<mpp::runtime_error>("no command specified");
+			}
+			return s;
+		}
+
+	public:
+		process_builder() = default;
+
+		~process_builder() = default;
+
+		process_builder(process_builder &&) = default;
+
+		process_builder(const process_builder &) = default;
+
+		process_builder &operator=(process_builder &&) = default;
+
+		process_builder &operator=(const process_builder &) = default;
+
+	public:
+		/**
+		 * Set the program to execute (argv[0]). May be called multiple times;
+		 * later calls replace the previous program.
+		 */
+		process_builder &command(const std::string &command)
+		{
+			if (_startup._cmdline.empty()) {
+				_startup._cmdline.push_back(command);
+			}
+			else {
+				_startup._cmdline[0].assign(command);
+			}
+			return *this;
+		}
+
+		/**
+		 * Append arguments after the program name.  May be called multiple
+		 * times; later calls replace previously set arguments (last-wins).
+		 */
+		template <typename Container>
+		process_builder &arguments(const Container &c)
+		{
+			if (_startup._cmdline.size() > 1)
+				_startup._cmdline.erase(_startup._cmdline.begin() + 1, _startup._cmdline.end());
+			std::copy(c.begin(), c.end(), std::back_inserter(_startup._cmdline));
+			return *this;
+		}
+
+		/**
+		 * Set an environment variable for the child process.  May be called
+		 * multiple times; later values for the same key overwrite earlier
+		 * ones (last-write-wins).
+		 */
+		process_builder &environment(const std::string &key, const std::string &value)
+		{
+			_startup._env.insert_or_assign(key, value);
+			_startup._env_block.reset();
+			return *this;
+		}
+
+		process_builder &redirect_stdin(fd_type target)
+		{
+			_startup._stdin._target = target;
+			return *this;
+		}
+
+		process_builder &redirect_stdout(fd_type target)
+		{
+			_startup._stdout._target = target;
+			return *this;
+		}
+
+		process_builder &redirect_stderr(fd_type target)
+		{
+			_startup._stderr._target = target;
+			return *this;
+		}
+
+		process_builder &directory(const std::string &cwd)
+		{
+			_startup._cwd = cwd;
+			return *this;
+		}
+
+		process_builder &merge_outputs(bool r)
+		{
+			_startup._merge_outputs = r;
+			return *this;
+		}
+
+		/**
+		 * Inherit the parent's stdin from the terminal (user can type directly).
+		 */
+		process_builder &inherit_stdin(bool v = true)
+		{
+			_startup._inherit_stdin = v;
+			return *this;
+		}
+
+		/**
+		 * Inherit the parent's stdout independently (without affecting stderr).
+		 * For setting both at once, see inherit_output().
+		 */
+		process_builder &inherit_stdout(bool v = true)
+		{
+			_startup._inherit_stdout = v;
+			return *this;
+		}
+
+		/**
+		 * Inherit the parent's stderr independently (without affecting stdout).
+		 * For setting both at once, see inherit_output().
+		 */
+		process_builder &inherit_stderr(bool v = true)
+		{
+			_startup._inherit_stderr = v;
+			return *this;
+		}
+
+		/**
+		 * Inherit the parent's stdout and stderr so child output appears
+		 * directly on the terminal without being captured.
+		 */
+		process_builder &inherit_output(bool v = true)
+		{
+			_startup._inherit_stdout = v;
+			_startup._inherit_stderr = v;
+			return *this;
+		}
+
+		/**
+		 * Buffer up to @p bytes written to process::in() before they reach
+		 * the pipe (0, the default, writes through at once).  Buffered data
+		 * is sent when the buffer fills, on flush, and by close_stdin();
+		 * flush yourself before waiting for a reply to what you wrote.
+		 */
+		process_builder &stdin_buffer(size_t bytes)
+		{
+			_startup._stdin_buffer = bytes;
+			return *this;
+		}
+
+		/**
+		 * Read buffer of process::out() / err(): the most one underflow
+		 * asks the pipe for (0 restores the default, 1 KiB).  Worth raising
+		 * for bulk reads through the streams; communicate() reads directly
+		 * into its result and does not depend on it.
+		 */
+		process_builder &read_buffer(size_t bytes)
+		{
+			_startup._read_buffer = bytes;
+			return *this;
+		}
+
+		/**
+		 * Expected size of the child's stdout.  communicate() then sizes
+		 * its result once instead of growing it as output arrives.
+		 */
+		process_builder &output_size_hint(size_t bytes)
+		{
+			_startup._output_hint = bytes;
+			return *this;
+		}
+
+		/**
+		 * Bound what communicate() keeps of each stream: the first
+		 * @p head_bytes and the last @p tail_bytes (a ring buffer), while
+		 * still draining everything so the child never blocks.  The
+		 * result's *_total and *_truncated fields tell how much was
+		 * dropped; a truncated out / err is head followed by tail.  Both
+		 * 0 (the default) keeps everything.
+		 */
+		process_builder &keep_output(size_t tail_bytes, size_t head_bytes = 0)
+		{
+			_startup._keep_tail = tail_bytes;
+			_startup._keep_head = head_bytes;
+			return *this;
+		}
+
+		/**
+		 * Capture stdout and stderr (unless inherited, redirected, or
+		 * stderr is merged) into anonymous files instead of pipes; after
+		 * exit, process::mapped_stdout() / mapped_stderr() return a
+		 * read-only mapping of them.  Suited to very large outputs: the
+		 * child never blocks on a full pipe and nothing is copied into the
+		 * parent's heap.  out() / err() and communicate() see no output.
+		 */
+		process_builder &capture_mapped(bool v = true)
+		{
+			_startup._capture_mapped = v;
+			return *this;
+		}
+
+		/**
+		 * Keep captures in memory only while output_size_hint() is at most
+		 * @p memory_cap bytes; larger ones go to a disk-backed file in
+		 * @p dir (empty: the system temp directory).  0 keeps every
+		 * capture in memory.  A running child's capture cannot move, so
+		 * the choice is made when it starts.
+		 */
+		process_builder &capture_spill(size_t memory_cap, const std::string &dir = {})
+		{
+			_startup._capture_memory_cap = memory_cap;
+			_startup._capture_dir = dir;
+			return *this;
+		}
+
+		/**
+		 * Limit the child's run time to @p ms (0, the default, is none).
+		 * When it runs out the child's process group gets SIGTERM, then
+		 * SIGKILL after kill_grace().  A timer on the default loop does
+		 * this, so it is enforced while the loop runs: in communicate(),
+		 * the waits, the poll_*() calls, or the caller's own uv_run();
+		 * not while a thread blocks reading out() / err().
+		 * process::limit_reached() and communicate_result::limit tell
+		 * which limit fired.
+		 */
+		process_builder &timeout(uint64_t ms)
+		{
+			_startup._timeout_ms = ms;
+			return *this;
+		}
+
+		/**
+		 * Treat @p ms without output on stdout or stderr (0, the default,
+		 * is no limit) like a timeout().  Output counts when it is read:
+		 * by communicate(), the on_*() subscriptions or read_stdout() /
+		 * read_stderr(), not through the out() / err() streams.  Only
+		 * the last stage of a pipeline keeps it (see pipeline_builder).
+		 */
+		process_builder &idle_timeout(uint64_t ms)
+		{
+			_startup._idle_timeout_ms = ms;
+			return *this;
+		}
+
+		/**
+		 * Time between the SIGTERM of a limit and the SIGKILL, for the
+		 * child to clean up (default 5000 ms; 0 sends SIGKILL at once).
+		 */
+		process_builder &kill_grace(uint64_t ms)
+		{
+			_startup._kill_grace_ms = ms;
+			return *this;
+		}
+
+		/**
+		 * Control environment inheritance.  When true (the default) the child
+		 * receives the parent's full environment, with any vars set via
+		 * environment() applied as overrides.  When false only those vars are
+		 * used (or an empty environment if none were set).
+		 */
+		process_builder &inherit_env(bool v = true)
+		{
+			if (_startup._inherit_env != v)
+				_startup._env_block.reset();
+			_startup._inherit_env = v;
+			return *this;
+		}
+
+		/**
+		 * Select how the child is spawned on *nix (see mpp_impl::spawn_backend).
+		 * The default picks the cheapest mechanism available.
+		 */
+		process_builder &backend(spawn_backend b)
+		{
+			_startup._backend = b;
+			return *this;
+		}
+
+		process_builder &shell(std::nullptr_t)
+		{
+			_startup._shell_mode = false;
+			_startup._shell_program.reset();
+			return *this;
+		}
+
+		process_builder &shell(const std::string &program)
+		{
+			if (program.empty()) {
+				mpp::throw_ex<mpp::runtime_error>("shell program cannot be empty");
+			}
+			_startup._shell_mode = true;
+			_startup._shell_program = program;
+			return *this;
+		}
+
+		process start()
+		{
+			const process_startup s = launch_startup();
+			process_info info{};
+			mpp_impl::create_process(s, info);
+			return process(info, &s);
+		}
+
+		/**
+		 * Start @p count identical children in one call.  Argument,
+		 * environment and PATH preparation is shared; the children are
+		 * still spawned one after another (see mpp_impl::create_processes()).
+		 * A child that fails does not affect the others: its entry carries
+		 * the error instead of a process.  Throws only for an invalid
+		 * configuration (e.g. no command).
+		 */
+		std::vector<spawn_result> start_many(size_t count)
+		{
+			const process_startup s = launch_startup();
+			std::vector<process_info> infos;
+			std::vector<std::string> errors;
+			mpp_impl::create_processes(s, count, infos, errors);
+			std::vector<spawn_result> results(count);
+			for (size_t i = 0; i < count; ++i) {
+				if (errors[i].empty())
+					results[i].proc.emplace(process(infos[i], &s));
+				else
+					results[i].error = std::move(errors[i]);
+			}
+			return results;
+		}
+
+		/**
+		 * Freeze the current configuration into a spawn_spec that can be
+		 * started many times (see spawn_spec).  The builder is unchanged.
+		 */
+		spawn_spec prepare() const;
+	};
+
+	/**
+	 * Immutable, precompiled form of a process_builder.  Everything that
+	 * does not depend on the per-launch arguments (shell wrapping, the
+	 * environment block, the PATH lookup) is done once by prepare(), so
+	 * start() only lays out argv in a single allocation and spawns.
+	 *
+	 * A spec is a snapshot: later changes to the builder, the parent
+	 * environment or PATH are not picked up.  prepare() again for that.
+	 */
+	class spawn_spec {
+		friend class process_builder;
+
+	private:
+		// _cmdline holds only the fixed argv prefix: the program, or
+		// {shell, "-c"} / {shell, "/c"} in shell mode.
+		process_startup _startup;
+		// Arguments captured by prepare(), used by start().
+		std::vector<std::string> _args;
+		// Shell mode: the command text the arguments are appended to.
+		std::string _shell_command;
+
+		spawn_spec() = default;
+
+		process launch(const std::vector<std::string> &args) const
+		{
+			process_info info{};
+			if (_startup._shell_mode) {
+				std::string cmd = _shell_command;
+				for (const auto &a : args) {
+					cmd += ' ';
+					cmd += a;
+				}
+				const mpp_impl::argv_block argv(_startup._cmdline, {std::move(cmd)});
+				mpp_impl::create_process(_startup, info, &argv);
+			}
+			else {
+				const mpp_impl::argv_block argv(_startup._cmdline, args);
+				mpp_impl::create_process(_startup, info, &argv);
+			}
+			return process(info, &_startup);
+		}
+
+	public:
+		/** Start a child with the arguments captured by prepare(). */
+		process start() const
+		{
+			return launch(_args);
+		}
+
+		/**
+		 * Start a child with @p args in place of the captured arguments.
+		 * In shell mode they are appended to the command text, as start()
+		 * on the builder would.
+		 */
+		process start(const std::vector<std::string> &args) const
+		{
+			return launch(args);
+		}
+
+		/** Arguments captured by prepare(). */
+		const std::vector<std::string> &arguments() const
+		{
+			return _args;
+		}
+
+		/**
+		 * Executable resolved from PATH by prepare(), or empty when the
+		 * lookup is left to spawn time.
+		 */
+		const std::string &executable() const
+		{
+			return _startup._executable;
+		}
+	};
+
+	inline spawn_spec process_builder::prepare() const
+	{
+		if (_startup._cmdline.empty()) {
+			mpp::throw_ex<mpp::runtime_error>("no command specified");
+		}
+		spawn_spec spec;
+		process_startup &s = spec._startup;
+		s = _startup;
+		mpp_impl::refresh_environment(s);
+		spec._args.assign(s._cmdline.begin() + 1, s._cmdline.end());
+		s._cmdline.resize(1);
+		if (s._shell_mode) {
+			spec._shell_command = std::move(s._cmdline[0]);
+#ifdef MOZART_PLATFORM_WIN32
+			s._cmdline = {s._shell_program.value_or("cmd"), "/c"};
+#else
+			s._cmdline = {s._shell_program.value_or("/bin/sh"), "-c"};
+#endif
+		}
+		mpp_impl::resolve_executable(s._cmdline[0], s._executable);
+		return spec;
+	}
+
+	/**
+	 * Running a | b | c.  Adjacent stages are joined by kernel pipes, so
+	 * data between them never passes through this process: in() is the
+	 * first stage's stdin, out() / err() are the last stage's stdout and
+	 * stderr.  Intermediate stages write stderr to the parent's stderr
+	 * unless their builder said otherwise.
+	 */
+	class pipeline {
+		friend class pipeline_builder;
+
+	private:
+		std::vector<process> _stages;
+
+		explicit pipeline(std::vector<process> stages)
+			: _stages(std::move(stages)) {}
+
+	public:
+		pipeline(const pipeline &) = delete;
+
+		pipeline(pipeline &&) noexcept = default;
+
+		pipeline &operator=(const pipeline &) = delete;
+
+		pipeline &operator=(pipeline &&) noexcept = default;
+
+		struct communicate_result {
+			std::string out;
+			std::string err;
+			// One per stage, in order; the last is the pipeline's status.
+			std::vector<int> exit_codes;
+			// As in process::communicate_result, for the last stage.
+			uint64_t out_total = 0;
+			uint64_t err_total = 0;
+			bool out_truncated = false;
+			bool err_truncated = false;
+			// The limit that ended a stage, if any: the first such stage's
+			// limit_reached(), in pipeline order.
+			limit_kind limit = limit_kind::none;
+		};
+
+		size_t size() const
+		{
+			return _stages.size();
+		}
+
+		process &stage(size_t i)
+		{
+			return _stages.at(i);
+		}
+
+		std::ostream &in()
+		{
+			return _stages.front().in();
+		}
+
+		std::istream &out()
+		{
+			return _stages.back().out();
+		}
+
+		std::istream &err()
+		{
+			return _stages.back().err();
+		}
+
+		void close_stdin()
+		{
+			_stages.front().close_stdin();
+		}
+
+		void begin_wait()
+		{
+			for (auto &p : _stages)
+				p.begin_wait();
+		}
+
+		/** Non-blocking: true once every stage has exited. */
+		bool poll_wait()
+		{
+			bool all = true;
+			for (auto &p : _stages)
+				all = p.poll_wait() && all;
+			return all;
+		}
+
+		/** Wait for every stage; returns their exit codes in order. */
+		std::vector<int> wait()
+		{
+			std::vector<int> codes;
+			codes.reserve(_stages.size());
+			for (auto &p : _stages)
+				codes.push_back(p.collect_wait());
+			return codes;
+		}
+
+		bool has_exited()
+		{
+			for (auto &p : _stages)
+				if (!p.has_exited())
+					return false;
+			return true;
+		}
+
+		/** Terminate every stage together with its descendants. */
+		void interrupt(bool force = false)
+		{
+			for (auto &p : _stages)
+				p.interrupt_tree(force);
+		}
+
+		/**
+		 * Close (or, with input, feed and then close) the first stdin,
+		 * drain the last stdout / stderr and wait for every stage.  See
+		 * process::begin_communicate().
+		 */
+		void begin_communicate()
+		{
+			for (auto &p : _stages)
+				p.begin_communicate();
+		}
+
+		void begin_communicate(std::string input)
+		{
+			_stages.front().begin_communicate(std::move(input));
+			for (size_t i = 1; i < _stages.size(); ++i)
+				_stages[i].begin_communicate();
+		}
+
+		bool poll_communicate()
+		{
+			bool all = true;
+			for (auto &p : _stages)
+				all = p.poll_communicate() && all;
+			return all;
+		}
+
+		communicate_result end_communicate()
+		{
+			communicate_result result;
+			result.exit_codes.reserve(_stages.size());
+			for (auto &p : _stages) {
+				auto r = p.end_communicate();
+				result.exit_codes.push_back(r.exit_code);
+				result.out = std::move(r.out);
+				result.err = std::move(r.err);
+				result.out_total = r.out_total;
+				result.err_total = r.err_total;
+				result.out_truncated = r.out_truncated;
+				result.err_truncated = r.err_truncated;
+				if (result.limit == limit_kind::none)
+					result.limit = r.limit;
+			}
+			return result;
+		}
+
+		communicate_result communicate()
+		{
+			begin_communicate();
+			return end_communicate();
+		}
+
+		communicate_result communicate(std::string input)
+		{
+			begin_communicate(std::move(input));
+			return end_communicate();
+		}
+	};
+
+	/**
+	 * Describes a | b | c as a list of process_builder stages.  Each stage
+	 * keeps its own command, arguments, environment and directory; the
+	 * streams joining two stages are always pipes between them.  An
+	 * idle_timeout() applies to the last stage only: the output of the
+	 * others goes to the next stage, where this process cannot see it.
+	 */
+	class pipeline_builder {
+	private:
+		std::vector<process_builder> _stages;
+
+	public:
+		/** Append a stage; the builder is copied. */
+		pipeline_builder &add(const process_builder &stage)
+		{
+			_stages.push_back(stage);
+			return *this;
+		}
+
+		size_t size() const
+		{
+			return _stages.size();
+		}
+
+		pipeline start()
+		{
+			if (_stages.empty()) {
+				mpp::throw_ex<mpp::runtime_error>("pipeline has no stages");
+			}
+			std::vector<mpp_impl::process_startup> startups;
+			startups.reserve(_stages.size());
+			for (size_t i = 0; i < _stages.size(); ++i) {
+				startups.push_back(_stages[i].launch_startup());
+				mpp_impl::process_startup &s = startups.back();
+				// Nobody drains an intermediate stage's stderr pipe.
+				if (i + 1 < _stages.size() && !s._merge_outputs
+				        && !s._stderr.redirected())
+					s._inherit_stderr = true;
+				// Its output is never read here, so it would look idle
+				// while streaming to the next stage.
+				if (i + 1 < _stages.size())
+					s._idle_timeout_ms = 0;
+			}
+			std::vector<mpp_impl::process_info> infos;
+			mpp_impl::create_pipeline(startups, infos);
+			std::vector<process> stages;
+			stages.reserve(infos.size());
+			for (size_t i = 0; i < infos.size(); ++i)
+				stages.push_back(process(infos[i], &startups[i]));
+			return pipeline(std::move(stages));
+		}
+	};
+
+	/**
+	 * How requests and replies are delimited on a worker's stdin and
+	 * stdout (see worker_pool).
+	 */
+	enum class worker_framing {
+		// One request per line, answered by one line; the '\n' is added
+		// to requests and stripped from replies (with a '\r' before it).
+		line,
+		// A 32-bit big-endian byte count, then that many bytes, both ways.
+		length_prefixed
+	};
+
+	struct worker_result {
+		// False when the worker died before replying.
+		bool ok = false;
+		std::string reply;
+		// Exit code of the worker that died, when !ok.
+		int exit_code = 0;
+	};
+
+	/**
+	 * N long-lived children started from one builder, serving requests
+	 * over their stdin / stdout so the spawn cost is paid once, not per
+	 * request.  Each worker has at most one request in flight; requests
+	 * wait in a FIFO queue while every worker is busy.  Requests are
+	 * written and replies read by the default loop, where worker exits
+	 * are watched too, so a request of any size streams in while the
+	 * reply streams out, and poll() and result() only ever wake up for
+	 * events.
+	 *
+	 * A worker is retired (stdin closed, left to exit) after
+	 * recycle_after requests when that is non-zero.  One that dies fails
+	 * its request, if any; replacements start as queued work needs them.
+	 * Not movable: the loop callbacks point into the pool.
+	 */
+	class worker_pool {
+	private:
+		enum class worker_state {
+			idle,
+			busy,
+			// stdin closed after recycle_after requests; waiting for exit.
+			retiring,
+			// stdout reached EOF: waiting for the exit code.
+			dead
+		};
+
+		struct worker {
+			std::unique_ptr<process> proc;
+			worker_state state = worker_state::idle;
+			// Loop-side writer on the worker's stdin; null where none could
+			// be opened, and then each frame is written by a pool job.
+			detail::frame_writer *writer = nullptr;
+			std::unique_ptr<detail::async_work> job;
+			// Reply bytes received so far.
+			std::string buffer;
+			uint64_t ticket = 0;
+			size_t served = 0;
+		};
+
+		spawn_spec _spec;
+		size_t _size;
+		worker_framing _framing;
+		size_t _recycle_after;
+		std::vector<std::unique_ptr<worker>> _workers;
+		std::deque<std::pair<uint64_t, std::string>> _queue;
+		std::unordered_map<uint64_t, worker_result> _results;
+		uint64_t _next_ticket = 1;
+
+		static spawn_spec prepare_spec(process_builder builder)
+		{
+			const process_startup &s = builder._startup;
+			if (s._inherit_stdin || s._stdin.redirected() || s._inherit_stdout ||
+			        s._stdout.redirected() || s._capture_mapped)
+				mpp::throw_ex<mpp::runtime_error>("worker_pool: stdin and stdout must be pipes");
+			// Nobody drains a worker's stderr pipe.
+			if (!s._merge_outputs && !s._stderr.redirected())
+				builder.inherit_stderr(true);
+			return builder.prepare();
+		}
+
+		void spawn()
+		{
+			auto w = std::make_unique<worker>();
+			w->proc = std::make_unique<process>(_spec.start());
+			worker *raw = w.get();
+			w->proc->on_stdout_chunk([this, raw](std::string_view data) {
+				raw->buffer.append(data.data(), data.size());
+				take_reply(raw);
+			});
+			// Learn about the exit from the loop, not by polling.
+			w->proc->begin_wait();
+#ifdef MOZART_PLATFORM_UNIX
+			w->writer = detail::open_frame_writer(w->proc->_this->_info._stdin);
+#endif
+			_workers.push_back(std::move(w));
+		}
+
+		// Complete the in-flight request once a whole reply has arrived.
+		// Runs from an output callback, so retiring is left to housekeep().
+		void take_reply(worker *w)
+		{
+			if (w->state != worker_state::busy)
+				return;
+			std::string reply;
+			if (_framing == worker_framing::line) {
+				const char *begin = w->buffer.data();
+				const char *nl = mpp::find_newline(begin, begin + w->buffer.size());
+				if (nl == nullptr)
+					return;
+				reply.assign(mpp::chomp_cr(std::string_view(begin, static_cast<size_t>(nl - begin))));
+				w->buffer.erase(0, static_cast<size_t>(nl - begin) + 1);
+			}
+			else {
+				if (w->buffer.size() < 4)
+					return;
+				const auto *b = reinterpret_cast<const unsigned char *>(w->buffer.data());
+				const size_t len = (size_t(b[0]) << 24) | (size_t(b[1]) << 16) | (size_t(b[2]) << 8) | size_t(b[3]);
+				if (w->buffer.size() - 4 < len)
+					return;
+				reply.assign(w->buffer, 4, len);
+				w->buffer.erase(0, 4 + len);
+			}
+			worker_result &r = _results[w->ticket];
+			r.ok = true;
+			r.reply = std::move(reply);
+			w->state = worker_state::idle;
+			w->ticket = 0;
+			++w->served;
+		}
+
+		// Close the worker's stdin.  Whatever the loop writer still holds
+		// is dropped; a pool job is let finish first, as it shares the fd.
+		void close_input(worker *w)
+		{
+			if (w->writer != nullptr) {
+				detail::close_frame_writer(w->writer);
+				w->writer = nullptr;
+			}
+			if (w->job) {
+				detail::run_until_done(w->job.get());
+				w->job.reset();
+			}
+			w->proc->close_stdin();
+		}
+
+		// Hand @p request to idle worker @p w.  The frame is queued on the
+		// worker's stdin and written as the child reads it, while poll()
+		// and result() run the loop; if the worker is gone the request
+		// fails with it once its exit code is in.
+		void send(worker *w, uint64_t ticket, const std::string &request)
+		{
+			std::string frame;
+			if (_framing == worker_framing::line) {
+				frame.reserve(request.size() + 1);
+				frame = request;
+				frame += '\n';
+			}
+			else {
+				const uint32_t len = static_cast<uint32_t>(request.size());
+				const char prefix[4] = {char(len >> 24), char(len >> 16), char(len >> 8), char(len)};
+				frame.reserve(request.size() + 4);
+				frame.assign(prefix, 4);
+				frame += request;
+			}
+			w->state = worker_state::busy;
+			w->ticket = ticket;
+#ifdef MOZART_PLATFORM_UNIX
+			if (w->writer != nullptr) {
+				if (!detail::write_frame(w->writer, std::move(frame)))
+					w->state = worker_state::dead;
+				return;
+			}
+#endif
+			// A reply can come before the child read all of the last frame.
+			if (w->job)
+				detail::run_until_done(w->job.get());
+			auto job = std::make_unique<detail::async_work>();
+			job->req.data = job.get();
+			job->input = std::move(frame);
+			job->fd = w->proc->_this->_info._stdin;
+			if (uv_queue_work(uv_default_loop(), &job->req,
+			                  detail::frame_work_cb, detail::after_frame_cb) != 0) {
+				w->job.reset();
+				w->state = worker_state::dead;
+				return;
 			}
+			w->job = std::move(job);
 		}
 
-		/**
-		 * Non-blocking poll: drive the libuv loop and return true when
-		 * both reader-work items have completed.
-		 * Safe to call from a yield loop without blocking the OS thread.
-		 */
-		bool poll_communicate()
+		// True once the worker's stdin refused part of a frame.
+		static bool input_failed(const worker *w)
 		{
-			uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-			bool out_ok = !_this->_out_work ||
-			              _this->_out_work->done.load(std::memory_order_acquire);
-			bool err_ok = !_this->_err_work ||
-			              _this->_err_work->done.load(std::memory_order_acquire);
-			return out_ok && err_ok;
+			if (w->writer != nullptr && w->writer->failed)
+				return true;
+			return w->job && w->job->done.load(std::memory_order_acquire) && w->job->truncated;
 		}
 
-		/**
-		 * Collect reader results and wait for process exit.
-		 * Call after poll_communicate() returns true, or to block-wait directly.
-		 */
-		communicate_result end_communicate()
+		size_t live() const
 		{
-			communicate_result result;
-			if (_this->_out_work) {
-				while (!_this->_out_work->done.load(std::memory_order_acquire)) {
-					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			size_t n = 0;
+			for (auto &w : _workers)
+				if (w->state == worker_state::idle || w->state == worker_state::busy)
+					++n;
+			return n;
+		}
+
+		// Reap exited workers, then hand queued requests to idle ones,
+		// starting replacements up to the pool size.
+		void housekeep()
+		{
+			for (size_t i = 0; i < _workers.size();) {
+				worker *w = _workers[i].get();
+				if ((w->state == worker_state::idle || w->state == worker_state::busy) &&
+				        (w->proc->output_done() || input_failed(w)))
+					w->state = worker_state::dead;
+				if (w->state == worker_state::idle && _recycle_after > 0 && w->served >= _recycle_after) {
+					close_input(w);
+					w->state = worker_state::retiring;
 				}
-				result.out = std::move(_this->_out_work->output);
-				_this->_out_work.reset();
+				if ((w->state == worker_state::dead || w->state == worker_state::retiring) &&
+				        w->proc->poll_wait()) {
+					const int code = w->proc->collect_wait();
+					if (w->state == worker_state::dead && w->ticket != 0 &&
+					        _results.find(w->ticket) == _results.end()) {
+						worker_result &r = _results[w->ticket];
+						r.ok = false;
+						r.exit_code = code;
+					}
+					close_input(w);
+					_workers.erase(_workers.begin() + static_cast<std::ptrdiff_t>(i));
+					continue;
+				}
+				++i;
 			}
-			if (_this->_err_work) {
-				while (!_this->_err_work->done.load(std::memory_order_acquire)) {
-					uv_run(uv_default_loop(), UV_RUN_NOWAIT);
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			while (!_queue.empty()) {
+				worker *idle = nullptr;
+				for (auto &w : _workers)
+					if (w->state == worker_state::idle) {
+						idle = w.get();
+						break;
+					}
+				if (idle == nullptr) {
+					if (live() >= _size)
+						return;
+					spawn();
+					idle = _workers.back().get();
 				}
-				result.err = std::move(_this->_err_work->output);
-				_this->_err_work.reset();
+				send(idle, _queue.front().first, _queue.front().second);
+				_queue.pop_front();
 			}
-			result.exit_code = collect_wait();
-			return result;
 		}
 
+	public:
 		/**
-		 * Blocking convenience wrapper (original semantics preserved):
-		 * begin + drive loop until both readers finish + collect.
-		 *
-		 * Delegates to end_communicate() which already drives uv_run and
-		 * collects results — no need to duplicate the wait loops here.
+		 * Start @p workers children from @p builder (whose stdin and
+		 * stdout must be pipes; an un-redirected stderr is inherited).
 		 */
-		communicate_result communicate()
+		worker_pool(const process_builder &builder, size_t workers,
+		            worker_framing framing = worker_framing::line, size_t recycle_after = 0)
+			: _spec(prepare_spec(builder)), _size(std::max<size_t>(workers, 1)),
+			  _framing(framing), _recycle_after(recycle_after)
 		{
-			begin_communicate();
-			return end_communicate();
+			mpp_impl::ignore_sigpipe();
+			for (size_t i = 0; i < _size; ++i)
+				spawn();
 		}
 
-	public:
-		static process exec(const std::string &command);
-
-		static process exec(const std::string &command,
-		                    const std::vector<std::string> &args);
-	};
-
-	class process_builder {
-	private:
-		process_startup _startup;
-
-	public:
-		process_builder() = default;
-
-		~process_builder() = default;
-
-		process_builder(process_builder &&) = default;
-
-		process_builder(const process_builder &) = default;
-
-		process_builder &operator=(process_builder &&) = default;
+		worker_pool(const worker_pool &) = delete;
 
-		process_builder &operator=(const process_builder &) = default;
+		worker_pool &operator=(const worker_pool &) = delete;
 
-	public:
-		/**
-		 * Set the program to execute (argv[0]). May be called multiple times;
-		 * later calls replace the previous program.
-		 */
-		process_builder &command(const std::string &command)
+		~worker_pool()
 		{
-			if (_startup._cmdline.empty()) {
-				_startup._cmdline.push_back(command);
-			}
-			else {
-				_startup._cmdline[0].assign(command);
-			}
-			return *this;
+			shutdown();
 		}
 
 		/**
-		 * Append arguments after the program name.  May be called multiple
-		 * times; later calls replace previously set arguments (last-wins).
+		 * Queue @p request and return its ticket for ready() / result().
+		 * In line framing the request must not contain '\n'.
 		 */
-		template <typename Container>
-		process_builder &arguments(const Container &c)
+		uint64_t submit(std::string request)
 		{
-			if (_startup._cmdline.size() > 1)
-				_startup._cmdline.erase(_startup._cmdline.begin() + 1, _startup._cmdline.end());
-			std::copy(c.begin(), c.end(), std::back_inserter(_startup._cmdline));
-			return *this;
+			if (_framing == worker_framing::line && request.find('\n') != std::string::npos)
+				mpp::throw_ex<mpp::runtime_error>("worker_pool: line request contains a newline");
+			if (_framing == worker_framing::length_prefixed && request.size() > 0xFFFFFFFFu)
+				mpp::throw_ex<mpp::runtime_error>("worker_pool: request too large for a 32-bit prefix");
+			const uint64_t ticket = _next_ticket++;
+			_queue.emplace_back(ticket, std::move(request));
+			housekeep();
+			return ticket;
 		}
 
 		/**
-		 * Set an environment variable for the child process.  May be called
-		 * multiple times; later values for the same key overwrite earlier
-		 * ones (last-write-wins).
+		 * Run the loop once without blocking and dispatch queued work.
+		 * Returns true while requests are queued or in flight.
 		 */
-		process_builder &environment(const std::string &key, const std::string &value)
+		bool poll()
 		{
-			_startup._env.insert_or_assign(key, value);
-			return *this;
+			uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+			housekeep();
+			return outstanding() > 0;
 		}
 
-		process_builder &redirect_stdin(fd_type target)
+		/** Non-blocking: true once the result of @p ticket is in. */
+		bool ready(uint64_t ticket)
 		{
-			_startup._stdin._target = target;
-			return *this;
+			poll();
+			return _results.count(ticket) > 0;
 		}
 
-		process_builder &redirect_stdout(fd_type target)
+		/**
+		 * Block on the loop until @p ticket is answered (or its worker
+		 * died) and return the result, which is then forgotten.
+		 */
+		worker_result result(uint64_t ticket)
 		{
-			_startup._stdout._target = target;
-			return *this;
+			housekeep();
+			while (_results.count(ticket) == 0) {
+				if (!pending(ticket))
+					mpp::throw_ex<mpp::runtime_error>("worker_pool: unknown ticket");
+				if (uv_run(uv_default_loop(), UV_RUN_ONCE) == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				housekeep();
+			}
+			auto it = _results.find(ticket);
+			worker_result r = std::move(it->second);
+			_results.erase(it);
+			return r;
 		}
 
-		process_builder &redirect_stderr(fd_type target)
+		/** submit() and result() in one. */
+		worker_result call(std::string request)
 		{
-			_startup._stderr._target = target;
-			return *this;
+			return result(submit(std::move(request)));
 		}
 
-		process_builder &directory(const std::string &cwd)
+		/** True while @p ticket is queued or in flight. */
+		bool pending(uint64_t ticket) const
 		{
-			_startup._cwd = cwd;
-			return *this;
+			for (auto &q : _queue)
+				if (q.first == ticket)
+					return true;
+			for (auto &w : _workers)
+				if ((w->state == worker_state::busy || w->state == worker_state::dead) && w->ticket == ticket)
+					return true;
+			return false;
 		}
 
-		process_builder &merge_outputs(bool r)
+		/** Requests queued or in flight. */
+		size_t outstanding() const
 		{
-			_startup._merge_outputs = r;
-			return *this;
+			size_t n = _queue.size();
+			for (auto &w : _workers)
+				if (w->state == worker_state::busy)
+					++n;
+			return n;
 		}
 
-		/**
-		 * Inherit the parent's stdin from the terminal (user can type directly).
-		 */
-		process_builder &inherit_stdin(bool v = true)
+		/** Workers currently serving or ready to serve. */
+		size_t workers() const
 		{
-			_startup._inherit_stdin = v;
-			return *this;
+			return live();
 		}
 
 		/**
-		 * Inherit the parent's stdout independently (without affecting stderr).
-		 * For setting both at once, see inherit_output().
+		 * Close every worker's stdin and wait up to @p grace_ms for them
+		 * to exit, then kill the rest.  Queued requests are dropped.
 		 */
-		process_builder &inherit_stdout(bool v = true)
+		void shutdown(int grace_ms = 1000)
 		{
-			_startup._inherit_stdout = v;
-			return *this;
+			_queue.clear();
+			// A pool job still writing holds the fd: it ends with the kill.
+			for (auto &w : _workers)
+				if (!w->job || w->job->done.load(std::memory_order_acquire))
+					close_input(w.get());
+			detail::run_until([this] {
+				for (auto &w : _workers)
+					if (!w->proc->take_wait())
+						return false;
+				return true;
+			}, grace_ms);
+			for (auto &w : _workers) {
+				if (!w->proc->take_wait())
+					w->proc->interrupt(true);
+				w->proc->collect_wait();
+				close_input(w.get());
+			}
+			_workers.clear();
 		}
+	};
+
+	/** Outcome of one job of run_all() or task_graph::run(). */
+	struct job_result {
+		// False when the job could not be launched (see error) or was
+		// skipped after an earlier failure (run_all_options::fail_fast).
+		bool started = false;
+		int exit_code = -1;
+		std::string out;
+		std::string err;
+		std::string error;
+		// Wall time from launch to exit, in seconds.
+		double seconds = 0;
+	};
 
+	struct run_all_options {
+		// Jobs running at once; 0 means mpp_impl::available_cpus().
+		size_t max_parallel = 0;
+		// After the first job that fails to start or exits non-zero,
+		// launch nothing more; what is running still finishes.
+		bool fail_fast = false;
+		// Called from the scheduler's own thread as each job finishes.
+		std::function<void(size_t, const job_result &)> on_done;
+	};
+
+	namespace detail {
 		/**
-		 * Inherit the parent's stderr independently (without affecting stdout).
-		 * For setting both at once, see inherit_output().
+		 * Runs communicate()d jobs for run_all() and task_graph and hands
+		 * back the ones that finished.  Each child registers itself through
+		 * process::on_settle() when its exit or output completes; wait()
+		 * sleeps in uv_run(UV_RUN_ONCE) and checks only those.
 		 */
-		process_builder &inherit_stderr(bool v = true)
+		class job_runner {
+			using clock = std::chrono::steady_clock;
+
+			struct slot {
+				std::optional<process> proc;
+				job_result *result = nullptr;
+				clock::time_point started;
+			};
+
+			// Declared ahead of the slots, whose processes may still
+			// notify while they are destroyed on an exception.
+			std::vector<size_t> _settled;
+			std::unordered_map<size_t, slot> _running;
+
+		public:
+			job_runner()
+			{
+				mpp_impl::ignore_sigpipe();
+			}
+
+			job_runner(const job_runner &) = delete;
+
+			job_runner &operator=(const job_runner &) = delete;
+
+			size_t active() const
+			{
+				return _running.size();
+			}
+
+			/**
+			 * Launch job @p id from @p builder; @p result is filled in when
+			 * wait() reports it.  Returns false, with result.error set, when
+			 * the child could not be started.
+			 */
+			bool start(size_t id, process_builder &builder, job_result &result)
+			{
+				slot &s = _running[id];
+				try {
+					s.started = clock::now();
+					s.proc.emplace(builder.start());
+				}
+				catch (const std::exception &e) {
+					_running.erase(id);
+					result.error = e.what();
+					return false;
+				}
+				result.started = true;
+				s.result = &result;
+				s.proc->on_settle([this, id] {
+					_settled.push_back(id);
+				});
+				s.proc->begin_communicate();
+				return true;
+			}
+
+			/** Block until at least one job finished; append their ids to @p done. */
+			void wait(std::vector<size_t> &done)
+			{
+				const size_t before = done.size();
+				while (done.size() == before && !_running.empty()) {
+					if (_settled.empty() && uv_run(uv_default_loop(), UV_RUN_ONCE) == 0 && _settled.empty())
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					std::vector<size_t> batch;
+					batch.swap(_settled);
+					for (size_t id : batch) {
+						auto it = _running.find(id);
+						if (it == _running.end())
+							continue;
+						process &p = *it->second.proc;
+						if (!p.poll_communicate() || !p.poll_wait())
+							continue;
+						process::communicate_result r = p.end_communicate();
+						job_result &out = *it->second.result;
+						out.exit_code = r.exit_code;
+						out.out = std::move(r.out);
+						out.err = std::move(r.err);
+						out.seconds = std::chrono::duration<double>(clock::now() - it->second.started).count();
+						_running.erase(it);
+						done.push_back(id);
+					}
+				}
+			}
+		};
+
+		inline size_t parallel_limit(size_t max_parallel)
 		{
-			_startup._inherit_stderr = v;
-			return *this;
+			return max_parallel > 0 ? max_parallel : static_cast<size_t>(mpp_impl::available_cpus());
 		}
+	}
 
-		/**
-		 * Inherit the parent's stdout and stderr so child output appears
-		 * directly on the terminal without being captured.
-		 */
-		process_builder &inherit_output(bool v = true)
-		{
-			_startup._inherit_stdout = v;
-			_startup._inherit_stderr = v;
-			return *this;
+	/**
+	 * Run every builder in @p jobs, at most options.max_parallel at a
+	 * time, and return their results in the order of @p jobs.  Each job
+	 * is communicate()d: stdin closed, stdout / stderr captured as the
+	 * builder configures them.  The loop sleeps until some child's exit
+	 * or output completes (process::on_settle()), then tops the window up
+	 * from the queue, so the cost does not grow with the running jobs.
+	 */
+	inline std::vector<job_result> run_all(std::vector<process_builder> jobs,
+	                                       const run_all_options &options = {})
+	{
+		const size_t limit = detail::parallel_limit(options.max_parallel);
+		std::vector<job_result> results(jobs.size());
+		detail::job_runner runner;
+		std::vector<size_t> done;
+		size_t next = 0, finished = 0;
+		bool failed = false;
+
+		const auto finish = [&](size_t i) {
+			++finished;
+			if (!results[i].started || results[i].exit_code != 0)
+				failed = true;
+			if (options.on_done)
+				options.on_done(i, results[i]);
+		};
+
+		while (finished < jobs.size()) {
+			while (runner.active() < limit && next < jobs.size()) {
+				const size_t i = next++;
+				if (failed && options.fail_fast)
+					results[i].error = "skipped after an earlier failure";
+				else if (runner.start(i, jobs[i], results[i]))
+					continue;
+				finish(i);
+			}
+			done.clear();
+			runner.wait(done);
+			for (size_t i : done)
+				finish(i);
 		}
+		return results;
+	}
+
+	enum class task_status {
+		succeeded, failed, skipped
+	};
+
+	/**
+	 * Commands with dependencies between them, run make -j style: a
+	 * node starts once every node it depends on succeeded, up to a
+	 * parallelism limit.  When a node fails, everything that depends on
+	 * it, directly or not, is skipped; independent branches go on unless
+	 * run_all_options::fail_fast is set.
+	 */
+	class task_graph {
+		struct node {
+			std::string name;
+			process_builder builder;
+			std::vector<std::string> deps;
+		};
+
+		std::vector<node> _nodes;
+		std::unordered_map<std::string, size_t> _index;
+
+	public:
+		struct node_result {
+			std::string name;
+			task_status status = task_status::skipped;
+			job_result job;
+			// Seconds from the start of run() to the node's launch and
+			// exit; both 0 for a node that never ran.
+			double start = 0;
+			double finish = 0;
+		};
+
+		struct report {
+			std::vector<node_result> nodes;
+			// Node ids of the chain that ended last, first to last: each
+			// one was the latest-finishing dependency of the next.
+			std::vector<size_t> critical_path;
+			// Wall time of the whole run.
+			double seconds = 0;
+
+			bool ok() const
+			{
+				for (auto &n : nodes)
+					if (n.status != task_status::succeeded)
+						return false;
+				return true;
+			}
+		};
 
 		/**
-		 * Control environment inheritance.  When true (the default) the child
-		 * receives the parent's full environment, with any vars set via
-		 * environment() applied as overrides.  When false only those vars are
-		 * used (or an empty environment if none were set).
+		 * Add node @p name running @p builder after the nodes named in
+		 * @p deps, which may be added later.  Returns the node id, its
+		 * index in report::nodes.  Throws on a duplicate name.
 		 */
-		process_builder &inherit_env(bool v = true)
+		size_t add(const std::string &name, const process_builder &builder,
+		           std::vector<std::string> deps = {})
 		{
-			_startup._inherit_env = v;
-			return *this;
+			if (!_index.emplace(name, _nodes.size()).second)
+				mpp::throw_ex<mpp::runtime_error>("task_graph: duplicate node \"" + name + "\"");
+			_nodes.push_back(node{name, builder, std::move(deps)});
+			return _nodes.size() - 1;
 		}
 
-		process_builder &shell(std::nullptr_t)
+		size_t size() const
 		{
-			_startup._shell_mode = false;
-			_startup._shell_program.reset();
-			return *this;
+			return _nodes.size();
 		}
 
-		process_builder &shell(const std::string &program)
+		const std::string &name(size_t id) const
 		{
-			if (program.empty()) {
-				mpp::throw_ex<mpp::runtime_error>("shell program cannot be empty");
-			}
-			_startup._shell_mode = true;
-			_startup._shell_program = program;
-			return *this;
+			return _nodes.at(id).name;
 		}
 
-		process start()
+		/**
+		 * Run the graph; options.on_done gets each node's id as it ends,
+		 * skipped nodes included.  Throws before launching anything on an
+		 * unknown dependency or a cycle.
+		 */
+		report run(const run_all_options &options = {})
 		{
-			process_startup s = _startup;
-			if (s._shell_mode) {
-				if (s._cmdline.empty()) {
-					mpp::throw_ex<mpp::runtime_error>("no command specified");
+			using clock = std::chrono::steady_clock;
+			const size_t n = _nodes.size();
+			std::vector<std::vector<size_t>> deps(n), dependents(n);
+			std::vector<size_t> waiting(n);
+			std::deque<size_t> ready;
+			for (size_t i = 0; i < n; ++i) {
+				for (auto &d : _nodes[i].deps) {
+					auto it = _index.find(d);
+					if (it == _index.end())
+						mpp::throw_ex<mpp::runtime_error>("task_graph: node \"" + _nodes[i].name +
+						                                  "\" depends on unknown node \"" + d + "\"");
+					deps[i].push_back(it->second);
+					dependents[it->second].push_back(i);
 				}
-				std::string cmd;
-				for (size_t i = 0; i < s._cmdline.size(); ++i) {
-					if (i > 0) cmd += ' ';
-					cmd += s._cmdline[i];
+				waiting[i] = deps[i].size();
+				if (waiting[i] == 0)
+					ready.push_back(i);
+			}
+			check_acyclic(deps, ready);
+
+			report rep;
+			rep.nodes.resize(n);
+			for (size_t i = 0; i < n; ++i)
+				rep.nodes[i].name = _nodes[i].name;
+			const size_t limit = detail::parallel_limit(options.max_parallel);
+			const clock::time_point t0 = clock::now();
+			const auto since = [t0] {
+				return std::chrono::duration<double>(clock::now() - t0).count();
+			};
+			detail::job_runner runner;
+			std::vector<bool> settled(n, false);
+			std::vector<size_t> done;
+			size_t finished = 0;
+			bool failed = false;
+
+			// Record node i, then release or skip its dependents.
+			const auto finish = [&](size_t i) {
+				std::vector<size_t> stack{i};
+				while (!stack.empty()) {
+					const size_t k = stack.back();
+					stack.pop_back();
+					node_result &r = rep.nodes[k];
+					settled[k] = true;
+					++finished;
+					if (r.job.started) {
+						r.finish = r.start + r.job.seconds;
+						r.status = r.job.exit_code == 0 ? task_status::succeeded : task_status::failed;
+					}
+					if (r.status != task_status::succeeded)
+						failed = true;
+					if (options.on_done)
+						options.on_done(k, r.job);
+					for (size_t d : dependents[k]) {
+						if (settled[d])
+							continue;
+						if (r.status != task_status::succeeded) {
+							rep.nodes[d].job.error = "dependency \"" + r.name + "\" did not succeed";
+							rep.nodes[d].status = task_status::skipped;
+							// Settled now, so a second failing dependency skips it only once.
+							settled[d] = true;
+							stack.push_back(d);
+						}
+						else if (--waiting[d] == 0) {
+							ready.push_back(d);
+						}
+					}
 				}
-#ifdef MOZART_PLATFORM_WIN32
-				const std::string shell_program = s._shell_program.value_or("cmd");
-				s._cmdline = {shell_program, "/c", std::move(cmd)};
-#else
-				const std::string shell_program = s._shell_program.value_or("/bin/sh");
-				s._cmdline = {shell_program, "-c", std::move(cmd)};
-#endif
+			};
+
+			while (finished < n) {
+				while (runner.active() < limit && !ready.empty()) {
+					const size_t i = ready.front();
+					ready.pop_front();
+					node_result &r = rep.nodes[i];
+					if (failed && options.fail_fast) {
+						r.job.error = "skipped after an earlier failure";
+						r.status = task_status::skipped;
+						finish(i);
+						continue;
+					}
+					r.start = since();
+					if (!runner.start(i, _nodes[i].builder, r.job)) {
+						r.status = task_status::failed;
+						finish(i);
+					}
+				}
+				done.clear();
+				runner.wait(done);
+				for (size_t i : done)
+					finish(i);
 			}
-			else if (s._cmdline.empty()) {
-				mpp::throw_ex<mpp::runtime_error>("no command specified");
+			rep.seconds = since();
+			rep.critical_path = critical_path(rep, deps);
+			return rep;
+		}
+
+	private:
+		static void check_acyclic(const std::vector<std::vector<size_t>> &deps,
+		                          const std::deque<size_t> &roots)
+		{
+			// Kahn's algorithm over the dependency counts.
+			std::vector<std::vector<size_t>> dependents(deps.size());
+			std::vector<size_t> waiting(deps.size());
+			for (size_t i = 0; i < deps.size(); ++i) {
+				waiting[i] = deps[i].size();
+				for (size_t d : deps[i])
+					dependents[d].push_back(i);
 			}
-			process_info info{};
-			mpp_impl::create_process(s, info);
-			return process(info);
+			std::vector<size_t> stack(roots.begin(), roots.end());
+			size_t seen = 0;
+			while (!stack.empty()) {
+				const size_t k = stack.back();
+				stack.pop_back();
+				++seen;
+				for (size_t d : dependents[k])
+					if (--waiting[d] == 0)
+						stack.push_back(d);
+			}
+			if (seen != deps.size())
+				mpp::throw_ex<mpp::runtime_error>("task_graph: dependency cycle");
+		}
+
+		static std::vector<size_t> critical_path(const report &rep,
+		        const std::vector<std::vector<size_t>> &deps)
+		{
+			std::vector<size_t> path;
+			size_t last = rep.nodes.size();
+			for (size_t i = 0; i < rep.nodes.size(); ++i)
+				if (rep.nodes[i].job.started && (last == rep.nodes.size() || rep.nodes[i].finish > rep.nodes[last].finish))
+					last = i;
+			while (last != rep.nodes.size()) {
+				path.push_back(last);
+				size_t gate = rep.nodes.size();
+				for (size_t d : deps[last])
+					if (gate == rep.nodes.size() || rep.nodes[d].finish > rep.nodes[gate].finish)
+						gate = d;
+				last = gate;
+			}
+			std::reverse(path.begin(), path.end());
+			return path;
 		}
 	};
 }
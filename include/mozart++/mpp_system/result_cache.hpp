@@ -0,0 +1,407 @@
+/**
+ * Mozart++ Template Library: System/Result Cache
+ *
+ * Licensed under Apache 2.0
+ *
+ * Copyright (C) 2017-2026 Michael Lee(李登淳)
+ *
+ * Email:   mikecovlee@163.com
+ * Github:  https://github.com/mikecovlee
+ * Website: http://covscript.org.cn
+ */
+#pragma once
+
+#include <mozart++/mpp_system/process.hpp>
+#include <mozart++/mpp_foundation/sha256.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace mpp {
+	/**
+	 * On-disk cache of the results of deterministic commands, in the
+	 * manner of ccache: a command whose normalized startup, stdin and
+	 * declared input files hash to a known key is not run again; its
+	 * exit code, stdout and stderr are replayed from the cache.
+	 *
+	 * The key covers the command line (after shell wrapping), the
+	 * executable (found on PATH, or the path given when the command
+	 * names one) with its size and modification time, the
+	 * absolute working directory, the child's effective environment
+	 * (the whole parent environment with the builder's environment()
+	 * overrides applied, or only the overrides when it is not
+	 * inherited), merge_outputs / keep_output, the stdin payload and
+	 * the SHA-256 of every declared input file.
+	 *
+	 * Entries live under dir as <2 hex>/<62 hex> files, written to a
+	 * temporary name and renamed, so concurrent users of one directory
+	 * never see a torn entry; an entry whose lengths do not match its
+	 * file is treated as a miss and removed.  A hit refreshes the entry's modification
+	 * time; when max_bytes is set, storing evicts the least recently used
+	 * entries until the cache is back under 90% of it.
+	 */
+	class result_cache {
+	public:
+		struct entry {
+			int exit_code = 0;
+			std::string out;
+			std::string err;
+			// True when replayed from the cache rather than run.
+			bool hit = false;
+		};
+
+	private:
+		static constexpr char magic[8] = {'M', 'P', 'P', 'R', 'C', '1', '\n', '\0'};
+
+		enum class read_status { missing, damaged, ok };
+
+		std::filesystem::path _dir;
+		uint64_t _max_bytes;
+		bool _cache_failures = false;
+		uint64_t _hits = 0;
+		uint64_t _misses = 0;
+		// Bytes on disk as of the last scan plus what was stored since;
+		// negative until the first scan.
+		int64_t _bytes = -1;
+
+		static void hash_field(sha256 &h, std::string_view field)
+		{
+			// Length-prefixed, so no two field sequences hash alike.
+			const uint64_t n = field.size();
+			unsigned char len[8];
+			for (int i = 0; i < 8; ++i)
+				len[i] = static_cast<unsigned char>(n >> (8 * i));
+			h.update(len, sizeof(len));
+			h.update(field);
+		}
+
+		static void hash_file(sha256 &h, const std::string &path)
+		{
+			std::ifstream in(path, std::ios::binary);
+			if (!in) {
+				hash_field(h, "missing");
+				return;
+			}
+			sha256 content;
+			char buf[64 * 1024];
+			while (in.read(buf, sizeof(buf)) || in.gcount() > 0)
+				content.update(buf, static_cast<size_t>(in.gcount()));
+			hash_field(h, "file");
+			hash_field(h, content.hex_digest());
+		}
+
+		std::filesystem::path entry_path(const std::string &key) const
+		{
+			return _dir / key.substr(0, 2) / key.substr(2);
+		}
+
+		static read_status read_entry(const std::filesystem::path &path, entry &e)
+		{
+			std::error_code ec;
+			const uint64_t file_size = std::filesystem::file_size(path, ec);
+			if (ec)
+				return read_status::missing;
+			std::ifstream in(path, std::ios::binary);
+			if (!in)
+				return read_status::missing;
+			char head[sizeof(magic)];
+			unsigned char fields[20];
+			if (!in.read(head, sizeof(head)) || std::memcmp(head, magic, sizeof(magic)) != 0 ||
+			        !in.read(reinterpret_cast<char *>(fields), sizeof(fields)))
+				return read_status::damaged;
+			const auto get = [&fields](int at, int bytes) {
+				uint64_t v = 0;
+				for (int i = bytes - 1; i >= 0; --i)
+					v = v << 8 | fields[at + i];
+				return v;
+			};
+			const uint64_t out_len = get(4, 8);
+			const uint64_t err_len = get(12, 8);
+			// Checked before anything is sized from them.
+			if (out_len > file_size || err_len > file_size ||
+			        sizeof(magic) + sizeof(fields) + out_len + err_len != file_size)
+				return read_status::damaged;
+			e.exit_code = static_cast<int>(static_cast<uint32_t>(get(0, 4)));
+			e.out.resize(static_cast<size_t>(out_len));
+			e.err.resize(static_cast<size_t>(err_len));
+			if ((e.out.empty() || in.read(&e.out[0], static_cast<std::streamsize>(e.out.size()))) &&
+			        (e.err.empty() || in.read(&e.err[0], static_cast<std::streamsize>(e.err.size()))))
+				return read_status::ok;
+			return read_status::damaged;
+		}
+
+		// put() writes to <entry>.tmp<N> and renames; another writer may
+		// be filling one right now.
+		static bool is_temporary(const std::filesystem::path &path)
+		{
+			return path.filename().string().find(".tmp") != std::string::npos;
+		}
+
+		uint64_t scan(std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> *files) const
+		{
+			uint64_t total = 0;
+			std::error_code ec;
+			for (std::filesystem::recursive_directory_iterator it(_dir, ec), end; !ec && it != end; it.increment(ec)) {
+				if (!it->is_regular_file(ec) || is_temporary(it->path()))
+					continue;
+				const uint64_t size = it->file_size(ec);
+				if (ec)
+					continue;
+				total += size;
+				if (files != nullptr)
+					files->emplace_back(it->last_write_time(ec), it->path());
+			}
+			return total;
+		}
+
+		void evict()
+		{
+			std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+			uint64_t total = scan(&files);
+			std::sort(files.begin(), files.end());
+			const uint64_t target = _max_bytes - _max_bytes / 10;
+			std::error_code ec;
+			for (auto &f : files) {
+				if (total <= target)
+					break;
+				const uint64_t size = std::filesystem::file_size(f.second, ec);
+				if (!ec && std::filesystem::remove(f.second, ec))
+					total -= size;
+			}
+			_bytes = static_cast<int64_t>(total);
+		}
+
+	public:
+		/**
+		 * Cache in directory @p dir, created if needed, holding at most
+		 * about @p max_bytes (0: unbounded).
+		 */
+		explicit result_cache(const std::string &dir, uint64_t max_bytes = 0)
+			: _dir(dir), _max_bytes(max_bytes)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(_dir, ec);
+			if (ec)
+				mpp::throw_ex<mpp::runtime_error>("result_cache: cannot create " + dir + ": " + ec.message());
+		}
+
+		/** Also cache runs that exited non-zero (off by default). */
+		result_cache &cache_failures(bool enable)
+		{
+			_cache_failures = enable;
+			return *this;
+		}
+
+		/**
+		 * Key of running @p builder with @p input on stdin, given the
+		 * files in @p inputs.  Throws when a stream is inherited,
+		 * redirected or mapped, as the output would not be captured.
+		 */
+		std::string key(process_builder builder, const std::vector<std::string> &inputs = {},
+		                std::string_view input = {}) const
+		{
+			const process_startup s = builder.launch_startup();
+			if (s._inherit_stdin || s._inherit_stdout || s._inherit_stderr || s._stdin.redirected() ||
+			        s._stdout.redirected() || s._stderr.redirected() || s._capture_mapped)
+				mpp::throw_ex<mpp::runtime_error>("result_cache: only commands with piped stdio can be cached");
+			sha256 h;
+			hash_field(h, "mpp-result-cache-1");
+			hash_field(h, std::to_string(s._cmdline.size()));
+			for (auto &arg : s._cmdline)
+				hash_field(h, arg);
+			// A name with a separator is run as that path, relative to
+			// the working directory; anything else is looked up on PATH.
+			const std::string &prog = s._cmdline[0];
+#ifdef MOZART_PLATFORM_WIN32
+			const bool named = prog.find_first_of("/\\") != std::string::npos;
+#else
+			const bool named = prog.find('/') != std::string::npos;
+#endif
+			std::string exe;
+			if (named) {
+				std::filesystem::path path(prog);
+				if (path.is_relative() && !s._cwd.empty())
+					path = std::filesystem::path(s._cwd) / path;
+				exe = path.lexically_normal().string();
+			}
+			else if (!mpp_impl::resolve_executable(prog, exe))
+				exe.clear();
+			std::error_code size_ec, mtime_ec;
+			const auto size = exe.empty() ? 0 : std::filesystem::file_size(exe, size_ec);
+			const auto mtime = exe.empty() ? std::filesystem::file_time_type() :
+			                   std::filesystem::last_write_time(exe, mtime_ec);
+			if (exe.empty() || size_ec || mtime_ec)
+				hash_field(h, "exe-unknown");
+			else {
+				hash_field(h, exe);
+				hash_field(h, std::to_string(size) + ":" + std::to_string(mtime.time_since_epoch().count()));
+			}
+			std::error_code ec;
+			hash_field(h, std::filesystem::absolute(s._cwd, ec).lexically_normal().string());
+			// The environment the child will see, in name order.
+			std::map<std::string, std::string> env;
+			if (s._inherit_env) {
+				const auto parent = mpp_impl::parent_environment();
+				env.insert(parent.begin(), parent.end());
+			}
+			for (auto &kv : s._env)
+				env[kv.first] = kv.second;
+			hash_field(h, s._inherit_env ? "inherit" : "clean");
+			hash_field(h, std::to_string(env.size()));
+			for (auto &kv : env) {
+				hash_field(h, kv.first);
+				hash_field(h, kv.second);
+			}
+			hash_field(h, s._merge_outputs ? "merged" : "split");
+			hash_field(h, std::to_string(s._keep_head) + ":" + std::to_string(s._keep_tail));
+			hash_field(h, input);
+			hash_field(h, std::to_string(inputs.size()));
+			for (auto &path : inputs) {
+				hash_field(h, path);
+				hash_file(h, path);
+			}
+			return h.hex_digest();
+		}
+
+		/** The entry stored under @p key; counts a hit or a miss. */
+		std::optional<entry> get(const std::string &key)
+		{
+			entry e;
+			const std::filesystem::path path = entry_path(key);
+			const read_status status = read_entry(path, e);
+			if (status != read_status::ok) {
+				if (status == read_status::damaged) {
+					std::error_code ec;
+					std::filesystem::remove(path, ec);
+				}
+				++_misses;
+				return std::nullopt;
+			}
+			std::error_code ec;
+			std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+			++_hits;
+			e.hit = true;
+			return e;
+		}
+
+		/** Store @p e under @p key, then evict down to the size limit. */
+		void put(const std::string &key, const entry &e)
+		{
+			const std::filesystem::path path = entry_path(key);
+			std::error_code ec;
+			std::filesystem::create_directories(path.parent_path(), ec);
+			std::filesystem::path tmp = path;
+			// Unique across the processes sharing the directory.
+			static thread_local std::mt19937_64 rng{std::random_device{}()};
+			tmp += ".tmp" + std::to_string(rng());
+			{
+				std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+				unsigned char fields[20];
+				const auto set = [&fields](int at, int bytes, uint64_t v) {
+					for (int i = 0; i < bytes; ++i)
+						fields[at + i] = static_cast<unsigned char>(v >> (8 * i));
+				};
+				set(0, 4, static_cast<uint32_t>(e.exit_code));
+				set(4, 8, e.out.size());
+				set(12, 8, e.err.size());
+				out.write(magic, sizeof(magic));
+				out.write(reinterpret_cast<const char *>(fields), sizeof(fields));
+				out.write(e.out.data(), static_cast<std::streamsize>(e.out.size()));
+				out.write(e.err.data(), static_cast<std::streamsize>(e.err.size()));
+				if (!out.flush()) {
+					out.close();
+					std::filesystem::remove(tmp, ec);
+					return; // a full disk only costs the next run a miss
+				}
+			}
+			std::filesystem::rename(tmp, path, ec);
+			if (ec) {
+				std::filesystem::remove(tmp, ec);
+				return;
+			}
+			if (_max_bytes == 0)
+				return;
+			if (_bytes < 0)
+				_bytes = static_cast<int64_t>(scan(nullptr));
+			else
+				_bytes += static_cast<int64_t>(sizeof(magic) + 20 + e.out.size() + e.err.size());
+			if (static_cast<uint64_t>(_bytes) > _max_bytes)
+				evict();
+		}
+
+		/**
+		 * Replay the cached result of running @p builder with @p input on
+		 * stdin, or run it, store the result (when it exited 0, or always
+		 * with cache_failures()) and return it.
+		 */
+		entry run(const process_builder &builder, const std::vector<std::string> &inputs = {},
+		          std::string input = {})
+		{
+			const std::string k = key(builder, inputs, input);
+			if (auto e = get(k))
+				return std::move(*e);
+			process_builder b = builder;
+			process p = b.start();
+			return store(k, p.communicate(std::move(input)));
+		}
+
+		/**
+		 * The entry for @p r, the outcome of running the command behind
+		 * @p key, stored as run() would; for callers that drive the child
+		 * themselves.
+		 */
+		entry store(const std::string &key, process::communicate_result r)
+		{
+			entry e;
+			e.exit_code = r.exit_code;
+			e.out = std::move(r.out);
+			e.err = std::move(r.err);
+			if (e.exit_code == 0 || _cache_failures)
+				put(key, e);
+			return e;
+		}
+
+		uint64_t hits() const
+		{
+			return _hits;
+		}
+
+		uint64_t misses() const
+		{
+			return _misses;
+		}
+
+		void reset_stats()
+		{
+			_hits = _misses = 0;
+		}
+
+		/** Bytes the entries take on disk (scans the directory). */
+		uint64_t size()
+		{
+			const uint64_t total = scan(nullptr);
+			_bytes = static_cast<int64_t>(total);
+			return total;
+		}
+
+		/** Remove every entry (the <2 hex> subdirectories of dir). */
+		void clear()
+		{
+			std::error_code ec;
+			std::vector<std::filesystem::path> buckets;
+			for (std::filesystem::directory_iterator it(_dir, ec), end; !ec && it != end; it.increment(ec))
+				if (it->path().filename().string().size() == 2 && it->is_directory(ec))
+					buckets.push_back(it->path());
+			for (auto &b : buckets)
+				std::filesystem::remove_all(b, ec);
+			_bytes = 0;
+		}
+	};
+}
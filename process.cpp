@@ -24,10 +24,14 @@
 #include <covscript/cni.hpp>
 #include <mozart++/process>
 #include <mozart++/file>
+#include <mozart++/result_cache>
 
 #include <uv.h>
 
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <thread>
 
 #ifdef MOZART_PLATFORM_WIN32
@@ -139,9 +143,68 @@ static inline uv_file to_uv_file(const mpp::file_ptr &f)
 #endif
 }
 
+// Read up to len bytes of f at offset through the libuv pool, waiting at
+// most deadline_ms (< 0: no limit).  Returns the bytes read, 0 at EOF, or
+// a negative libuv error; *on_time tells whether it beat the deadline.
+static int fs_read_at(const mpp::file_ptr &f, char *buf, size_t len, int64_t offset,
+                      int deadline_ms, bool *on_time)
+{
+	*on_time = true;
+	const uv_file ufd = to_uv_file(f);
+	if (ufd < 0)
+		return UV_EBADF;
+	uv_buf_t iov = uv_buf_init(buf, static_cast<unsigned int>(len));
+	auto *bundle = new uv_fs_request{};
+	bundle->req.data = bundle;
+	const int submit = uv_fs_read(uv_default_loop(), &bundle->req, ufd, &iov, 1,
+	                              offset, uv_fs_complete);
+	if (submit < 0) {
+		uv_fs_req_cleanup(&bundle->req);
+		delete bundle;
+		return submit;
+	}
+	*on_time = uv_wait_fs_with_deadline(uv_default_loop(), bundle, deadline_ms);
+	const int n = bundle->state.result;
+	delete bundle;
+	return n;
+}
+
+// Read the next line_chunk bytes after f's read-ahead into it, waiting
+// at most deadline_ms.  Returns the bytes added, 0 at EOF, or < 0 on an
+// error or timeout.  Bytes that arrive late are kept all the same: they
+// sit ahead of the read position, so a retry does not read them again.
+static constexpr size_t line_chunk = 64 * 1024;
+
+static int fill_read_ahead(const mpp::file_ptr &f, int deadline_ms)
+{
+	const int64_t offset = f->read_position() + static_cast<int64_t>(f->read_ahead().size());
+	char *room = f->extend_read_ahead(line_chunk);
+	bool on_time = true;
+	const int n = fs_read_at(f, room, line_chunk, offset, deadline_ms, &on_time);
+	f->commit_read_ahead(line_chunk, n > 0 ? static_cast<size_t>(n) : 0);
+	return n > 0 && !on_time ? UV_ETIMEDOUT : n;
+}
+
+// Milliseconds left of deadline_ms since start (-1: no limit, 0: spent).
+static int remaining_ms(std::chrono::steady_clock::time_point start, int deadline_ms)
+{
+	if (deadline_ms < 0)
+		return -1;
+	const auto spent = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                       std::chrono::steady_clock::now() - start).count();
+	return spent >= deadline_ms ? 0 : static_cast<int>(deadline_ms - spent);
+}
+
 using process_t = std::shared_ptr<mpp::process>;
 using builder_t = mpp::process_builder;
+using spec_t = std::shared_ptr<const mpp::spawn_spec>;
+using pipeline_builder_t = mpp::pipeline_builder;
+using pipeline_t = std::shared_ptr<mpp::pipeline>;
+using mapped_t = std::shared_ptr<mpp::mapped_output>;
 using file_t = mpp::file_ptr;
+using pool_t = std::shared_ptr<mpp::worker_pool>;
+using graph_t = mpp::task_graph;
+using cache_t = std::shared_ptr<mpp::result_cache>;
 
 static std::string get_default_shell()
 {
@@ -154,6 +217,331 @@ static std::string get_default_shell()
 #endif
 }
 
+// COVSCRIPT_PROCESS_FORK_SERVER=1 starts the fork server when the module
+// is loaded, while the interpreter is still small and single-threaded.
+static const bool fork_server_at_load = []() {
+	const char *v = std::getenv("COVSCRIPT_PROCESS_FORK_SERVER");
+	return v != nullptr && *v != '\0' && std::strcmp(v, "0") != 0 && mpp_impl::fork_server_start();
+}();
+
+// Drains stdout and stderr simultaneously to avoid pipe-full deadlocks
+// (feeding *input to stdin meanwhile, when given), waits for the process
+// (or every pipeline stage) to exit, and returns the communicate_result.
+// In a fiber context: begin_communicate() starts the readers on the libuv
+// loop, then we poll poll_communicate() + yield cooperatively until they
+// finish.  No extra wrapper thread is needed; peer fibers stay schedulable.
+template <typename T>
+static auto drive_communicate(T &p, const std::string *input)
+{
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		if (input != nullptr)
+			p.begin_communicate(*input);
+		else
+			p.begin_communicate();
+		while (!p.poll_communicate())
+			cs::fiber::yield();
+		return p.end_communicate();
+	}
+#endif
+	return input != nullptr ? p.communicate(*input) : p.communicate();
+}
+
+// Wait for the child to exit.  In a fiber context: launch begin_wait() so
+// the exit is awaited off this thread (pidfd watch or libuv thread pool),
+// then cooperatively yield until poll_wait() sees it complete — zero
+// syscalls per tick.  Outside a fiber: collect_wait() waits synchronously.
+static int wait_exit(const process_t &p)
+{
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		p->begin_wait();
+		while (!p->poll_wait())
+			cs::fiber::yield();
+	}
+#endif
+	return p->collect_wait();
+}
+
+// The reply to ticket t of a worker pool, or null when its worker exited
+// first.  In a fiber context the wait polls and yields, like wait_exit().
+static cs::var pool_result(const pool_t &p, uint64_t t)
+{
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		while (!p->ready(t) && p->pending(t))
+			cs::fiber::yield();
+	}
+#endif
+	mpp::worker_result r = p->result(t);
+	if (!r.ok)
+		return cs::null_pointer;
+	return cs::var::make<std::string>(std::move(r.reply));
+}
+
+// wait_any() / wait_all() over an array of process_t, null entries
+// skipped -> {{index, exit_code}, ...}.  In a fiber context each round
+// only checks (timeout 0) and then yields, so peer fibers keep running.
+static cs::array wait_children(const cs::array &procs, bool all, long long timeout_ms)
+{
+	std::vector<mpp::process *> set;
+	set.reserve(procs.size());
+	for (auto &v : procs)
+		set.push_back(v.is_type_of<cs::pointer>() ? nullptr : v.const_val<process_t>().get());
+	const auto wait = [&set, all](int ms) {
+		return all ? mpp::wait_all(set, ms) : mpp::wait_any(set, ms);
+	};
+	std::vector<mpp::exited_child> exited;
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		const size_t live = set.size() - static_cast<size_t>(std::count(set.begin(), set.end(), nullptr));
+		const auto start = std::chrono::steady_clock::now();
+		for (;;) {
+			exited = wait(0);
+			if ((all ? exited.size() == live : !exited.empty() || live == 0) ||
+			        remaining_ms(start, static_cast<int>(timeout_ms)) == 0)
+				break;
+			cs::fiber::yield();
+		}
+	}
+	else
+#endif
+		exited = wait(static_cast<int>(timeout_ms));
+	cs::array result;
+	for (auto &e : exited) {
+		cs::array entry;
+		entry.push_back(cs::var::make<cs::numeric>(e.index));
+		entry.push_back(cs::var::make<cs::numeric>(e.exit_code));
+		result.push_back(cs::var::make<cs::array>(std::move(entry)));
+	}
+	return result;
+}
+
+// Appends {out_total, err_total} and {out_truncated, err_truncated}.
+template <typename R>
+static void push_capture_stats(cs::array &arr, const R &r)
+{
+	cs::array totals;
+	totals.push_back(cs::var::make<cs::numeric>(r.out_total));
+	totals.push_back(cs::var::make<cs::numeric>(r.err_total));
+	cs::array truncated;
+	truncated.push_back(cs::var::make<bool>(r.out_truncated));
+	truncated.push_back(cs::var::make<bool>(r.err_truncated));
+	arr.push_back(cs::var::make<cs::array>(std::move(totals)));
+	arr.push_back(cs::var::make<cs::array>(std::move(truncated)));
+}
+
+// A builder limit in ms; throws when negative.
+static uint64_t to_ms(const char *what, cs::numeric ms)
+{
+	if (ms < 0)
+		mpp::throw_ex<mpp::runtime_error>(std::string(what) + ": milliseconds must not be negative");
+	return static_cast<uint64_t>(ms);
+}
+
+// "" / "timeout" / "idle_timeout"
+static std::string limit_name(mpp::limit_kind limit)
+{
+	switch (limit) {
+	case mpp::limit_kind::timeout:
+		return "timeout";
+	case mpp::limit_kind::idle_timeout:
+		return "idle_timeout";
+	default:
+		return "";
+	}
+}
+
+// -> {stdout, stderr, exit_code, {totals}, {truncated}, limit}
+static cs::array run_communicate(const process_t &p, const std::string *input)
+{
+	auto r = drive_communicate(*p, input);
+	cs::array arr;
+	arr.push_back(cs::var::make<std::string>(std::move(r.out)));
+	arr.push_back(cs::var::make<std::string>(std::move(r.err)));
+	arr.push_back(cs::var::make<cs::numeric>(r.exit_code));
+	push_capture_stats(arr, r);
+	arr.push_back(cs::var::make<std::string>(limit_name(r.limit)));
+	return arr;
+}
+
+static cs::array to_code_array(const std::vector<int> &codes)
+{
+	cs::array arr;
+	for (int c : codes)
+		arr.push_back(cs::var::make<cs::numeric>(c));
+	return arr;
+}
+
+// -> {out, err, exit_code | null, error, seconds}
+static cs::array to_job_array(const mpp::job_result &r)
+{
+	cs::array arr;
+	arr.push_back(cs::var::make<std::string>(r.out));
+	arr.push_back(cs::var::make<std::string>(r.err));
+	if (r.started)
+		arr.push_back(cs::var::make<cs::numeric>(r.exit_code));
+	else
+		arr.push_back(cs::null_pointer);
+	arr.push_back(cs::var::make<std::string>(r.error));
+	arr.push_back(cs::var::make<cs::numeric>(r.seconds));
+	return arr;
+}
+
+// A builder as is, or a string run through the default shell.
+static builder_t to_job_builder(const cs::var &v)
+{
+	if (v.is_type_of<builder_t>())
+		return v.const_val<builder_t>();
+	builder_t b;
+	b.command(v.const_val<std::string>());
+	b.shell(get_default_shell());
+	return b;
+}
+
+// max_parallel (<= 0: all CPUs) and the "fail_fast" key of a run_all /
+// task_graph options hash; "on_done" is left to the caller.
+static mpp::run_all_options to_run_options(cs::numeric max_parallel, const cs::hash_map &options)
+{
+	mpp::run_all_options o;
+	o.max_parallel = max_parallel > 0 ? static_cast<size_t>(max_parallel) : 0;
+	auto it = options.find(cs::var::make<std::string>("fail_fast"));
+	if (it != options.end())
+		o.fail_fast = it->second.const_val<bool>();
+	return o;
+}
+
+static const cs::var *find_on_done(const cs::hash_map &options)
+{
+	auto it = options.find(cs::var::make<std::string>("on_done"));
+	return it == options.end() ? nullptr : &it->second;
+}
+
+// -> {last stdout, last stderr, {exit code per stage}, {totals}, {truncated}, limit}
+static cs::array run_communicate(const pipeline_t &p, const std::string *input)
+{
+	auto r = drive_communicate(*p, input);
+	cs::array arr;
+	arr.push_back(cs::var::make<std::string>(std::move(r.out)));
+	arr.push_back(cs::var::make<std::string>(std::move(r.err)));
+	arr.push_back(cs::var::make<cs::array>(to_code_array(r.exit_codes)));
+	push_capture_stats(arr, r);
+	arr.push_back(cs::var::make<std::string>(limit_name(r.limit)));
+	return arr;
+}
+
+// Heap bundle for process.pump() on the libuv pool.  Holds references to
+// the process and the file so neither can be closed under the worker;
+// the pump itself is bounded by its deadline, so the wait always ends.
+struct pump_request {
+	uv_work_t req;
+	process_t proc;
+	file_t file;
+	uint64_t offset = 0;
+	int64_t length = -1;
+	int deadline_ms = -1;
+	uint64_t moved = 0;
+	std::string error;
+	bool done = false;
+};
+
+static void pump_work_cb(uv_work_t *req)
+{
+	auto *r = static_cast<pump_request *>(req->data);
+	try {
+		r->moved = r->proc->pump(r->file->native_fd(), r->offset, r->length, r->deadline_ms);
+	}
+	catch (const std::exception &e) {
+		r->error = e.what();
+	}
+}
+
+static void pump_after_cb(uv_work_t *req, int)
+{
+	static_cast<pump_request *>(req->data)->done = true;
+}
+
+// In a fiber context the transfer runs on the libuv pool while the fiber
+// yields, so a slow reader only stalls this fiber; otherwise it runs here.
+static uint64_t run_pump(const process_t &p, const file_t &f, uint64_t offset,
+                         int64_t length, int deadline_ms)
+{
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		auto r = std::make_unique<pump_request>();
+		r->req.data = r.get();
+		r->proc = p;
+		r->file = f;
+		r->offset = offset;
+		r->length = length;
+		r->deadline_ms = deadline_ms;
+		if (uv_queue_work(uv_default_loop(), &r->req, pump_work_cb, pump_after_cb) == 0) {
+			while (!r->done) {
+				uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+				if (!r->done)
+					cs::fiber::yield();
+			}
+			if (!r->error.empty())
+				mpp::throw_ex<mpp::runtime_error>(r->error);
+			return r->moved;
+		}
+	}
+#endif
+	return p->pump(f->native_fd(), offset, length, deadline_ms);
+}
+
+// Script callbacks of output subscriptions (on_out_line etc.).  The loop
+// only queues them; process.async.poll() / poll_once() run them, so
+// CovScript code never runs inside a wait that happens to drive the loop.
+struct pending_callback {
+	cs::var fn;
+	std::string data;
+};
+
+static std::deque<pending_callback> pending_callbacks;
+
+// Run the callbacks queued so far; those they queue wait for the next
+// poll.  One that throws leaves the rest queued.
+static void dispatch_callbacks()
+{
+	for (size_t n = pending_callbacks.size(); n > 0 && !pending_callbacks.empty(); --n) {
+		pending_callback c = std::move(pending_callbacks.front());
+		pending_callbacks.pop_front();
+		cs::invoke(c.fn, cs::var::make<std::string>(std::move(c.data)));
+	}
+}
+
+static std::function<void(std::string_view)> queue_callback(const cs::var &fn)
+{
+	return [fn](std::string_view data) {
+		pending_callbacks.push_back(pending_callback{fn, std::string(data)});
+	};
+}
+
+// Run a deadline-aware stdio call (read_stdout / write_stdin, ...).  In a
+// fiber context it is only ever polled (deadline 0) and the fiber yields
+// between tries until the deadline passes; otherwise the call itself
+// waits on the pipe.
+template <typename F>
+static auto poll_stdio(int deadline_ms, F &&call)
+{
+#if COVSCRIPT_PROCESS_HAVE_FIBER
+	if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
+		const auto start = std::chrono::steady_clock::now();
+		for (;;) {
+			auto r = call(0);
+			if (r || deadline_ms == 0)
+				return r;
+			if (deadline_ms > 0 && std::chrono::steady_clock::now() - start
+			        >= std::chrono::milliseconds(deadline_ms))
+				return r;
+			cs::fiber::yield();
+		}
+	}
+#endif
+	return call(deadline_ms);
+}
+
 CNI_ROOT_NAMESPACE {
 	CNI_V(exec, [](const std::string &cmd, const cs::array &args)
 	{
@@ -168,6 +556,16 @@ CNI_ROOT_NAMESPACE {
 		return get_default_shell();
 	})
 
+	// fork_server(enable) -> bool: start or stop the fork server; returns
+	// whether it is running afterwards (always false on Windows).
+	CNI_V(fork_server, [](bool enable) -> bool
+	{
+		if (enable)
+			return mpp_impl::fork_server_start();
+		mpp_impl::fork_server_stop();
+		return false;
+	})
+
 	CNI_V(shell, [](const std::string &command)
 	{
 		builder_t b;
@@ -176,6 +574,118 @@ CNI_ROOT_NAMESPACE {
 		return std::make_shared<mpp::process>(b.start());
 	})
 
+	// run(cmd, args, options) -> [out, err, exit_code, {totals},
+	// {truncated}, limit, timed_out]: spawn, communicate and wait in one
+	// native call; communicate()'s layout with timed_out appended.
+	// options (a hash, may be empty): "env" -> hash of overrides,
+	// "inherit_env" -> bool, "cwd" -> str, "input" -> str fed
+	// to stdin, "capture" -> "pipe" (default) | "merge" | "inherit",
+	// "shell" -> bool (run cmd with args through default_shell()),
+	// "timeout" / "idle_timeout" / "kill_grace" -> ms, as the builder's.
+	CNI_V(run, [](const std::string &cmd, const cs::array &args, const cs::hash_map &options)
+	{
+		builder_t b;
+		b.command(cmd);
+		std::vector<std::string> argv;
+		argv.reserve(args.size());
+		for (auto &it : args)
+			argv.emplace_back(it.const_val<std::string>());
+		b.arguments(argv);
+		const std::string *input = nullptr;
+		for (auto &kv : options) {
+			const std::string &key = kv.first.const_val<std::string>();
+			const cs::var &v = kv.second;
+			if (key == "env") {
+				for (auto &e : v.const_val<cs::hash_map>())
+					b.environment(e.first.const_val<std::string>(), e.second.const_val<std::string>());
+			}
+			else if (key == "inherit_env")
+				b.inherit_env(v.const_val<bool>());
+			else if (key == "cwd")
+				b.directory(v.const_val<std::string>());
+			else if (key == "input")
+				input = &v.const_val<std::string>();
+			else if (key == "capture") {
+				const std::string &mode = v.const_val<std::string>();
+				if (mode == "merge")
+					b.merge_outputs(true);
+				else if (mode == "inherit")
+					b.inherit_output(true);
+				else if (mode != "pipe")
+					mpp::throw_ex<mpp::runtime_error>("run: capture must be \"pipe\", \"merge\" or \"inherit\"");
+			}
+			else if (key == "shell") {
+				if (v.const_val<bool>())
+					b.shell(get_default_shell());
+			}
+			else if (key == "timeout")
+				b.timeout(to_ms("run: timeout", v.const_val<cs::numeric>()));
+			else if (key == "idle_timeout")
+				b.idle_timeout(to_ms("run: idle_timeout", v.const_val<cs::numeric>()));
+			else if (key == "kill_grace")
+				b.kill_grace(to_ms("run: kill_grace", v.const_val<cs::numeric>()));
+			else
+				mpp::throw_ex<mpp::runtime_error>("run: unknown option \"" + key + "\"");
+		}
+		mpp::process p = b.start();
+		mpp::process::communicate_result r = drive_communicate(p, input);
+		cs::array arr;
+		arr.push_back(cs::var::make<std::string>(std::move(r.out)));
+		arr.push_back(cs::var::make<std::string>(std::move(r.err)));
+		arr.push_back(cs::var::make<cs::numeric>(r.exit_code));
+		push_capture_stats(arr, r);
+		arr.push_back(cs::var::make<std::string>(limit_name(r.limit)));
+		arr.push_back(cs::var::make<bool>(r.limit != mpp::limit_kind::none));
+		return arr;
+	})
+
+	// wait_any(procs, timeout_ms) -> {{index, exit_code}, ...}: block until
+	// at least one process_t of procs (null entries skipped) has exited,
+	// for at most timeout_ms (< 0: no limit), and report every one that
+	// has; empty on timeout.  wait_all waits for all of them.
+	CNI_V(wait_any, [](const cs::array &procs, long long timeout_ms)
+	{
+		return wait_children(procs, false, timeout_ms);
+	})
+	CNI_V(wait_all, [](const cs::array &procs, long long timeout_ms)
+	{
+		return wait_children(procs, true, timeout_ms);
+	})
+
+	// result_cache(dir, max_bytes) -> cache: on-disk cache of command
+	// results under dir, trimmed to about max_bytes (0: unbounded).
+	CNI_V(result_cache, [](const std::string &dir, cs::numeric max_bytes) -> cache_t
+	{
+		if (max_bytes < 0)
+			mpp::throw_ex<mpp::runtime_error>("result_cache: max_bytes must not be negative");
+		return std::make_shared<mpp::result_cache>(dir, static_cast<uint64_t>(max_bytes));
+	})
+
+	// run_all(commands, max_parallel, options) -> array: run every command
+	// (a builder, or a string for the default shell) with at most
+	// max_parallel at once (<= 0: the CPUs available) and return
+	// [out, err, exit_code | null, error, seconds] per command, in order.
+	// options (a hash, may be empty): "fail_fast" -> bool,
+	// "on_done" -> function(index, result) called as each job finishes.
+	CNI_V(run_all, [](const cs::array &commands, cs::numeric max_parallel, const cs::hash_map &options)
+	{
+		std::vector<builder_t> jobs;
+		jobs.reserve(commands.size());
+		for (auto &c : commands)
+			jobs.push_back(to_job_builder(c));
+		mpp::run_all_options o = to_run_options(max_parallel, options);
+		if (const cs::var *fn = find_on_done(options)) {
+			const cs::var on_done = *fn;
+			o.on_done = [on_done](size_t i, const mpp::job_result &r) {
+				cs::invoke(on_done, cs::var::make<cs::numeric>(i), cs::var::make<cs::array>(to_job_array(r)));
+			};
+		}
+		cs::array result;
+		for (auto &r : mpp::run_all(std::move(jobs), o))
+			result.push_back(cs::var::make<cs::array>(to_job_array(r)));
+		return result;
+	})
+
 	// -------------------------------------------------------------------------
 	// file_t extension methods
 	// -------------------------------------------------------------------------
@@ -208,30 +718,9 @@ CNI_ROOT_NAMESPACE {
 			if (size <= 0) return cs::var::make<std::string>(std::string{});
 
 			std::vector<char> buf(size);
-			uv_buf_t iov = uv_buf_init(buf.data(), size);
-			auto *bundle = new uv_fs_request{};
-			bundle->req.data = bundle;
-			const uv_file ufd = to_uv_file(f);
-			if (ufd < 0)
-			{
-				delete bundle;
-				return cs::null_pointer;
-			}
-
-			const int submit = uv_fs_read(
-			                       uv_default_loop(), &bundle->req, ufd, &iov, 1,
-			                       static_cast<int64_t>(f->read_position()), uv_fs_complete);
-			if (submit < 0)
-			{
-				uv_fs_req_cleanup(&bundle->req);
-				delete bundle;
-				return cs::null_pointer;
-			}
-
-			const bool on_time = uv_wait_fs_with_deadline(
-			                         uv_default_loop(), bundle, deadline_ms);
-			const int n = bundle->state.result;
-			delete bundle;
+			bool on_time = true;
+			const int n = fs_read_at(f, buf.data(), static_cast<size_t>(size),
+			                         f->read_position(), deadline_ms, &on_time);
 			if (n > 0)
 			{
 				// When the deadline was exceeded the caller receives null and
@@ -250,6 +739,76 @@ CNI_ROOT_NAMESPACE {
 			// n < 0: error or timeout.
 			return cs::null_pointer;
 		})
+		// readline(deadline_ms): the next line at the current position,
+		// including its "\n".  "" = EOF, null = error / timeout (the
+		// position stays put, so a retry resumes).  Reads 64 KiB blocks
+		// ahead and searches them with mpp::find_newline().  The first
+		// block is always read; the deadline is checked after it, so
+		// readline(0) still returns a line that block holds.
+		CNI_V(readline, [](file_t &f, int deadline_ms) -> cs::var {
+			if (!f || !f->is_readable()) return cs::null_pointer;
+			const auto start = std::chrono::steady_clock::now();
+			size_t scanned = 0;
+			bool first = true;
+			for (;;)
+			{
+				std::string_view ahead = f->read_ahead();
+				const char *nl = mpp::find_newline(ahead.data() + scanned, ahead.data() + ahead.size());
+				if (nl != nullptr) {
+					std::string line(ahead.data(), nl + 1);
+					f->consume_read_ahead(line.size());
+					return cs::var::make<std::string>(std::move(line));
+				}
+				scanned = ahead.size();
+				const int remaining = remaining_ms(start, deadline_ms);
+				if (remaining == 0 && !first)
+					return cs::null_pointer;
+				const int n = fill_read_ahead(f, remaining == 0 ? -1 : remaining);
+				first = false;
+				if (n < 0)
+					return cs::null_pointer;
+				if (n == 0) {
+					std::string line(f->read_ahead());
+					f->consume_read_ahead(line.size());
+					return cs::var::make<std::string>(std::move(line));
+				}
+			}
+		})
+		// lines(deadline_ms): everything from the current position to EOF
+		// as an array of lines without "\n" / "\r\n".  null = error /
+		// timeout, with the position unchanged.  As with readline, the
+		// first block is read before the deadline is checked.
+		CNI_V(lines, [](file_t &f, int deadline_ms) -> cs::var {
+			if (!f || !f->is_readable()) return cs::null_pointer;
+			const auto start = std::chrono::steady_clock::now();
+			bool first = true;
+			cs::array result;
+			auto push = [&result](std::string_view line)
+			{
+				result.push_back(cs::var::make<std::string>(line));
+			};
+			// Nothing is consumed until EOF; done marks the bytes split so far.
+			size_t done = 0;
+			for (;;)
+			{
+				std::string_view ahead = f->read_ahead();
+				done += mpp::for_each_line(ahead.substr(done), push);
+				const int remaining = remaining_ms(start, deadline_ms);
+				if (remaining == 0 && !first)
+					return cs::null_pointer;
+				const int n = fill_read_ahead(f, remaining == 0 ? -1 : remaining);
+				first = false;
+				if (n < 0)
+					return cs::null_pointer;
+				if (n == 0)
+					break;
+			}
+			std::string_view rest = f->read_ahead().substr(done);
+			if (!rest.empty())
+				push(mpp::chomp_cr(rest));
+			f->consume_read_ahead(f->read_ahead().size());
+			return cs::var::make<cs::array>(std::move(result));
+		})
 		// write(data, deadline_ms): write data to the file.
 		// Returns bytes written, or -1 on error / timeout.
 		//
@@ -369,14 +928,19 @@ CNI_ROOT_NAMESPACE {
 	{
 		// Drive the libuv event loop without blocking.
 		// Returns non-zero if the loop has active handles/requests remaining.
+		// Queued output callbacks (on_out_line etc.) run afterwards.
 		CNI_V(poll, []() -> int {
-			return uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+			const int active = uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+			dispatch_callbacks();
+			return active;
 		})
 
 		// Run one iteration of the event loop (may wait briefly for I/O).
 		// Returns true if more work remains after this iteration.
 		CNI_V(poll_once, []() -> bool {
-			return uv_run(uv_default_loop(), UV_RUN_ONCE) != 0;
+			const bool active = uv_run(uv_default_loop(), UV_RUN_ONCE) != 0;
+			dispatch_callbacks();
+			return active;
 		})
 
 		// Stop the currently-running event loop (uv_run returns after current callbacks).
@@ -448,6 +1012,64 @@ CNI_ROOT_NAMESPACE {
 			b.val<builder_t>().inherit_env(v);
 			return b;
 		})
+		// stdin_buffer(bytes): buffer writes to in(); 0 (default) writes through.
+		CNI_V(stdin_buffer, [](const cs::var &b, cs::numeric bytes) -> cs::var {
+			if (bytes < 0)
+				mpp::throw_ex<mpp::runtime_error>("stdin_buffer: size must not be negative");
+			b.val<builder_t>().stdin_buffer(static_cast<size_t>(bytes));
+			return b;
+		})
+		// read_buffer(bytes): read size of out() / err(); 0 restores the default.
+		CNI_V(read_buffer, [](const cs::var &b, cs::numeric bytes) -> cs::var {
+			if (bytes < 0)
+				mpp::throw_ex<mpp::runtime_error>("read_buffer: size must not be negative");
+			b.val<builder_t>().read_buffer(static_cast<size_t>(bytes));
+			return b;
+		})
+		// output_size_hint(bytes): expected stdout size for communicate().
+		CNI_V(output_size_hint, [](const cs::var &b, cs::numeric bytes) -> cs::var {
+			if (bytes < 0)
+				mpp::throw_ex<mpp::runtime_error>("output_size_hint: size must not be negative");
+			b.val<builder_t>().output_size_hint(static_cast<size_t>(bytes));
+			return b;
+		})
+		// keep_output(tail, head): communicate keeps only the first head and
+		// the last tail bytes of each stream; 0, 0 keeps everything.
+		CNI_V(keep_output, [](const cs::var &b, cs::numeric tail, cs::numeric head) -> cs::var {
+			if (tail < 0 || head < 0)
+				mpp::throw_ex<mpp::runtime_error>("keep_output: sizes must not be negative");
+			b.val<builder_t>().keep_output(static_cast<size_t>(tail), static_cast<size_t>(head));
+			return b;
+		})
+		// capture_mapped(enable): capture stdout / stderr into anonymous
+		// files, read after exit through mapped_out() / mapped_err().
+		CNI_V(capture_mapped, [](const cs::var &b, bool enable) -> cs::var {
+			b.val<builder_t>().capture_mapped(enable);
+			return b;
+		})
+		// capture_spill(memory_cap, dir): captures whose output_size_hint
+		// exceeds memory_cap go to a disk-backed file in dir ("" = temp dir).
+		CNI_V(capture_spill, [](const cs::var &b, cs::numeric memory_cap, const std::string &dir) -> cs::var {
+			if (memory_cap < 0)
+				mpp::throw_ex<mpp::runtime_error>("capture_spill: size must not be negative");
+			b.val<builder_t>().capture_spill(static_cast<size_t>(memory_cap), dir);
+			return b;
+		})
+		// timeout(ms) / idle_timeout(ms): SIGTERM the child's process group
+		// once it ran for ms, or wrote nothing for ms (0: no limit), then
+		// SIGKILL after kill_grace(ms) (0: SIGKILL at once).
+		CNI_V(timeout, [](const cs::var &b, cs::numeric ms) -> cs::var {
+			b.val<builder_t>().timeout(to_ms("timeout", ms));
+			return b;
+		})
+		CNI_V(idle_timeout, [](const cs::var &b, cs::numeric ms) -> cs::var {
+			b.val<builder_t>().idle_timeout(to_ms("idle_timeout", ms));
+			return b;
+		})
+		CNI_V(kill_grace, [](const cs::var &b, cs::numeric ms) -> cs::var {
+			b.val<builder_t>().kill_grace(to_ms("kill_grace", ms));
+			return b;
+		})
 		CNI_V(shell, [](const cs::var &b, const std::string &program) -> cs::var {
 			b.val<builder_t>().shell(program);
 			return b;
@@ -476,33 +1098,324 @@ CNI_ROOT_NAMESPACE {
 		CNI_V(start, [](builder_t &b) {
 			return std::make_shared<mpp::process>(b.start());
 		})
+		// start_many(n) -> array of [process_t | null, error: str], one per child.
+		CNI_V(start_many, [](builder_t &b, cs::numeric n) {
+			if (n < 0)
+				mpp::throw_ex<mpp::runtime_error>("start_many: count must not be negative");
+			cs::array arr;
+			for (auto &r : b.start_many(static_cast<size_t>(n))) {
+				cs::array entry;
+				if (r.ok())
+					entry.push_back(cs::var::make<process_t>(std::make_shared<mpp::process>(std::move(*r.proc))));
+				else
+					entry.push_back(cs::null_pointer);
+				entry.push_back(cs::var::make<std::string>(std::move(r.error)));
+				arr.push_back(cs::var::make<cs::array>(std::move(entry)));
+			}
+			return arr;
+		})
+		// prepare() -> spec: freeze the builder for repeated launches.
+		CNI_V(prepare, [](const builder_t &b) -> spec_t {
+			return std::make_shared<const mpp::spawn_spec>(b.prepare());
+		})
+		// worker_pool(n, framing, recycle_after) -> pool: n long-lived
+		// children answering one request at a time on stdin / stdout.
+		// framing is "line" or "length" (32-bit big-endian prefix); each
+		// worker is replaced after recycle_after requests (0: never).
+		CNI_V(worker_pool, [](const builder_t &b, cs::numeric n, const std::string &framing,
+		cs::numeric recycle_after) -> pool_t {
+			if (n < 1 || recycle_after < 0)
+				mpp::throw_ex<mpp::runtime_error>("worker_pool: need at least one worker and recycle_after >= 0");
+			mpp::worker_framing f;
+			if (framing == "line")
+				f = mpp::worker_framing::line;
+			else if (framing == "length")
+				f = mpp::worker_framing::length_prefixed;
+			else
+				mpp::throw_ex<mpp::runtime_error>("worker_pool: framing must be \"line\" or \"length\"");
+			return std::make_shared<mpp::worker_pool>(b, static_cast<size_t>(n), f,
+			        static_cast<size_t>(recycle_after));
+		})
 	}
 
-	CNI_NAMESPACE(process_type)
+	CNI_NAMESPACE(spec_type)
 	{
-		CNI_V(in, [](const process_t &p) {
+		// start(args): launch with args in place of the captured arguments.
+		CNI_V(start, [](const spec_t &s, const cs::array &args) {
+			std::vector<std::string> arr;
+			arr.reserve(args.size());
+			for (auto &it:args)
+				arr.emplace_back(it.const_val<std::string>());
+			return std::make_shared<mpp::process>(s->start(arr));
+		})
+		// args() -> array: the arguments captured by builder.prepare().
+		CNI_V(args, [](const spec_t &s) {
+			cs::array arr;
+			for (auto &it : s->arguments())
+				arr.push_back(cs::var::make<std::string>(it));
+			return arr;
+		})
+		// executable() -> string: PATH-resolved program, "" if deferred to spawn.
+		CNI_V(executable, [](const spec_t &s) -> std::string {
+			return s->executable();
+		})
+	}
+
+	CNI_TYPE_EXT_V(pipeline_builder_type, pipeline_builder_t, pipeline, pipeline_builder_t())
+	{
+		// add(builder): append a stage; the builder's settings are copied.
+		CNI_V(add, [](const cs::var &pb, const builder_t &b) -> cs::var {
+			pb.val<pipeline_builder_t>().add(b);
+			return pb;
+		})
+		CNI_V(size, [](const pipeline_builder_t &pb) -> cs::numeric {
+			return pb.size();
+		})
+		CNI_V(start, [](pipeline_builder_t &pb) {
+			return std::make_shared<mpp::pipeline>(pb.start());
+		})
+	}
+
+	CNI_NAMESPACE(pipeline_type)
+	{
+		// in(): first stage's stdin; out() / err(): last stage's stdout / stderr.
+		CNI_V(in, [](const pipeline_t &p) {
 			return cs::ostream(&p->in(), [](std::ostream *) {});
 		})
-		CNI_V(out, [](const process_t &p) {
+		CNI_V(out, [](const pipeline_t &p) {
 			return cs::istream(&p->out(), [](std::istream *) {});
 		})
-		CNI_V(err, [](const process_t &p) {
+		CNI_V(err, [](const pipeline_t &p) {
 			return cs::istream(&p->err(), [](std::istream *) {});
 		})
-		CNI_V(wait, [](const process_t &p) {
-			// In a fiber context: launch begin_wait() so work on the libuv thread pool performs
-			// the single blocking waitpid/WaitForSingleObject, then cooperatively
-			// yield until poll_wait() sees the work complete — zero syscalls per tick.
-			// Outside a fiber: collect_wait() falls back to direct synchronous wait.
+		CNI_V(close_stdin, [](const pipeline_t &p) {
+			p->close_stdin();
+		})
+		CNI_V(size, [](const pipeline_t &p) -> cs::numeric {
+			return p->size();
+		})
+		// stage(i) -> process: shares ownership with the pipeline.
+		CNI_V(stage, [](const pipeline_t &p, cs::numeric i) -> process_t {
+			if (i < 0 || static_cast<size_t>(i) >= p->size())
+				mpp::throw_ex<mpp::runtime_error>("pipeline stage index out of range");
+			return process_t(p, &p->stage(static_cast<size_t>(i)));
+		})
+		// wait() -> array: exit code of every stage, in order.
+		CNI_V(wait, [](const pipeline_t &p) {
 #if COVSCRIPT_PROCESS_HAVE_FIBER
 			if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
 				p->begin_wait();
 				while (!p->poll_wait())
 					cs::fiber::yield();
-				return p->collect_wait();
 			}
 #endif
-			return p->collect_wait();
+			return to_code_array(p->wait());
+		})
+		CNI_V(has_exited, [](const pipeline_t &p) {
+			return p->has_exited();
+		})
+		// kill(force): terminate every stage and its descendants.
+		CNI_V(kill, [](const pipeline_t &p, bool force) {
+			p->interrupt(force);
+		})
+		CNI_V(communicate, [](const pipeline_t &p) {
+			return run_communicate(p, nullptr);
+		})
+		CNI_V(communicate_input, [](const pipeline_t &p, const std::string &input) {
+			return run_communicate(p, &input);
+		})
+	}
+
+	CNI_TYPE_EXT_V(graph_type, graph_t, task_graph, graph_t())
+	{
+		// add(name, command, deps) -> graph: command is a builder or a
+		// shell string; deps names nodes that must succeed first.
+		CNI_V(add, [](const cs::var &g, const std::string &name, const cs::var &command,
+		const cs::array &deps) -> cs::var {
+			std::vector<std::string> names;
+			names.reserve(deps.size());
+			for (auto &d : deps)
+				names.emplace_back(d.const_val<std::string>());
+			g.val<graph_t>().add(name, to_job_builder(command), std::move(names));
+			return g;
+		})
+		CNI_V(size, [](const graph_t &g) -> cs::numeric {
+			return g.size();
+		})
+		// run(max_parallel, options) -> [nodes, critical_path, seconds]:
+		// nodes holds [name, status, exit_code | null, out, err, error,
+		// start, finish] per node in the order added; critical_path the
+		// names of the chain that ended last.  options as run_all, with
+		// on_done(name, result) and result as in run_all.
+		CNI_V(run, [](graph_t &g, cs::numeric max_parallel, const cs::hash_map &options) {
+			static const char *const status_names[] = {"succeeded", "failed", "skipped"};
+			const auto to_node = [](const mpp::task_graph::node_result &n) {
+				cs::array arr;
+				arr.push_back(cs::var::make<std::string>(n.name));
+				arr.push_back(cs::var::make<std::string>(status_names[static_cast<int>(n.status)]));
+				cs::array job = to_job_array(n.job);
+				arr.push_back(job[2]);
+				arr.push_back(job[0]);
+				arr.push_back(job[1]);
+				arr.push_back(job[3]);
+				arr.push_back(cs::var::make<cs::numeric>(n.start));
+				arr.push_back(cs::var::make<cs::numeric>(n.finish));
+				return arr;
+			};
+			mpp::run_all_options o = to_run_options(max_parallel, options);
+			if (const cs::var *fn = find_on_done(options)) {
+				const cs::var on_done = *fn;
+				o.on_done = [on_done, &g](size_t i, const mpp::job_result &r) {
+					cs::invoke(on_done, cs::var::make<std::string>(g.name(i)),
+					           cs::var::make<cs::array>(to_job_array(r)));
+				};
+			}
+			mpp::task_graph::report rep = g.run(o);
+			cs::array nodes, path;
+			for (auto &n : rep.nodes)
+				nodes.push_back(cs::var::make<cs::array>(to_node(n)));
+			for (size_t i : rep.critical_path)
+				path.push_back(cs::var::make<std::string>(rep.nodes[i].name));
+			cs::array result;
+			result.push_back(cs::var::make<cs::array>(std::move(nodes)));
+			result.push_back(cs::var::make<cs::array>(std::move(path)));
+			result.push_back(cs::var::make<cs::numeric>(rep.seconds));
+			return result;
+		})
+	}
+
+	CNI_NAMESPACE(cache_type)
+	{
+		// run(command, inputs, input) -> [out, err, exit_code, hit]: replay
+		// the cached result, or run command (a builder or a shell string)
+		// with input on stdin and cache it.  inputs lists the files the
+		// result depends on; their contents are part of the key.  A miss
+		// runs like process.run, yielding in a fiber.
+		CNI_V(run, [](const cache_t &c, const cs::var &command, const cs::array &inputs,
+		const std::string &input) {
+			std::vector<std::string> files;
+			files.reserve(inputs.size());
+			for (auto &f : inputs)
+				files.emplace_back(f.const_val<std::string>());
+			builder_t b = to_job_builder(command);
+			const std::string key = c->key(b, files, input);
+			std::optional<mpp::result_cache::entry> hit = c->get(key);
+			mpp::result_cache::entry e;
+			if (hit)
+				e = std::move(*hit);
+			else {
+				mpp::process p = b.start();
+				e = c->store(key, drive_communicate(p, &input));
+			}
+			cs::array arr;
+			arr.push_back(cs::var::make<std::string>(std::move(e.out)));
+			arr.push_back(cs::var::make<std::string>(std::move(e.err)));
+			arr.push_back(cs::var::make<cs::numeric>(e.exit_code));
+			arr.push_back(cs::var::make<bool>(e.hit));
+			return arr;
+		})
+		// cache_failures(enable) -> cache: also keep non-zero exits.
+		CNI_V(cache_failures, [](const cs::var &c, bool enable) -> cs::var {
+			c.const_val<cache_t>()->cache_failures(enable);
+			return c;
+		})
+		CNI_V(hits, [](const cache_t &c) -> cs::numeric {
+			return c->hits();
+		})
+		CNI_V(misses, [](const cache_t &c) -> cs::numeric {
+			return c->misses();
+		})
+		CNI_V(reset_stats, [](const cache_t &c) {
+			c->reset_stats();
+		})
+		// size() -> bytes the entries take on disk.
+		CNI_V(size, [](const cache_t &c) -> cs::numeric {
+			return c->size();
+		})
+		CNI_V(clear, [](const cache_t &c) {
+			c->clear();
+		})
+	}
+
+	CNI_NAMESPACE(mapped_type)
+	{
+		CNI_V(size, [](const mapped_t &m) -> cs::numeric {
+			return m->size();
+		})
+		// str() -> string: copy of the whole capture.
+		CNI_V(str, [](const mapped_t &m) -> std::string {
+			return std::string(m->view());
+		})
+		// substr(pos, len) -> string: copy of a slice, clamped to the capture.
+		CNI_V(substr, [](const mapped_t &m, cs::numeric pos, cs::numeric len) -> std::string {
+			if (pos < 0 || len < 0)
+				mpp::throw_ex<mpp::runtime_error>("substr: position and length must not be negative");
+			const std::string_view v = m->view();
+			if (static_cast<size_t>(pos) >= v.size())
+				return std::string();
+			return std::string(v.substr(static_cast<size_t>(pos), static_cast<size_t>(len)));
+		})
+		// write_to(file_t) -> bytes written, straight from the mapped pages,
+		// at the file's write position (or its end in append mode).
+		CNI_V(write_to, [](const mapped_t &m, const file_t &f) -> cs::numeric {
+			if (!f || !f->is_writable())
+				mpp::throw_ex<mpp::runtime_error>("file_t is not open for writing");
+			const size_t n = m->write_to(f->native_fd(), f->is_append() ? -1 : f->write_position());
+			if (!f->is_append())
+				f->advance_write(static_cast<int64_t>(n));
+			return n;
+		})
+	}
+
+	CNI_NAMESPACE(pool_type)
+	{
+		// submit(request) -> ticket; queued until a worker is free.
+		CNI_V(submit, [](const pool_t &p, const std::string &request) -> cs::numeric {
+			return p->submit(request);
+		})
+		// ready(ticket) -> bool: the answer (or the worker's death) is in.
+		CNI_V(ready, [](const pool_t &p, cs::numeric ticket) -> bool {
+			return p->ready(static_cast<uint64_t>(ticket));
+		})
+		// result(ticket) -> string or null: the reply, or null when the
+		// worker exited first.  In a fiber the wait yields between polls.
+		CNI_V(result, [](const pool_t &p, cs::numeric ticket) -> cs::var {
+			return pool_result(p, static_cast<uint64_t>(ticket));
+		})
+		// call(request) -> string or null: submit() and result() in one.
+		CNI_V(call, [](const pool_t &p, const std::string &request) -> cs::var {
+			return pool_result(p, p->submit(request));
+		})
+		// outstanding() -> requests queued or in flight.
+		CNI_V(outstanding, [](const pool_t &p) -> cs::numeric {
+			return p->outstanding();
+		})
+		// workers() -> children currently alive.
+		CNI_V(workers, [](const pool_t &p) -> cs::numeric {
+			return p->workers();
+		})
+		// shutdown(grace_ms): close the workers' stdin, kill the stragglers.
+		CNI_V(shutdown, [](const pool_t &p, int grace_ms) {
+			p->shutdown(grace_ms);
+		})
+	}
+
+	CNI_NAMESPACE(process_type)
+	{
+		CNI_V(in, [](const process_t &p) {
+			return cs::ostream(&p->in(), [](std::ostream *) {});
+		})
+		CNI_V(out, [](const process_t &p) {
+			return cs::istream(&p->out(), [](std::istream *) {});
+		})
+		CNI_V(err, [](const process_t &p) {
+			return cs::istream(&p->err(), [](std::istream *) {});
+		})
+		CNI_V(close_stdin, [](const process_t &p) {
+			p->close_stdin();
+		})
+		CNI_V(wait, [](const process_t &p) {
+			return wait_exit(p);
 		})
 		CNI_V(try_wait, [](const process_t &p) -> cs::var {
 			// poll_wait() checks the work state without a syscall (if begin_wait()
@@ -583,35 +1496,126 @@ CNI_ROOT_NAMESPACE {
 		CNI_V(kill_tree, [](const process_t &p, bool force) {
 			p->interrupt_tree(force);
 		})
+		// limit_reached() -> "" / "timeout" / "idle_timeout": the builder
+		// limit that made the child be signalled.
+		CNI_V(limit_reached, [](const process_t &p) {
+			return limit_name(p->limit_reached());
+		})
 		CNI_V(get_pid, [](const process_t &p) {
 			return p->pid();
 		})
 		CNI_V(communicate, [](const process_t &p) {
-			// Drains stdout and stderr simultaneously to avoid pipe-full deadlocks,
-			// waits for the process to exit, and returns {stdout, stderr, exit_code}.
-			// In a fiber context: begin_communicate() submits reader work to the libuv thread pool
-			// (same thread overhead as always — two reader threads), then we poll
-			// poll_communicate() + yield cooperatively until both readers finish.
-			// No extra wrapper thread is needed; peer fibers stay schedulable.
-#if COVSCRIPT_PROCESS_HAVE_FIBER
-			if (cs::current_process != nullptr && !cs::current_process->fiber_stack.empty()) {
-				p->begin_communicate();
-				while (!p->poll_communicate())
-					cs::fiber::yield();
-				auto r = p->end_communicate();
-				cs::array arr;
-				arr.push_back(cs::var::make<std::string>(std::move(r.out)));
-				arr.push_back(cs::var::make<std::string>(std::move(r.err)));
-				arr.push_back(cs::var::make<cs::numeric>(r.exit_code));
-				return arr;
-			}
-#endif
-			auto r = p->communicate();
-			cs::array arr;
-			arr.push_back(cs::var::make<std::string>(std::move(r.out)));
-			arr.push_back(cs::var::make<std::string>(std::move(r.err)));
-			arr.push_back(cs::var::make<cs::numeric>(r.exit_code));
-			return arr;
+			return run_communicate(p, nullptr);
+		})
+		CNI_V(communicate_input, [](const process_t &p, const std::string &input) {
+			return run_communicate(p, &input);
+		})
+		// mapped_out() / mapped_err(): wait for exit, then map the capture
+		// (builder.capture_mapped); empty when the stream was not captured.
+		CNI_V(mapped_out, [](const process_t &p) {
+			wait_exit(p);
+			return std::make_shared<mpp::mapped_output>(p->mapped_stdout());
+		})
+		CNI_V(mapped_err, [](const process_t &p) {
+			wait_exit(p);
+			return std::make_shared<mpp::mapped_output>(p->mapped_stderr());
+		})
+		// pump(file_t, offset, length, deadline_ms) -> bytes moved: stream
+		// length bytes of the file from offset (length < 0: up to EOF) into
+		// the child's stdin, which stays open.  A short count means EOF,
+		// the child stopped reading, or the deadline passed while the pipe
+		// was full (deadline_ms < 0: no limit).
+		CNI_V(pump, [](const process_t &p, const file_t &f, long long offset,
+		long long length, int deadline_ms) -> cs::numeric {
+			if (!f || !f->is_readable())
+				mpp::throw_ex<mpp::runtime_error>("file_t is not open for reading");
+			if (offset < 0)
+				mpp::throw_ex<mpp::runtime_error>("pump offset must be non-negative");
+			return run_pump(p, f, static_cast<uint64_t>(offset),
+			                static_cast<int64_t>(length), deadline_ms);
+		})
+		// readline() -> string: the next line of stdout including its "\n",
+		// "" at EOF.  Blocks like out(), but scans 64 KiB blocks with
+		// mpp::find_newline() instead of going a character at a time.
+		CNI_V(readline, [](const process_t &p) {
+			std::string line;
+			p->read_line(line);
+			return line;
+		})
+		// lines() -> array: the rest of stdout up to EOF, split into lines
+		// without "\n" / "\r\n".
+		CNI_V(lines, [](const process_t &p) {
+			cs::array result;
+			for (auto &line : p->read_lines())
+				result.push_back(cs::var::make<std::string>(std::move(line)));
+			return result;
+		})
+		// read_out(max, deadline_ms) / read_err(...) -> string or null: up to
+		// max bytes from the child's stdout / stderr pipe, waiting at most
+		// deadline_ms for data (< 0: no limit, 0: poll).  Returns "" at EOF
+		// and null on timeout.
+		CNI_V(read_out, [](const process_t &p, long long max, int deadline_ms) -> cs::var {
+			auto r = poll_stdio(deadline_ms, [&](int ms)
+			{
+				return p->read_stdout(static_cast<size_t>(std::max(0LL, max)), ms);
+			});
+			if (!r)
+				return cs::null_pointer;
+			return cs::var::make<std::string>(std::move(*r));
+		})
+		CNI_V(read_err, [](const process_t &p, long long max, int deadline_ms) -> cs::var {
+			auto r = poll_stdio(deadline_ms, [&](int ms)
+			{
+				return p->read_stderr(static_cast<size_t>(std::max(0LL, max)), ms);
+			});
+			if (!r)
+				return cs::null_pointer;
+			return cs::var::make<std::string>(std::move(*r));
+		})
+		// on_out_chunk(fn) / on_out_line(fn) / on_err_chunk / on_err_line:
+		// subscribe to the child's output; fn(str) is called with each
+		// chunk / line (without "\n") from process.async.poll().
+		CNI_V(on_out_chunk, [](const process_t &p, const cs::var &fn) {
+			p->on_stdout_chunk(queue_callback(fn));
+		})
+		CNI_V(on_out_line, [](const process_t &p, const cs::var &fn) {
+			p->on_stdout_line(queue_callback(fn));
+		})
+		CNI_V(on_err_chunk, [](const process_t &p, const cs::var &fn) {
+			p->on_stderr_chunk(queue_callback(fn));
+		})
+		CNI_V(on_err_line, [](const process_t &p, const cs::var &fn) {
+			p->on_stderr_line(queue_callback(fn));
+		})
+		CNI_V(pause_out, [](const process_t &p) {
+			p->pause_stdout();
+		})
+		CNI_V(resume_out, [](const process_t &p) {
+			p->resume_stdout();
+		})
+		CNI_V(pause_err, [](const process_t &p) {
+			p->pause_stderr();
+		})
+		CNI_V(resume_err, [](const process_t &p) {
+			p->resume_stderr();
+		})
+		// output_done() -> bool: every subscribed stream reached EOF and no
+		// output callback is left waiting for poll().
+		CNI_V(output_done, [](const process_t &p) -> bool {
+			return p->output_done() && pending_callbacks.empty();
+		})
+		// write_in(data, deadline_ms) -> bytes written or null: as much of
+		// data as the stdin pipe takes, waiting at most deadline_ms for room.
+		// -1 once stdin is closed or the child stopped reading; null when
+		// the deadline passed with nothing written.
+		CNI_V(write_in, [](const process_t &p, const std::string &data, int deadline_ms) -> cs::var {
+			auto r = poll_stdio(deadline_ms, [&](int ms)
+			{
+				return p->write_stdin(data, ms);
+			});
+			if (!r)
+				return cs::null_pointer;
+			return cs::var::make<cs::numeric>(*r);
 		})
 	}
 }
@@ -619,3 +1623,10 @@ CNI_ROOT_NAMESPACE {
 CNI_ENABLE_TYPE_EXT_V(file_type, file_t, process_file)
 CNI_ENABLE_TYPE_EXT_V(builder_type, builder_t, process_builder)
 CNI_ENABLE_TYPE_EXT_V(process_type, process_t, process)
+CNI_ENABLE_TYPE_EXT_V(spec_type, spec_t, process_spec)
+CNI_ENABLE_TYPE_EXT_V(pipeline_builder_type, pipeline_builder_t, process_pipeline_builder)
+CNI_ENABLE_TYPE_EXT_V(pipeline_type, pipeline_t, process_pipeline)
+CNI_ENABLE_TYPE_EXT_V(mapped_type, mapped_t, process_mapped)
+CNI_ENABLE_TYPE_EXT_V(pool_type, pool_t, process_worker_pool)
+CNI_ENABLE_TYPE_EXT_V(graph_type, graph_t, process_task_graph)
+CNI_ENABLE_TYPE_EXT_V(cache_type, cache_t, process_result_cache)
@@ -28,13 +28,9 @@ namespace mpp_impl {
 		return true;
 	}
 
-	void create_process(const process_startup &startup,
-	                    process_info &info)
+	void open_stdio(const process_startup &startup,
+	                fd_type *pstdin, fd_type *pstdout, fd_type *pstderr)
 	{
-		fd_type pstdin[2] = {FD_INVALID, FD_INVALID};
-		fd_type pstdout[2] = {FD_INVALID, FD_INVALID};
-		fd_type pstderr[2] = {FD_INVALID, FD_INVALID};
-
 		// Skip pipe creation for inherited streams; the platform-specific
 		// create_process_impl will use the parent's handles directly.
 		if (!startup._inherit_stdin && !redirect_or_pipe(startup._stdin, pstdin)) {
@@ -55,23 +51,124 @@ namespace mpp_impl {
 				mpp::throw_ex<mpp::runtime_error>("unable to bind stderr");
 			}
 		}
+	}
+
+	void close_stdio(const process_startup &startup,
+	                 fd_type *pstdin, fd_type *pstdout, fd_type *pstderr)
+	{
+		// note: we should NOT close user provided redirect target fd,
+		// let users to close.
+		if (!startup._inherit_stdin && !startup._stdin.redirected()) {
+			close_pipe(pstdin);
+		}
+		if (!startup._inherit_stdout && !startup._stdout.redirected()) {
+			close_pipe(pstdout);
+		}
+		if (!startup._inherit_stderr && !startup._merge_outputs
+		        && !startup._stderr.redirected()) {
+			close_pipe(pstderr);
+		}
+	}
+
+	/**
+	 * create_process() for a startup with _capture_mapped: the capture
+	 * files become ordinary redirect targets of the uncaptured startup,
+	 * and are handed to @p info once the child runs.
+	 */
+	static void create_captured_process(const process_startup &startup,
+	                                    process_info &info, const argv_block *argv)
+	{
+		process_startup s = startup;
+		s._capture_mapped = false;
+		fd_type out = FD_INVALID, err = FD_INVALID;
+		try {
+			if (!s._inherit_stdout && !s._stdout.redirected()) {
+				out = create_capture_file(s);
+				s._stdout._target = out;
+			}
+			if (!s._merge_outputs && !s._inherit_stderr && !s._stderr.redirected()) {
+				err = create_capture_file(s);
+				s._stderr._target = err;
+			}
+			create_process(s, info, argv);
+		}
+		catch (...) {
+			close_fd(out);
+			close_fd(err);
+			throw;
+		}
+		info._capture_out = out;
+		info._capture_err = err;
+	}
+
+	void create_process(const process_startup &startup,
+	                    process_info &info, const argv_block *argv)
+	{
+		if (startup._capture_mapped) {
+			create_captured_process(startup, info, argv);
+			return;
+		}
+
+		fd_type pstdin[2] = {FD_INVALID, FD_INVALID};
+		fd_type pstdout[2] = {FD_INVALID, FD_INVALID};
+		fd_type pstderr[2] = {FD_INVALID, FD_INVALID};
+
+		open_stdio(startup, pstdin, pstdout, pstderr);
 
 		try {
-			create_process_impl(startup, info, pstdin, pstdout, pstderr);
+			create_process_impl(startup, info, pstdin, pstdout, pstderr, argv);
 		}
 		catch (...) {
 			// do rollback work
-			// note: we should NOT close user provided redirect target fd,
-			// let users to close.
-			if (!startup._inherit_stdin && !startup._stdin.redirected()) {
-				close_pipe(pstdin);
-			}
-			if (!startup._inherit_stdout && !startup._stdout.redirected()) {
-				close_pipe(pstdout);
+			close_stdio(startup, pstdin, pstdout, pstderr);
+			throw;
+		}
+	}
+
+	void create_pipeline(std::vector<process_startup> &stages,
+	                     std::vector<process_info> &infos)
+	{
+		const size_t n = stages.size();
+		infos.assign(n, process_info{});
+		size_t started = 0;
+		// Read end of the pipe from the previous stage, not yet handed on.
+		fd_type upstream = FD_INVALID;
+		try {
+			for (size_t i = 0; i < n; ++i) {
+				process_startup &s = stages[i];
+				if (i > 0) {
+					s._inherit_stdin = false;
+					s._stdin._target = upstream;
+				}
+				fd_type link[2] = {FD_INVALID, FD_INVALID};
+				if (i + 1 < n) {
+					if (!create_chain_pipe(link)) {
+						mpp::throw_ex<mpp::runtime_error>("unable to create pipeline pipe");
+					}
+					s._inherit_stdout = false;
+					s._stdout._target = link[PIPE_WRITE];
+				}
+				try {
+					create_process(s, infos[i]);
+				}
+				catch (...) {
+					close_pipe(link);
+					throw;
+				}
+				++started;
+				// The children hold their ends now; keeping ours would hide
+				// EOF / EPIPE from them.
+				close_fd(upstream);
+				close_fd(link[PIPE_WRITE]);
+				upstream = link[PIPE_READ];
 			}
-			if (!startup._inherit_stderr && !startup._merge_outputs
-			        && !startup._stderr.redirected()) {
-				close_pipe(pstderr);
+		}
+		catch (...) {
+			close_fd(upstream);
+			for (size_t i = 0; i < started; ++i) {
+				terminate_process_tree(infos[i], true);
+				wait_for(infos[i]);
+				close_process(infos[i]);
 			}
 			throw;
 		}
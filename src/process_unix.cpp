@@ -18,18 +18,32 @@
 
 #include <mozart++/process>
 #include <algorithm>
+#include <atomic>
 #include <dirent.h>
 #include <cerrno>
 #include <fcntl.h>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include <cctype>
+#include <chrono>
 #include <climits>
+#include <csignal>
 #include <limits>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #ifdef __linux__
+#include <sched.h>
 #include <sys/syscall.h>
 #endif
 
@@ -200,6 +214,159 @@ namespace mpp_impl {
 		return pathv;
 	}
 
+	/**
+	 * Parent-side PATH resolution cache.
+	 *
+	 * Resolving in the parent lets the child issue a single execve() on the
+	 * final path instead of one failed execve() per earlier PATH directory.
+	 * Entries are keyed by the PATH contents and the command name and record
+	 * the mtime of every directory consulted; adding, removing or renaming a
+	 * file changes its directory's mtime, which invalidates the entry.
+	 * Misses are cached the same way.
+	 */
+	namespace path_cache {
+		struct dir_stamp {
+			std::string dir;
+			bool exists = false;
+			struct timespec mtime {};
+		};
+
+		struct entry {
+			// Empty when the command was not found.
+			std::string resolved;
+			std::vector<dir_stamp> dirs;
+		};
+
+		// Bound the cache so a stream of distinct names cannot grow it forever.
+		static constexpr size_t max_entries = 512;
+
+		static std::mutex lock;
+		static std::unordered_map<std::string, entry> entries;
+
+		static dir_stamp stamp(const std::string &dir)
+		{
+			dir_stamp s;
+			s.dir = dir;
+			struct stat st {};
+			if (stat(dir.c_str(), &st) == 0) {
+				s.exists = true;
+#ifdef MOZART_PLATFORM_DARWIN
+				s.mtime = st.st_mtimespec;
+#else
+				s.mtime = st.st_mtim;
+#endif
+			}
+			return s;
+		}
+
+		static bool still_valid(const entry &e)
+		{
+			for (const auto &d : e.dirs) {
+				dir_stamp now = stamp(d.dir);
+				if (now.exists != d.exists)
+					return false;
+				if (now.exists && (now.mtime.tv_sec != d.mtime.tv_sec
+				                   || now.mtime.tv_nsec != d.mtime.tv_nsec))
+					return false;
+			}
+			return true;
+		}
+
+		// Directory timestamps are coarse; a directory touched within the
+		// last couple of seconds may change again without a visible mtime
+		// change, so such lookups are not cached.
+		static bool settled(const entry &e)
+		{
+			const time_t now = time(nullptr);
+			for (const auto &d : e.dirs) {
+				if (d.exists && now - d.mtime.tv_sec < 2)
+					return false;
+			}
+			return true;
+		}
+
+		enum class outcome { found, not_found, uncacheable };
+
+		/**
+		 * Search @p path for @p file the way execvp() would.  Relative PATH
+		 * components depend on the child's working directory and candidates
+		 * that exist but are not executable need execve() to decide, so both
+		 * report `uncacheable` and leave the search to the child.
+		 */
+		static outcome search(const std::string &path, const std::string &file, entry &e)
+		{
+			size_t pos = 0;
+			while (true) {
+				size_t sep = path.find(':', pos);
+				std::string dir = path.substr(pos, sep == std::string::npos ? std::string::npos : sep - pos);
+				if (dir.empty() || dir[0] != '/')
+					return outcome::uncacheable;
+				e.dirs.push_back(stamp(dir));
+
+				std::string candidate = dir;
+				if (candidate.back() != '/')
+					candidate += '/';
+				candidate += file;
+				struct stat st {};
+				if (stat(candidate.c_str(), &st) == 0) {
+					if (S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+						e.resolved = std::move(candidate);
+						return outcome::found;
+					}
+					return outcome::uncacheable;
+				}
+				if (errno != ENOENT && errno != ENOTDIR)
+					return outcome::uncacheable;
+
+				if (sep == std::string::npos)
+					return outcome::not_found;
+				pos = sep + 1;
+			}
+		}
+	}
+
+	/**
+	 * Resolve @p file against the parent's PATH.
+	 *
+	 * Returns true with @p resolved set when the child can exec that path
+	 * directly, true with @p resolved empty when the command definitely does
+	 * not exist (errno semantics: ENOENT), and false when the child has to
+	 * search PATH itself.
+	 */
+	static bool resolve_in_path(const char *file, std::string &resolved)
+	{
+		const std::string path = get_path_env();
+		std::string key = path;
+		key += '\0';
+		key += file;
+
+		std::lock_guard<std::mutex> guard(path_cache::lock);
+		auto it = path_cache::entries.find(key);
+		if (it != path_cache::entries.end()) {
+			if (path_cache::still_valid(it->second)) {
+				resolved = it->second.resolved;
+				return true;
+			}
+			path_cache::entries.erase(it);
+		}
+
+		path_cache::entry e;
+		switch (path_cache::search(path, file, e)) {
+		case path_cache::outcome::uncacheable:
+			return false;
+		case path_cache::outcome::found:
+		case path_cache::outcome::not_found:
+			break;
+		}
+		resolved = e.resolved;
+		if (path_cache::settled(e)) {
+			if (path_cache::entries.size() >= path_cache::max_entries)
+				path_cache::entries.clear();
+			path_cache::entries.emplace(std::move(key), std::move(e));
+		}
+		return true;
+	}
+
 	/**
 	 * Exec file as a shell script but without shebang (#!).
 	 * This is a historical tradeoff.
@@ -238,14 +405,14 @@ namespace mpp_impl {
 
 	/**
 	 * mpp implementation of the GNU extension execvpe()
+	 *
+	 * PATH is searched through @p pathv, which the parent splits before the
+	 * child is created: with the vfork-style backend the child shares the
+	 * parent's address space and must not allocate.
 	 */
-	static void mpp_execvpe(const char *file, const char **argv, char **envp)
+	static void mpp_execvpe(const char *file, const char **argv, char **envp,
+	                        const char *const *pathv)
 	{
-		if (envp == nullptr || envp == environ) {
-			execvp(file, const_cast<char *const *>(argv));
-			return;
-		}
-
 		if (*file == '\0') {
 			errno = ENOENT;
 			return;
@@ -253,75 +420,70 @@ namespace mpp_impl {
 
 		if (strchr(file, '/') != nullptr) {
 			execve_or_shebang(file, argv, envp);
+			return;
+		}
 
+		// We must search PATH (parent's, not child's)
+		if (pathv == nullptr) {
+			errno = ENOMEM;
+			return;
 		}
-		else {
-			// We must search PATH (parent's, not child's)
-			const char *const *pathv = effective_pathv();
 
-			if (pathv == nullptr) {
-				errno = ENOMEM;
-				return;
+		// prepare the full space to avoid memory allocation
+		char absolute_path[PATH_MAX] = {0};
+		int filelen = strlen(file);
+		int sticky_errno = 0;
+
+		for (auto dirs = pathv; *dirs; dirs++) {
+			const char *dir = *dirs;
+			int dirlen = strlen(dir);
+			if (filelen + dirlen + 2 >= PATH_MAX) {
+				errno = ENAMETOOLONG;
+				continue;
 			}
 
-			// prepare the full space to avoid memory allocation
-			char absolute_path[PATH_MAX] = {0};
-			int filelen = strlen(file);
-			int sticky_errno = 0;
-
-			for (auto dirs = pathv; *dirs; dirs++) {
-				const char *dir = *dirs;
-				int dirlen = strlen(dir);
-				if (filelen + dirlen + 2 >= PATH_MAX) {
-					errno = ENAMETOOLONG;
-					continue;
-				}
-
-				memcpy(absolute_path, dir, dirlen);
-				if (absolute_path[dirlen - 1] != '/') {
-					absolute_path[dirlen++] = '/';
-				}
+			memcpy(absolute_path, dir, dirlen);
+			if (absolute_path[dirlen - 1] != '/') {
+				absolute_path[dirlen++] = '/';
+			}
 
-				memcpy(absolute_path + dirlen, file, filelen);
-				absolute_path[dirlen + filelen] = '\0';
-				execve_or_shebang(absolute_path, argv, envp);
-
-				// If permission is denied for a file (the attempted
-				// execve returned EACCES), these functions will continue
-				// searching the rest of the search path.  If no other
-				// file is found, however, they will return with the
-				// global variable errno set to EACCES.
-				switch (errno) {
-				case EACCES:
-					sticky_errno = errno;
-				// fall-through
-				case ENOENT:
-				case ENOTDIR:
+			memcpy(absolute_path + dirlen, file, filelen);
+			absolute_path[dirlen + filelen] = '\0';
+			execve_or_shebang(absolute_path, argv, envp);
+
+			// If permission is denied for a file (the attempted
+			// execve returned EACCES), these functions will continue
+			// searching the rest of the search path.  If no other
+			// file is found, however, they will return with the
+			// global variable errno set to EACCES.
+			switch (errno) {
+			case EACCES:
+				sticky_errno = errno;
+			// fall-through
+			case ENOENT:
+			case ENOTDIR:
 #ifdef ELOOP
-				case ELOOP:
+			case ELOOP:
 #endif
 #ifdef ESTALE
-				case ESTALE:
+			case ESTALE:
 #endif
 #ifdef ENODEV
-				case ENODEV:
+			case ENODEV:
 #endif
 #ifdef ETIMEDOUT
-				case ETIMEDOUT:
+			case ETIMEDOUT:
 #endif
-					// Try other directories in PATH
-					break;
-				default:
-					free((void*)pathv);
-					return;
-				}
+				// Try other directories in PATH
+				break;
+			default:
+				return;
 			}
-			free((void*)pathv);
+		}
 
-			// tell the caller the real errno
-			if (sticky_errno != 0) {
-				errno = sticky_errno;
-			}
+		// tell the caller the real errno
+		if (sticky_errno != 0) {
+			errno = sticky_errno;
 		}
 	}
 
@@ -344,34 +506,101 @@ namespace mpp_impl {
 		_exit(-1);
 	}
 
+	/**
+	 * Everything the child needs between spawn and exec, prepared by the
+	 * parent.  The child only reads from it: with the vfork-style backend it
+	 * runs in the parent's address space, so writing here (or allocating)
+	 * would corrupt the parent.
+	 */
+	struct spawn_context {
+		const process_startup *startup = nullptr;
+		fd_type stdin_fds[2] = {FD_INVALID, FD_INVALID};
+		fd_type stdout_fds[2] = {FD_INVALID, FD_INVALID};
+		fd_type stderr_fds[2] = {FD_INVALID, FD_INVALID};
+		fd_type fail_fds[2] = {FD_INVALID, FD_INVALID};
+		// File to exec: argv[0], or the path resolved by resolve_in_path().
+		const char *file = nullptr;
+		// argv has one spare slot for execve_without_shebang's expansion.
+		const char **argv = nullptr;
+		char **envp = nullptr;
+		const char *const *pathv = nullptr;
+		// Set by the vfork-style backend: the child resets inherited signal
+		// handlers and restores `sigmask` before exec.
+		bool reset_signals = false;
+		sigset_t sigmask;
+	};
+
+	static void child_close(fd_type fd)
+	{
+		if (fd != FD_INVALID) {
+			close(fd);
+		}
+	}
+
+	// Set once ignore_sigpipe() has ignored SIGPIPE on our behalf.  The
+	// SIG_IGN disposition survives exec, so children get SIG_DFL back.
+	static std::atomic<bool> sigpipe_ignored{false};
+
 	__attribute__((noreturn))
-	static void child_proc(const process_startup &startup, process_info &info,
-	                       fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
-	                       fd_type *pfail, char **prebuilt_envp)
+	static void child_proc(const spawn_context &ctx)
 	{
+		const process_startup &startup = *ctx.startup;
+
+		if (sigpipe_ignored.load(std::memory_order_relaxed)) {
+			struct sigaction sa {};
+			sa.sa_handler = SIG_DFL;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGPIPE, &sa, nullptr);
+		}
+
+		if (ctx.reset_signals) {
+			// A handler installed by the parent must not run on shared
+			// memory before exec.  Without CLONE_SIGHAND the dispositions
+			// are private to the child, so this does not affect the parent.
+			struct sigaction sa {};
+			for (int sig = 1; sig < NSIG; ++sig) {
+				if (sig == SIGKILL || sig == SIGSTOP) continue;
+				if (sigaction(sig, nullptr, &sa) != 0) continue;
+				if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL) continue;
+				sa.sa_handler = SIG_DFL;
+				sa.sa_flags = 0;
+				sigemptyset(&sa.sa_mask);
+				sigaction(sig, &sa, nullptr);
+			}
+			sigprocmask(SIG_SETMASK, &ctx.sigmask, nullptr);
+		}
+
 		// Put child in a dedicated process group for kill-tree semantics.
 		setpgid(0, 0);
 
+		// Work on copies of the descriptors: ctx may be parent memory.
+		const fd_type in_read = ctx.stdin_fds[PIPE_READ];
+		const fd_type in_write = ctx.stdin_fds[PIPE_WRITE];
+		const fd_type out_read = ctx.stdout_fds[PIPE_READ];
+		const fd_type out_write = ctx.stdout_fds[PIPE_WRITE];
+		const fd_type err_read = ctx.stderr_fds[PIPE_READ];
+		const fd_type err_write = ctx.stderr_fds[PIPE_WRITE];
+
 		// close child side of read pipe
-		close_fd(pfail[PIPE_READ]);
-		int fail_fd = pfail[PIPE_WRITE];
+		child_close(ctx.fail_fds[PIPE_READ]);
+		int fail_fd = ctx.fail_fds[PIPE_WRITE];
 
 		// Close ends the child doesn't need (for inherited streams these are FD_INVALID → no-op)
 		if (!startup._inherit_stdin && !startup._stdin.redirected()) {
-			close_fd(pstdin[PIPE_WRITE]);
+			child_close(in_write);
 		}
 		if (!startup._inherit_stdout && !startup._stdout.redirected()) {
-			close_fd(pstdout[PIPE_READ]);
+			child_close(out_read);
 		}
 
 		// Set up stdin
 		if (!startup._inherit_stdin) {
-			dup2(pstdin[PIPE_READ], STDIN_FILENO);
+			dup2(in_read, STDIN_FILENO);
 		}
 
 		// Set up stdout
 		if (!startup._inherit_stdout) {
-			dup2(pstdout[PIPE_WRITE], STDOUT_FILENO);
+			dup2(out_write, STDOUT_FILENO);
 		}
 
 		/*
@@ -386,28 +615,15 @@ namespace mpp_impl {
 		}
 		else if (!startup._inherit_stderr) {
 			if (!startup._stderr.redirected()) {
-				close_fd(pstderr[PIPE_READ]);
+				child_close(err_read);
 			}
-			dup2(pstderr[PIPE_WRITE], STDERR_FILENO);
+			dup2(err_write, STDERR_FILENO);
 		}
 		// if inherit_stderr: leave STDERR_FILENO pointing at parent's stderr
 
-		if (!startup._inherit_stdin)  close_fd(pstdin[PIPE_READ]);
-		if (!startup._inherit_stdout) close_fd(pstdout[PIPE_WRITE]);
-		if (!startup._inherit_stderr && !startup._merge_outputs) close_fd(pstderr[PIPE_WRITE]);
-
-		// command-line and environments
-		// Allocate one extra slot for execve_without_shebang's argv expansion
-		// (inserts /bin/sh at argv[0] and shifts the rest right by one).
-		size_t asize = startup._cmdline.size();
-		std::vector<char *> argv(asize + 2, nullptr);
-
-		// copy command-line arguments (points into startup._cmdline, valid after fork)
-		for (std::size_t i = 0; i < asize; ++i) {
-			argv[i] = const_cast<char *>(startup._cmdline[i].c_str());
-		}
-
-		// prebuilt_envp was constructed by the parent before fork, no heap allocation needed here.
+		if (!startup._inherit_stdin)  child_close(in_read);
+		if (!startup._inherit_stdout) child_close(out_write);
+		if (!startup._inherit_stderr && !startup._merge_outputs) child_close(err_write);
 
 		// close everything above stderr
 		close_all_descriptors(STDERR_FILENO + 1, fail_fd);
@@ -427,58 +643,253 @@ namespace mpp_impl {
 		}
 
 		// run subprocess
-		mpp_execvpe(argv[0], const_cast<const char **>(argv.data()), prebuilt_envp);
+		mpp_execvpe(ctx.file, ctx.argv, ctx.envp, ctx.pathv);
 
 		// exec failed
 		exit_with_error(fail_fd);
 		// never return
 	}
 
-	void create_process_impl(const process_startup &startup, process_info &info,
-	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr)
+#ifdef __linux__
+	static int clone_child_entry(void *arg)
+	{
+		child_proc(*static_cast<const spawn_context *>(arg));
+	}
+
+	/**
+	 * vfork-style spawn: clone(CLONE_VM | CLONE_VFORK) shares the parent's
+	 * address space instead of copying its page tables, so the cost no
+	 * longer grows with the parent's RSS.  The child runs on a private
+	 * stack and the calling thread stays suspended until it execs or exits.
+	 * Returns -1 (errno set) if the child could not be created.
+	 */
+	static pid_t clone_vfork_child(spawn_context &ctx)
 	{
-		// Build envp strings BEFORE fork to avoid heap allocation in the child
-		// process, where the allocator may be in an inconsistent state if the
-		// parent is multi-threaded.
-		std::vector<std::string> env_strings;
-		std::vector<char *> envp_vec;
-		char **prebuilt_envp_ptr;
+		constexpr size_t stack_size = 64 * 1024;
+		void *stack = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE,
+		                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (stack == MAP_FAILED) {
+			return -1;
+		}
 
+		// Keep every signal blocked until the child has reset the inherited
+		// handlers; child_proc restores the original mask before exec.
+		sigset_t all;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &ctx.sigmask);
+		ctx.reset_signals = true;
+
+		pid_t pid = clone(clone_child_entry, static_cast<char *>(stack) + stack_size,
+		                  CLONE_VM | CLONE_VFORK | SIGCHLD, &ctx);
+		int saved_errno = errno;
+
+		pthread_sigmask(SIG_SETMASK, &ctx.sigmask, nullptr);
+		ctx.reset_signals = false;
+		munmap(stack, stack_size);
+		errno = saved_errno;
+		return pid;
+	}
+#endif
+
+	/**
+	 * Create the child described by @p ctx using the backend requested in
+	 * the startup info.  fork() is only used when the address-space-sharing
+	 * backend is unavailable or was explicitly declined.
+	 */
+	static pid_t spawn_child(spawn_context &ctx)
+	{
+#ifdef __linux__
+		if (ctx.startup->_backend == spawn_backend::automatic) {
+			pid_t pid = clone_vfork_child(ctx);
+			if (pid >= 0) {
+				return pid;
+			}
+			MOZART_LOGEV("clone(CLONE_VM | CLONE_VFORK) failed, falling back to fork()");
+		}
+#endif
+		pid_t pid = fork();
+		if (pid == 0) {
+			// in child process, fail_fds will be closed in child_proc
+			child_proc(ctx);
+			// child never returns
+		}
+		return pid;
+	}
+
+	struct environment_block {
+		// Parent environ entries the block was merged from, compared by
+		// pointer in environment_block_current().  setenv()/unsetenv()
+		// replace entries or the table itself, so any change shows up here.
+		std::vector<const char *> parent;
+		bool inherit = false;
+		// "key=value\0" entries, laid out contiguously.
+		std::vector<char> strings;
+		// Null-terminated pointers into `strings`, passed as envp.
+		std::vector<char *> envp;
+	};
+
+	environment_ptr make_environment_block(const process_startup &startup)
+	{
 		if (startup._inherit_env && startup._env.empty()) {
-			// nullptr → mpp_execvpe calls execvp which inherits the parent's
-			// full environment without any copying.
-			prebuilt_envp_ptr = nullptr;
+			return nullptr;
+		}
+
+		auto block = std::make_shared<environment_block>();
+		std::vector<std::pair<std::string, std::string>> entries;
+		block->inherit = startup._inherit_env;
+		if (startup._inherit_env) {
+			// Merge: start from parent environ in its original order, then
+			// apply _env overrides in place and append the new keys.
+			std::unordered_map<std::string, size_t> index;
+			for (char **ep = environ; ep && *ep; ++ep) {
+				block->parent.push_back(*ep);
+				const char *eq = strchr(*ep, '=');
+				if (eq == nullptr)
+					continue;
+				std::string key(*ep, eq - *ep);
+				if (index.emplace(key, entries.size()).second)
+					entries.emplace_back(std::move(key), eq + 1);
+			}
+			for (const auto &e : startup._env) {
+				auto it = index.find(e.first);
+				if (it != index.end())
+					entries[it->second].second = e.second;
+				else
+					entries.emplace_back(e.first, e.second);
+			}
 		}
 		else {
-			if (startup._inherit_env) {
-				// Merge: start from parent environ, then apply _env overrides.
-				// All string construction happens before fork (no heap in child).
-				std::unordered_map<std::string, std::string> merged;
-				for (char **ep = environ; ep && *ep; ++ep) {
-					std::string entry(*ep);
-					auto eq = entry.find('=');
-					if (eq != std::string::npos)
-						merged.emplace(entry.substr(0, eq), entry.substr(eq + 1));
+			// inherit_env=false: only _env (empty env block if _env is also empty).
+			entries.assign(startup._env.begin(), startup._env.end());
+		}
+
+		size_t total = 0;
+		for (const auto &e : entries)
+			total += e.first.size() + e.second.size() + 2;
+		block->strings.resize(total);
+		block->envp.reserve(entries.size() + 1);
+		char *p = block->strings.data();
+		for (const auto &e : entries) {
+			block->envp.push_back(p);
+			memcpy(p, e.first.data(), e.first.size());
+			p += e.first.size();
+			*p++ = '=';
+			memcpy(p, e.second.data(), e.second.size());
+			p += e.second.size();
+			*p++ = '\0';
+		}
+		block->envp.push_back(nullptr);
+		return block;
+	}
+
+	bool environment_block_current(const environment_block &env)
+	{
+		if (!env.inherit) {
+			return true;
+		}
+		size_t i = 0;
+		for (char **ep = environ; ep && *ep; ++ep, ++i) {
+			if (i >= env.parent.size() || env.parent[i] != *ep)
+				return false;
+		}
+		return i == env.parent.size();
+	}
+
+	std::unordered_map<std::string, std::string> parent_environment()
+	{
+		std::unordered_map<std::string, std::string> env;
+		for (char **ep = environ; ep && *ep; ++ep) {
+			const char *eq = std::strchr(*ep, '=');
+			if (eq != nullptr)
+				env.emplace(std::string(*ep, eq - *ep), std::string(eq + 1));
+		}
+		return env;
+	}
+
+	bool resolve_executable(const std::string &file, std::string &resolved)
+	{
+		if (file.empty() || file.find('/') != std::string::npos) {
+			return false;
+		}
+		std::string path;
+		if (!resolve_in_path(file.c_str(), path) || path.empty()) {
+			return false;
+		}
+		resolved = std::move(path);
+		return true;
+	}
+
+	struct pathv_deleter {
+		void operator()(const char *const *pathv) const
+		{
+			free((void *)pathv);
+		}
+	};
+
+	/**
+	 * Everything a spawn needs besides its stdio: argv, the executable to
+	 * exec and the environment.  Built once per start(), or once for a
+	 * whole batch in create_processes().
+	 */
+	struct spawn_plan {
+		environment_ptr env_block;
+		char **envp = nullptr;
+		// Points into startup._cmdline or the caller's argv_block.
+		std::vector<const char *> argv;
+		std::string resolved;
+		std::unique_ptr<const char *const, pathv_deleter> pathv;
+	};
+
+	static void make_spawn_plan(const process_startup &startup, const argv_block *argv_override,
+	                            spawn_plan &plan)
+	{
+		// The environment is built BEFORE spawning to avoid heap allocation in
+		// the child process, where the allocator may be in an inconsistent
+		// state if the parent is multi-threaded.  Builders hand us a cached
+		// block; direct callers get one built here.
+		plan.env_block = startup._env_block;
+		if (!plan.env_block)
+			plan.env_block = make_environment_block(startup);
+		// nullptr block: the child inherits the parent's full environment.
+		plan.envp = plan.env_block ? const_cast<char **>(plan.env_block->envp.data()) : environ;
+
+		// command-line arguments, pointing into startup._cmdline or the
+		// caller's prebuilt block.  Allocate one extra slot for
+		// execve_without_shebang's argv expansion (inserts /bin/sh at
+		// argv[0] and shifts the rest right by one).
+		const size_t asize = argv_override ? argv_override->size() : startup._cmdline.size();
+		plan.argv.assign(asize + 2, nullptr);
+		for (std::size_t i = 0; i < asize; ++i) {
+			plan.argv[i] = argv_override ? (*argv_override)[i] : startup._cmdline[i].c_str();
+		}
+
+		// Resolve the command against PATH here, so the child performs a
+		// single execve().  When that is not possible, split PATH here
+		// rather than in the child, which may not allocate.  Prepared specs
+		// have done this already.
+		plan.resolved = startup._executable;
+		const char *file = plan.argv[0];
+		if (plan.resolved.empty() && *file != '\0' && strchr(file, '/') == nullptr) {
+			if (resolve_in_path(file, plan.resolved)) {
+				if (plan.resolved.empty()) {
+					mpp::throw_ex<mpp::runtime_error>("child exec failed: " + std::string(strerror(ENOENT)));
 				}
-				for (const auto &e : startup._env)
-					merged[e.first] = e.second;
-				env_strings.reserve(merged.size());
-				for (const auto &e : merged)
-					env_strings.push_back(e.first + "=" + e.second);
 			}
 			else {
-				// inherit_env=false: only _env (empty env block if _env is also empty).
-				env_strings.reserve(startup._env.size());
-				for (const auto &e : startup._env)
-					env_strings.push_back(e.first + "=" + e.second);
+				plan.pathv.reset(effective_pathv());
 			}
-			envp_vec.reserve(env_strings.size() + 1);
-			for (auto &s : env_strings)
-				envp_vec.push_back(const_cast<char *>(s.c_str()));
-			envp_vec.push_back(nullptr);
-			prebuilt_envp_ptr = envp_vec.data();
 		}
+	}
 
+	/**
+	 * Create the child described by @p plan without waiting for its exec.
+	 * Returns its pid; the exec result arrives on @p fail_read, which
+	 * confirm_child() consumes.
+	 */
+	static pid_t launch_child(const process_startup &startup, const spawn_plan &plan,
+	                          fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                          fd_type &fail_read)
+	{
 		// the child_proc will use this pipe to
 		// tell parent whether the process has started.
 		fd_type pfail[2] = {FD_INVALID, FD_INVALID};
@@ -490,93 +901,1076 @@ namespace mpp_impl {
 			mpp::throw_ex<mpp::runtime_error>("unable to create communication pipe");
 		}
 
-		pid_t pid = fork();
+		// A private argv table per child: execve_without_shebang rewrites it
+		// in place, and with the vfork-style backend the child shares our
+		// memory.  The strings themselves stay shared.
+		std::vector<const char *> argv(plan.argv);
+
+		spawn_context ctx;
+		ctx.startup = &startup;
+		std::copy(pstdin, pstdin + 2, ctx.stdin_fds);
+		std::copy(pstdout, pstdout + 2, ctx.stdout_fds);
+		std::copy(pstderr, pstderr + 2, ctx.stderr_fds);
+		std::copy(pfail, pfail + 2, ctx.fail_fds);
+		ctx.file = plan.resolved.empty() ? argv[0] : plan.resolved.c_str();
+		ctx.argv = argv.data();
+		ctx.envp = plan.envp;
+		ctx.pathv = plan.pathv.get();
+
+		pid_t pid = spawn_child(ctx);
 
 		if (pid < 0) {
 			close_pipe(pfail);
 			mpp::throw_ex<mpp::runtime_error>("unable to fork subprocess");
-
 		}
-		else if (pid == 0) {
-			// in child process, pfail will be closed in child_proc
-			child_proc(startup, info, pstdin, pstdout, pstderr, pfail, prebuilt_envp_ptr);
 
-			// child never returns
+		// Best-effort reinforcement of child's process-group leader role.
+		setpgid(pid, pid);
 
+		close_fd(pfail[PIPE_WRITE]);
+		fail_read = pfail[PIPE_READ];
+		return pid;
+	}
+
+	/**
+	 * Close the parent's copies of the child-side stdio ends of a running
+	 * child and hand the parent-side ends over to @p info.
+	 */
+	static void adopt_child(const process_startup &startup, pid_t pid,
+	                        fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                        process_info &info)
+	{
+		if (!startup._inherit_stdin && !startup._stdin.redirected()) {
+			close_fd(pstdin[PIPE_READ]);
+		}
+		if (!startup._inherit_stdout && !startup._stdout.redirected()) {
+			close_fd(pstdout[PIPE_WRITE]);
+		}
+
+		/*
+		 * pay special attention to stderr,
+		 * there are 3 cases:
+		 *      1. merge stderr to stdout
+		 *      2. inherit stderr from parent
+		 *      3. redirect stderr to a file
+		 */
+		if (startup._merge_outputs || startup._inherit_stderr) {
+			// nothing to close on parent side
 		}
 		else {
-			// in parent process
+			// stderr is either redirected or piped
+			if (!startup._stderr.redirected()) {
+				close_fd(pstderr[PIPE_WRITE]);
+			}
+		}
 
-			// Best-effort reinforcement of child's process-group leader role.
-			setpgid(pid, pid);
+		info._pid = pid;
+		// Record the child's start time for identity verification
+		// (PID-reuse detection in process_exited / kill_tree).  A pidfd
+		// already pins the identity.
+		if (info._pidfd == FD_INVALID)
+			info._start_time = get_process_start_time(pid);
+		// Only store pipe fds that we own.  Redirect targets and inherited
+		// streams are owned by the caller (file_t / OS), so we must not
+		// close them in close_process().
+		info._stdin  = (startup._inherit_stdin  || startup._stdin.redirected())
+		               ? FD_INVALID : pstdin[PIPE_WRITE];
+		info._stdout = (startup._inherit_stdout || startup._stdout.redirected())
+		               ? FD_INVALID : pstdout[PIPE_READ];
+		info._stderr = (startup._merge_outputs || startup._inherit_stderr
+		                || startup._stderr.redirected())
+		               ? FD_INVALID : pstderr[PIPE_READ];
+
+		// on *nix systems, fork() doesn't create threads to run process
+		info._tid = FD_INVALID;
+	}
+
+	/**
+	 * Collect the exec result of a child started by launch_child() and, on
+	 * success, hand its pipe ends over to @p info.  Throws after reaping
+	 * the child when exec failed.
+	 */
+	static void confirm_child(const process_startup &startup, pid_t pid, fd_type fail_read,
+	                          fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                          process_info &info)
+	{
+		// receive exec call result form child
+		int child_errno = 0;
+
+		switch (read_fully(fail_read, &child_errno, sizeof(child_errno))) {
+		case 0:
+			// child exec succeeded.
+			break;
+		case sizeof(child_errno):
+			// child failed to exec, we will wait it.
+			waitpid(pid, nullptr, 0);
+			close_fd(fail_read);
+			mpp::throw_ex<mpp::runtime_error>("child exec failed: " + std::string(strerror(child_errno)));
+			break;
+		default:
+			// Partial or zero-length read: child died before writing
+			// the full errno.  Reap it to avoid a zombie.
+			waitpid(pid, nullptr, 0);
+			close_fd(fail_read);
+			mpp::throw_ex<mpp::runtime_error>("read failed: " + std::string(strerror(errno)));
+			break;
+		}
+
+		close_fd(fail_read);
+#if defined(__linux__) && defined(SYS_pidfd_open)
+		// The child is ours and not yet reaped, so the pid cannot have been
+		// recycled: the pidfd is guaranteed to refer to it.
+		const long pidfd = syscall(SYS_pidfd_open, pid, 0);
+		if (pidfd >= 0)
+			info._pidfd = static_cast<fd_type>(pidfd);
+#endif
+		adopt_child(startup, pid, pstdin, pstdout, pstderr, info);
+	}
+
+	/*
+	 * Fork server.
+	 *
+	 * Request (host -> server), one per spawn, over a SOCK_STREAM socketpair:
+	 *   uint32_t size                          bytes that follow
+	 *   uint32_t flags, argc, envc, pathc
+	 *   NUL-terminated strings: file, cwd, argv[argc], envp[envc], pathv[pathc]
+	 * SCM_RIGHTS on the first byte carries {status, stdin, stdout[, stderr]},
+	 * the child-side descriptors.  The server answers with a spawn_reply and,
+	 * once it has reaped the child, writes its exit code (int32_t, same
+	 * encoding as wait_for()) to `status` and closes it.
+	 */
+	namespace fork_server {
+		enum : uint32_t {
+			flag_merge_outputs = 1
+		};
+
+		struct spawn_reply {
+			int32_t pid;
+			// 0 when the child is running, otherwise the errno of the failed
+			// exec (or of the failed fork, with pid == -1).
+			int32_t error;
+		};
+
+		constexpr int max_fds = 4;
+		constexpr size_t header_words = 5;
+
+		std::mutex lock;
+		// Host side of the socket, -1 when the server is not running.
+		int sock = -1;
+
+#ifdef MSG_NOSIGNAL
+		constexpr int send_flags = MSG_NOSIGNAL;
+#else
+		constexpr int send_flags = 0; // SO_NOSIGPIPE is set on the socket
+#endif
 
-			// receive exec call result form child
+		static bool send_all(int fd, const char *buf, size_t size)
+		{
+			while (size > 0) {
+				ssize_t n = send(fd, buf, size, send_flags);
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				buf += n;
+				size -= n;
+			}
+			return true;
+		}
+
+		// ---- server side -------------------------------------------------
+
+		static int sigchld_pipe[2] = {-1, -1};
+
+		static void on_sigchld(int)
+		{
+			const int saved_errno = errno;
+			const char c = 0;
+			if (write(sigchld_pipe[PIPE_WRITE], &c, 1) < 0) {
+				// pipe full: a wakeup is already pending
+			}
+			errno = saved_errno;
+		}
+
+		// Writes to a status pipe whose reader is gone must fail with EPIPE
+		// rather than kill the server.  A handler (unlike SIG_IGN) is not
+		// inherited across exec.
+		static void on_sigpipe(int) {}
+
+		static void reap_children(std::unordered_map<pid_t, int> &children)
+		{
+			int status = 0;
+			pid_t pid;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				int32_t code;
+				if (WIFEXITED(status))
+					code = WEXITSTATUS(status);
+				else if (WIFSIGNALED(status))
+					code = 0x80 + WTERMSIG(status);
+				else
+					continue;
+				auto it = children.find(pid);
+				if (it == children.end())
+					continue;
+				ssize_t n;
+				do {
+					n = write(it->second, &code, sizeof(code));
+				}
+				while (n == -1 && errno == EINTR);
+				close(it->second);
+				children.erase(it);
+			}
+		}
+
+		/**
+		 * Read one request.  Returns false on EOF or a broken stream; any
+		 * descriptors received are stored in @p fds either way.
+		 */
+		static bool receive_request(int fd, std::vector<char> &body, int *fds, int &nfds)
+		{
+			uint32_t size = 0;
+			union {
+				char buf[CMSG_SPACE(sizeof(int) * max_fds)];
+				struct cmsghdr align;
+			} control;
+			struct iovec iov = {&size, sizeof(size)};
+			struct msghdr msg {};
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control.buf;
+			msg.msg_controllen = sizeof(control.buf);
+
+			ssize_t n;
+			do {
+				n = recvmsg(fd, &msg, 0);
+			}
+			while (n == -1 && errno == EINTR);
+			nfds = 0;
+			if (n <= 0)
+				return false;
+			for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+				if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+					continue;
+				const int count = static_cast<int>((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+				for (int i = 0; i < count; ++i) {
+					int received;
+					memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+					if (nfds < max_fds)
+						fds[nfds++] = received;
+					else
+						close(received);
+				}
+			}
+			if (n < static_cast<ssize_t>(sizeof(size))) {
+				const size_t rest = sizeof(size) - n;
+				if (read_fully(fd, reinterpret_cast<char *>(&size) + n, rest) != static_cast<ssize_t>(rest))
+					return false;
+			}
+			body.resize(size);
+			return read_fully(fd, body.data(), size) == static_cast<ssize_t>(size);
+		}
+
+		struct request {
+			uint32_t flags = 0;
+			const char *file = nullptr;
+			const char *cwd = nullptr;
+			std::vector<const char *> argv;
+			std::vector<char *> envp;
+			std::vector<const char *> pathv;
+		};
+
+		static bool parse_request(std::vector<char> &body, request &req)
+		{
+			if (body.size() < (header_words - 1) * sizeof(uint32_t))
+				return false;
+			uint32_t header[header_words - 1];
+			memcpy(header, body.data(), sizeof(header));
+			req.flags = header[0];
+			char *p = body.data() + sizeof(header);
+			char *const end = body.data() + body.size();
+			auto next = [&p, end]() -> char * {
+				char *nul = static_cast<char *>(memchr(p, '\0', end - p));
+				if (nul == nullptr)
+					return nullptr;
+				char *str = p;
+				p = nul + 1;
+				return str;
+			};
+			if ((req.file = next()) == nullptr || (req.cwd = next()) == nullptr)
+				return false;
+			for (uint32_t i = 0; i < header[1]; ++i) {
+				const char *a = next();
+				if (a == nullptr) return false;
+				req.argv.push_back(a);
+			}
+			if (req.argv.empty())
+				return false;
+			// spare slot for execve_without_shebang, then the terminator
+			req.argv.resize(req.argv.size() + 2, nullptr);
+			for (uint32_t i = 0; i < header[2]; ++i) {
+				char *e = next();
+				if (e == nullptr) return false;
+				req.envp.push_back(e);
+			}
+			req.envp.push_back(nullptr);
+			for (uint32_t i = 0; i < header[3]; ++i) {
+				const char *d = next();
+				if (d == nullptr) return false;
+				req.pathv.push_back(d);
+			}
+			if (!req.pathv.empty())
+				req.pathv.push_back(nullptr);
+			return true;
+		}
+
+		static spawn_reply serve_request(std::vector<char> &body, int *fds, int nfds,
+		                                 std::unordered_map<pid_t, int> &children)
+		{
+			spawn_reply reply = {-1, EINVAL};
+			request req;
+			if (!parse_request(body, req))
+				return reply;
+			const bool merge = (req.flags & flag_merge_outputs) != 0;
+			if (nfds != (merge ? 3 : 4))
+				return reply;
+
+			// The child's stdio arrives as plain descriptors: treat every
+			// stream as redirected to the one we were sent.
+			process_startup startup;
+			startup._cwd = req.cwd;
+			startup._merge_outputs = merge;
+			startup._stdin._target = fds[1];
+			startup._stdout._target = fds[2];
+			if (!merge)
+				startup._stderr._target = fds[3];
+
+			fd_type pfail[2] = {FD_INVALID, FD_INVALID};
+#ifdef __linux__
+			if (pipe2(pfail, O_CLOEXEC) != 0) {
+#else
+			if (!create_pipe(pfail)) {
+#endif
+				reply.error = errno;
+				return reply;
+			}
+
+			spawn_context ctx;
+			ctx.startup = &startup;
+			ctx.stdin_fds[PIPE_READ] = ctx.stdin_fds[PIPE_WRITE] = fds[1];
+			ctx.stdout_fds[PIPE_READ] = ctx.stdout_fds[PIPE_WRITE] = fds[2];
+			if (!merge)
+				ctx.stderr_fds[PIPE_READ] = ctx.stderr_fds[PIPE_WRITE] = fds[3];
+			std::copy(pfail, pfail + 2, ctx.fail_fds);
+			ctx.file = req.file;
+			ctx.argv = req.argv.data();
+			ctx.envp = req.envp.data();
+			ctx.pathv = req.pathv.empty() ? nullptr : req.pathv.data();
+
+			const pid_t pid = spawn_child(ctx);
+			if (pid < 0) {
+				reply.error = errno;
+				close_pipe(pfail);
+				return reply;
+			}
+			setpgid(pid, pid);
 			close_fd(pfail[PIPE_WRITE]);
 			int child_errno = 0;
-
-			switch (read_fully(pfail[PIPE_READ], &child_errno, sizeof(child_errno))) {
-			case 0:
-				// child exec succeeded.
-				break;
-			case sizeof(child_errno):
-				// child failed to exec, we will wait it.
-				waitpid(pid, nullptr, 0);
-				close_fd(pfail[PIPE_READ]);
-				mpp::throw_ex<mpp::runtime_error>("child exec failed: " + std::string(strerror(child_errno)));
-				break;
-			default:
-				// Partial or zero-length read: child died before writing
-				// the full errno.  Reap it to avoid a zombie.
+			const ssize_t n = read_fully(pfail[PIPE_READ], &child_errno, sizeof(child_errno));
+			close_fd(pfail[PIPE_READ]);
+			reply.pid = pid;
+			if (n == 0) {
+				reply.error = 0;
+				children.emplace(pid, fds[0]);
+				fds[0] = -1;
+			}
+			else {
+				reply.error = n == sizeof(child_errno) ? child_errno : EIO;
 				waitpid(pid, nullptr, 0);
-				close_fd(pfail[PIPE_READ]);
-				mpp::throw_ex<mpp::runtime_error>("read failed: " + std::string(strerror(errno)));
-				break;
 			}
+			return reply;
+		}
 
-			close_fd(pfail[PIPE_READ]);
+		__attribute__((noreturn))
+		static void serve(int fd)
+		{
+			// Stay out of the host's process group (terminal signals) and
+			// drop every handler and descriptor inherited from it.
+			setpgid(0, 0);
+			struct sigaction sa {};
+			for (int sig = 1; sig < NSIG; ++sig) {
+				if (sig == SIGKILL || sig == SIGSTOP) continue;
+				if (sigaction(sig, nullptr, &sa) != 0) continue;
+				if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL) continue;
+				sa.sa_handler = SIG_DFL;
+				sa.sa_flags = 0;
+				sigemptyset(&sa.sa_mask);
+				sigaction(sig, &sa, nullptr);
+			}
+			sigset_t none;
+			sigemptyset(&none);
+			sigprocmask(SIG_SETMASK, &none, nullptr);
+
+			close_all_descriptors(STDERR_FILENO + 1, fd);
+			const int devnull = open("/dev/null", O_RDWR);
+			if (devnull >= 0) {
+				dup2(devnull, STDIN_FILENO);
+				dup2(devnull, STDOUT_FILENO);
+				dup2(devnull, STDERR_FILENO);
+				if (devnull > STDERR_FILENO)
+					close(devnull);
+			}
+
+			if (pipe(sigchld_pipe) != 0)
+				_exit(1);
+			for (int end : sigchld_pipe) {
+				fcntl(end, F_SETFD, FD_CLOEXEC);
+				fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+			}
+			sa.sa_handler = on_sigchld;
+			sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGCHLD, &sa, nullptr);
+			sa.sa_handler = on_sigpipe;
+			sa.sa_flags = SA_RESTART;
+			sigaction(SIGPIPE, &sa, nullptr);
+
+			std::unordered_map<pid_t, int> children;
+			std::vector<char> body;
+			bool host_alive = true;
+			// After the host goes away keep reaping until our children are
+			// gone, so nothing is left unreaped under init.
+			while (host_alive || !children.empty()) {
+				struct pollfd pfds[2] = {
+					{sigchld_pipe[PIPE_READ], POLLIN, 0},
+					{fd, POLLIN, 0}
+				};
+				if (poll(pfds, host_alive ? 2 : 1, -1) < 0) {
+					if (errno == EINTR) continue;
+					_exit(1);
+				}
+				if (pfds[0].revents != 0) {
+					char drain[64];
+					while (read(sigchld_pipe[PIPE_READ], drain, sizeof(drain)) > 0) {}
+					reap_children(children);
+				}
+				if (host_alive && pfds[1].revents != 0) {
+					int fds[max_fds];
+					int nfds = 0;
+					const bool ok = receive_request(fd, body, fds, nfds);
+					spawn_reply reply = {-1, EINVAL};
+					if (ok)
+						reply = serve_request(body, fds, nfds, children);
+					for (int i = 0; i < nfds; ++i) {
+						if (fds[i] != -1)
+							close(fds[i]);
+					}
+					if (!ok || !send_all(fd, reinterpret_cast<const char *>(&reply), sizeof(reply))) {
+						close(fd);
+						host_alive = false;
+					}
+				}
+			}
+			_exit(0);
+		}
+
+		// ---- host side ---------------------------------------------------
 
-			if (!startup._inherit_stdin && !startup._stdin.redirected()) {
-				close_fd(pstdin[PIPE_READ]);
+		static void stop_locked()
+		{
+			if (sock != -1) {
+				// The server sees EOF and exits once its children are reaped.
+				close(sock);
+				sock = -1;
 			}
-			if (!startup._inherit_stdout && !startup._stdout.redirected()) {
-				close_fd(pstdout[PIPE_WRITE]);
+		}
+
+		static bool send_request(const std::vector<char> &msg, const int *fds, int nfds)
+		{
+			union {
+				char buf[CMSG_SPACE(sizeof(int) * max_fds)];
+				struct cmsghdr align;
+			} control;
+			memset(control.buf, 0, sizeof(control.buf));
+			struct iovec iov = {const_cast<char *>(msg.data()), msg.size()};
+			struct msghdr hdr {};
+			hdr.msg_iov = &iov;
+			hdr.msg_iovlen = 1;
+			hdr.msg_control = control.buf;
+			hdr.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+			struct cmsghdr *c = CMSG_FIRSTHDR(&hdr);
+			c->cmsg_level = SOL_SOCKET;
+			c->cmsg_type = SCM_RIGHTS;
+			c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+			memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+
+			ssize_t n;
+			do {
+				n = sendmsg(sock, &hdr, send_flags);
 			}
+			while (n == -1 && errno == EINTR);
+			if (n < 0)
+				return false;
+			return send_all(sock, msg.data() + n, msg.size() - n);
+		}
 
-			/*
-			 * pay special attention to stderr,
-			 * there are 3 cases:
-			 *      1. merge stderr to stdout
-			 *      2. inherit stderr from parent
-			 *      3. redirect stderr to a file
-			 */
-			if (startup._merge_outputs || startup._inherit_stderr) {
-				// nothing to close on parent side
+		/**
+		 * Spawn through the server.  Returns false, with nothing changed,
+		 * when no server is running (or it just died); throws like
+		 * create_process_impl() when the child could not be started.
+		 */
+		static bool spawn(const process_startup &startup, const spawn_plan &plan,
+		                  fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+		                  process_info &info)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (sock == -1)
+					return false;
 			}
-			else {
-				// stderr is either redirected or piped
-				if (!startup._stderr.redirected()) {
-					close_fd(pstderr[PIPE_WRITE]);
+
+			std::vector<char> msg(header_words * sizeof(uint32_t));
+			auto append = [&msg](const char *str) {
+				msg.insert(msg.end(), str, str + strlen(str) + 1);
+			};
+			append(plan.resolved.empty() ? plan.argv[0] : plan.resolved.c_str());
+			append(startup._cwd.c_str());
+			uint32_t argc = 0;
+			for (; plan.argv[argc] != nullptr; ++argc)
+				append(plan.argv[argc]);
+			// Always send the environment: the server's own is a snapshot
+			// from when it was started.
+			uint32_t envc = 0;
+			for (char **ep = plan.envp; ep && *ep; ++ep, ++envc)
+				append(*ep);
+			uint32_t pathc = 0;
+			for (const char *const *dp = plan.pathv.get(); dp && *dp; ++dp, ++pathc)
+				append(*dp);
+			const uint32_t header[header_words] = {
+				static_cast<uint32_t>(msg.size() - sizeof(uint32_t)),
+				startup._merge_outputs ? flag_merge_outputs : 0u,
+				argc, envc, pathc
+			};
+			memcpy(msg.data(), header, sizeof(header));
+
+			fd_type status[2] = {FD_INVALID, FD_INVALID};
+#ifdef __linux__
+			if (pipe2(status, O_CLOEXEC) != 0) {
+#else
+			if (!create_pipe(status)) {
+#endif
+				mpp::throw_ex<mpp::runtime_error>("unable to create communication pipe");
+			}
+			int fds[max_fds];
+			int nfds = 0;
+			fds[nfds++] = status[PIPE_WRITE];
+			fds[nfds++] = startup._inherit_stdin ? STDIN_FILENO : pstdin[PIPE_READ];
+			fds[nfds++] = startup._inherit_stdout ? STDOUT_FILENO : pstdout[PIPE_WRITE];
+			if (!startup._merge_outputs)
+				fds[nfds++] = startup._inherit_stderr ? STDERR_FILENO : pstderr[PIPE_WRITE];
+
+			spawn_reply reply {};
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (sock == -1 || !send_request(msg, fds, nfds)
+				        || read_fully(sock, &reply, sizeof(reply)) != sizeof(reply)) {
+					stop_locked();
+					close_pipe(status);
+					MOZART_LOGEV("fork server is gone, spawning locally");
+					return false;
 				}
 			}
+			close_fd(status[PIPE_WRITE]);
+			if (reply.error != 0) {
+				close_fd(status[PIPE_READ]);
+				if (reply.pid < 0)
+					mpp::throw_ex<mpp::runtime_error>("unable to fork subprocess");
+				mpp::throw_ex<mpp::runtime_error>("child exec failed: " + std::string(strerror(reply.error)));
+			}
+			adopt_child(startup, reply.pid, pstdin, pstdout, pstderr, info);
+			info._status_fd = status[PIPE_READ];
+			return true;
+		}
+	}
 
-			info._pid = pid;
-			// Record the child's start time for identity verification
-			// (PID-reuse detection in process_exited / kill_tree).
-			info._start_time = get_process_start_time(pid);
-			// Only store pipe fds that we own.  Redirect targets and inherited
-			// streams are owned by the caller (file_t / OS), so we must not
-			// close them in close_process().
-			info._stdin  = (startup._inherit_stdin  || startup._stdin.redirected())
-			               ? FD_INVALID : pstdin[PIPE_WRITE];
-			info._stdout = (startup._inherit_stdout || startup._stdout.redirected())
-			               ? FD_INVALID : pstdout[PIPE_READ];
-			info._stderr = (startup._merge_outputs || startup._inherit_stderr
-			                || startup._stderr.redirected())
-			               ? FD_INVALID : pstderr[PIPE_READ];
+	bool fork_server_start()
+	{
+		std::lock_guard<std::mutex> guard(fork_server::lock);
+		if (fork_server::sock != -1)
+			return true;
+
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+			return false;
+		fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+		const int one = 1;
+		setsockopt(sv[0], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+		// Double fork: the server is not our child, so it never shows up
+		// in our own waitpid() calls and needs no reaping on stop.
+		const pid_t pid = fork();
+		if (pid == 0) {
+			close(sv[0]);
+			if (fork() == 0)
+				fork_server::serve(sv[1]);
+			_exit(0);
+		}
+		close(sv[1]);
+		if (pid < 0) {
+			close(sv[0]);
+			return false;
+		}
+		while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR) {}
+		fork_server::sock = sv[0];
+		return true;
+	}
+
+	void fork_server_stop()
+	{
+		std::lock_guard<std::mutex> guard(fork_server::lock);
+		fork_server::stop_locked();
+	}
+
+	bool fork_server_running()
+	{
+		std::lock_guard<std::mutex> guard(fork_server::lock);
+		return fork_server::sock != -1;
+	}
+
+	void create_process_impl(const process_startup &startup, process_info &info,
+	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                         const argv_block *argv)
+	{
+		spawn_plan plan;
+		make_spawn_plan(startup, argv, plan);
+		if (startup._backend == spawn_backend::automatic
+		        && fork_server::spawn(startup, plan, pstdin, pstdout, pstderr, info)) {
+			return;
+		}
+		fd_type fail_read = FD_INVALID;
+		pid_t pid = launch_child(startup, plan, pstdin, pstdout, pstderr, fail_read);
+		confirm_child(startup, pid, fail_read, pstdin, pstdout, pstderr, info);
+	}
+
+	void create_processes(const process_startup &startup, size_t count,
+	                      std::vector<process_info> &infos,
+	                      std::vector<std::string> &errors,
+	                      const argv_block *argv)
+	{
+		infos.assign(count, process_info{});
+		errors.assign(count, std::string());
+
+		if (startup._capture_mapped) {
+			// Every child needs capture files of its own.
+			for (size_t i = 0; i < count; ++i) {
+				try {
+					create_process(startup, infos[i], argv);
+				}
+				catch (const std::exception &e) {
+					errors[i] = e.what();
+				}
+			}
+			return;
+		}
+
+		spawn_plan plan;
+		try {
+			make_spawn_plan(startup, argv, plan);
+		}
+		catch (const std::exception &e) {
+			errors.assign(count, e.what());
+			return;
+		}
+
+		struct pending_child {
+			pid_t pid = -1;
+			fd_type fail_read = FD_INVALID;
+			fd_type in[2] = {FD_INVALID, FD_INVALID};
+			fd_type out[2] = {FD_INVALID, FD_INVALID};
+			fd_type err[2] = {FD_INVALID, FD_INVALID};
+		};
+		std::vector<pending_child> children(count);
+		const bool use_server = startup._backend == spawn_backend::automatic;
+
+		// Create every child first and collect the exec results after.
+		// Only a fork() child execs while we go on spawning: the vfork
+		// clone returns once its child has exec'd.
+		for (size_t i = 0; i < count; ++i) {
+			pending_child &c = children[i];
+			try {
+				open_stdio(startup, c.in, c.out, c.err);
+			}
+			catch (const std::exception &e) {
+				errors[i] = e.what();
+				continue;
+			}
+			try {
+				// The fork server confirms each exec before it replies.
+				if (!use_server || !fork_server::spawn(startup, plan, c.in, c.out, c.err, infos[i]))
+					c.pid = launch_child(startup, plan, c.in, c.out, c.err, c.fail_read);
+			}
+			catch (const std::exception &e) {
+				close_stdio(startup, c.in, c.out, c.err);
+				errors[i] = e.what();
+			}
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			pending_child &c = children[i];
+			if (c.pid < 0)
+				continue;
+			try {
+				confirm_child(startup, c.pid, c.fail_read, c.in, c.out, c.err, infos[i]);
+			}
+			catch (const std::exception &e) {
+				close_stdio(startup, c.in, c.out, c.err);
+				errors[i] = e.what();
+			}
+		}
+	}
+
+	bool create_chain_pipe(fd_type fds[2])
+	{
+#if defined(__linux__)
+		return pipe2(fds, O_CLOEXEC) == 0;
+#else
+		if (pipe(fds) != 0)
+			return false;
+		fcntl(fds[PIPE_READ], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[PIPE_WRITE], F_SETFD, FD_CLOEXEC);
+		return true;
+#endif
+	}
+
+	void ignore_sigpipe()
+	{
+		static std::once_flag once;
+		std::call_once(once, [] {
+			struct sigaction sa {};
+			if (sigaction(SIGPIPE, nullptr, &sa) != 0)
+				return;
+			if ((sa.sa_flags & SA_SIGINFO) || sa.sa_handler != SIG_DFL)
+				return; // the host chose a disposition: keep it
+			sa.sa_handler = SIG_IGN;
+			sa.sa_flags = 0;
+			sigemptyset(&sa.sa_mask);
+			// Children must see the flag before they can inherit SIG_IGN.
+			sigpipe_ignored.store(true, std::memory_order_relaxed);
+			sigaction(SIGPIPE, &sa, nullptr);
+		});
+	}
+
+#ifdef __linux__
+	// First line of a small text file, without its newline; "" if unreadable.
+	static std::string read_first_line(const std::string &path)
+	{
+		FILE *f = fopen(path.c_str(), "re");
+		if (f == nullptr)
+			return std::string();
+		char buf[256];
+		std::string line;
+		if (fgets(buf, sizeof(buf), f) != nullptr)
+			line = buf;
+		fclose(f);
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+			line.pop_back();
+		return line;
+	}
+
+	/**
+	 * CPUs granted by the CFS quota of this process's cgroup or any of its
+	 * ancestors (the tightest wins), or 0 for no quota.
+	 */
+	static unsigned cgroup_cpu_quota()
+	{
+		unsigned best = 0;
+		const auto consider = [&best](long long quota, long long period) {
+			if (quota <= 0 || period <= 0)
+				return;
+			const unsigned n = static_cast<unsigned>(std::max<long long>(1, (quota + period - 1) / period));
+			if (best == 0 || n < best)
+				best = n;
+		};
+		FILE *f = fopen("/proc/self/cgroup", "re");
+		if (f == nullptr)
+			return 0;
+		char buf[4096];
+		while (fgets(buf, sizeof(buf), f) != nullptr) {
+			// "hierarchy-id:controllers:path"
+			std::string entry(buf);
+			while (!entry.empty() && entry.back() == '\n')
+				entry.pop_back();
+			const size_t c1 = entry.find(':');
+			const size_t c2 = c1 == std::string::npos ? c1 : entry.find(':', c1 + 1);
+			if (c2 == std::string::npos)
+				continue;
+			const std::string controllers = entry.substr(c1 + 1, c2 - c1 - 1);
+			std::string path = entry.substr(c2 + 1);
+			const bool v2 = entry.compare(0, c1, "0") == 0 && controllers.empty();
+			std::string root;
+			if (v2)
+				root = "/sys/fs/cgroup";
+			else if (("," + controllers + ",").find(",cpu,") != std::string::npos)
+				root = access("/sys/fs/cgroup/cpu,cpuacct", F_OK) == 0 ? "/sys/fs/cgroup/cpu,cpuacct" : "/sys/fs/cgroup/cpu";
+			else
+				continue;
+			// Walk up to the root; a container sees its own cgroup as "/".
+			for (;;) {
+				const std::string dir = root + (path == "/" ? "" : path);
+				if (v2) {
+					// "max 100000" or "<quota> <period>"
+					const std::string line = read_first_line(dir + "/cpu.max");
+					long long quota = 0, period = 0;
+					if (line.compare(0, 3, "max") != 0 && sscanf(line.c_str(), "%lld %lld", &quota, &period) == 2)
+						consider(quota, period);
+				}
+				else {
+					consider(atoll(read_first_line(dir + "/cpu.cfs_quota_us").c_str()),
+					         atoll(read_first_line(dir + "/cpu.cfs_period_us").c_str()));
+				}
+				if (path.empty() || path == "/")
+					break;
+				const size_t slash = path.find_last_of('/');
+				path = slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+			}
+		}
+		fclose(f);
+		return best;
+	}
+#endif
+
+	unsigned available_cpus()
+	{
+		unsigned n = 0;
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+			n = static_cast<unsigned>(CPU_COUNT(&set));
+#endif
+		if (n == 0) {
+			const long online = sysconf(_SC_NPROCESSORS_ONLN);
+			n = online > 0 ? static_cast<unsigned>(online) : 1;
+		}
+#ifdef __linux__
+		const unsigned quota = cgroup_cpu_quota();
+		if (quota > 0 && quota < n)
+			n = quota;
+#endif
+		return n;
+	}
+
+	uint64_t pump_file(fd_type src, uint64_t offset, int64_t length,
+	                   fd_type dst, int deadline_ms)
+	{
+		using clock = std::chrono::steady_clock;
+		const bool has_deadline = deadline_ms >= 0;
+		const auto deadline = clock::now() + std::chrono::milliseconds(has_deadline ? deadline_ms : 0);
+
+		// Non-blocking for the duration, so a full pipe waits in poll(),
+		// where the deadline applies; in() expects a blocking fd again.
+		const int flags = fcntl(dst, F_GETFL);
+		if (flags < 0)
+			mpp::throw_ex<mpp::runtime_error>("pump: " + std::string(strerror(errno)));
+		if (!(flags & O_NONBLOCK))
+			fcntl(dst, F_SETFL, flags | O_NONBLOCK);
+		struct flags_guard {
+			int fd, flags;
+			~flags_guard()
+			{
+				if (!(flags & O_NONBLOCK))
+					fcntl(fd, F_SETFL, flags);
+			}
+		} guard{dst, flags};
 
-			// on *nix systems, fork() doesn't create threads to run process
-			info._tid = FD_INVALID;
+		constexpr size_t chunk = 64 * 1024;
+		std::unique_ptr<char[]> buf;   // pread() fallback only
+		size_t buf_pos = 0, buf_end = 0;
+#ifdef __linux__
+		bool use_splice = true;
+#endif
+		uint64_t moved = 0;
+		const auto remaining = [&]() -> size_t {
+			if (length < 0)
+				return chunk * 16;
+			return static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(length) - moved, chunk * 16));
+		};
+		while (length < 0 || moved < static_cast<uint64_t>(length)) {
+			ssize_t n;
+#ifdef __linux__
+			if (use_splice) {
+				loff_t off = static_cast<loff_t>(offset + moved);
+				n = splice(src, &off, dst, nullptr, remaining(), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+					use_splice = false;
+					continue;
+				}
+			}
+			else
+#endif
+			{
+				if (buf_pos == buf_end) {
+					if (!buf)
+						buf.reset(new char[chunk]);
+					const ssize_t r = pread(src, buf.get(), std::min(remaining(), chunk),
+					                        static_cast<off_t>(offset + moved));
+					if (r < 0) {
+						if (errno == EINTR)
+							continue;
+						mpp::throw_ex<mpp::runtime_error>("pump: read failed: " + std::string(strerror(errno)));
+					}
+					buf_pos = 0;
+					buf_end = static_cast<size_t>(r);
+				}
+				n = buf_end == 0 ? 0 : write(dst, buf.get() + buf_pos, buf_end - buf_pos);
+				if (n > 0)
+					buf_pos += static_cast<size_t>(n);
+			}
+			if (n > 0) {
+				moved += static_cast<uint64_t>(n);
+				if (has_deadline && clock::now() >= deadline)
+					break;
+				continue;
+			}
+			if (n == 0)
+				break; // EOF
+			if (errno == EINTR)
+				continue;
+			if (errno == EPIPE)
+				break; // the child stopped reading
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				mpp::throw_ex<mpp::runtime_error>("pump: " + std::string(strerror(errno)));
+			// The pipe is full: wait for the child to make room.
+			int timeout = -1;
+			if (has_deadline) {
+				const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now()).count();
+				if (left <= 0)
+					break;
+				timeout = static_cast<int>(std::min<long long>(left, INT_MAX));
+			}
+			struct pollfd pfd {};
+			pfd.fd = dst;
+			pfd.events = POLLOUT;
+			const int rc = poll(&pfd, 1, timeout);
+			if (rc == 0)
+				break;
+			if (rc < 0 && errno != EINTR)
+				mpp::throw_ex<mpp::runtime_error>("pump: poll failed: " + std::string(strerror(errno)));
+			// POLLERR means the reader is gone; the next write reports EPIPE.
 		}
+		return moved;
+	}
+
+	mpp::ssize_t read_nonblock(fd_type fd, char *buf, size_t n)
+	{
+		// Readable pipes never block a read, so the descriptor keeps the
+		// blocking mode that out() / err() rely on.
+		struct pollfd pfd {};
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		int rc;
+		while ((rc = poll(&pfd, 1, 0)) < 0 && errno == EINTR);
+		if (rc == 0)
+			return -1;
+		ssize_t r;
+		while ((r = ::read(fd, buf, n)) < 0 && errno == EINTR);
+		return r < 0 ? 0 : r;
+	}
+
+	mpp::ssize_t write_nonblock(fd_type fd, const char *buf, size_t n)
+	{
+		// POLLOUT only promises PIPE_BUF bytes of room, so the write itself
+		// must not block: O_NONBLOCK for the call, as in pump_file().
+		const int flags = fcntl(fd, F_GETFL);
+		if (flags < 0)
+			return -1;
+		if (!(flags & O_NONBLOCK))
+			fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		ssize_t r;
+		while ((r = ::write(fd, buf, n)) < 0 && errno == EINTR);
+		const int err = errno;
+		if (!(flags & O_NONBLOCK))
+			fcntl(fd, F_SETFL, flags);
+		if (r < 0)
+			return (err == EAGAIN || err == EWOULDBLOCK) ? 0 : -1;
+		return r;
+	}
+
+	bool wait_pipe(fd_type fd, bool for_write, int timeout_ms)
+	{
+		using clock = std::chrono::steady_clock;
+		const auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms < 0 ? 0 : timeout_ms);
+		struct pollfd pfd {};
+		pfd.fd = fd;
+		pfd.events = for_write ? POLLOUT : POLLIN;
+		for (;;) {
+			int wait = -1;
+			if (timeout_ms >= 0) {
+				const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now()).count();
+				wait = left > 0 ? static_cast<int>(std::min<long long>(left, INT_MAX)) : 0;
+			}
+			const int rc = poll(&pfd, 1, wait);
+			if (rc > 0)
+				return true; // POLLHUP / POLLERR: EOF or EPIPE is ready too
+			if (rc == 0)
+				return false;
+			if (errno != EINTR)
+				return true; // let the read / write report it
+		}
+	}
+
+	fd_type create_capture_file(const process_startup &startup)
+	{
+		const bool spill = startup._capture_memory_cap > 0
+		                   && startup._output_hint > startup._capture_memory_cap;
+		int fd = -1;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+		if (!spill)
+			fd = memfd_create("mpp-capture", MFD_CLOEXEC);
+#endif
+		std::string dir = startup._capture_dir;
+		if (dir.empty()) {
+			const char *tmp = getenv("TMPDIR");
+			dir = (tmp != nullptr && *tmp != '\0') ? tmp : "/tmp";
+		}
+#if defined(__linux__) && defined(O_TMPFILE)
+		if (fd < 0)
+			fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+		if (fd < 0) {
+			// No memfd / O_TMPFILE: a temporary file unlinked at once.
+			std::string path = dir + "/mpp-capture-XXXXXX";
+			fd = mkstemp(&path[0]);
+			if (fd >= 0) {
+				unlink(path.c_str());
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+			}
+		}
+		if (fd < 0)
+			mpp::throw_ex<mpp::runtime_error>("unable to create capture file: " + std::string(strerror(errno)));
+		return fd;
+	}
+
+	void map_capture(fd_type fd, const char *&data, size_t &size, fd_type &mapping)
+	{
+		data = nullptr;
+		size = 0;
+		mapping = FD_INVALID;
+		struct stat st {};
+		if (fstat(fd, &st) != 0)
+			mpp::throw_ex<mpp::runtime_error>("unable to stat capture file: " + std::string(strerror(errno)));
+		if (st.st_size <= 0)
+			return;
+		void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			mpp::throw_ex<mpp::runtime_error>("unable to map capture file: " + std::string(strerror(errno)));
+		data = static_cast<const char *>(p);
+		size = static_cast<size_t>(st.st_size);
+	}
+
+	void unmap_capture(const char *data, size_t size, fd_type)
+	{
+		munmap(const_cast<char *>(data), size);
 	}
 
 	void close_process(process_info &info)
@@ -584,6 +1978,10 @@ namespace mpp_impl {
 		mpp_impl::close_fd(info._stdin);
 		mpp_impl::close_fd(info._stdout);
 		mpp_impl::close_fd(info._stderr);
+		mpp_impl::close_fd(info._status_fd);
+		mpp_impl::close_fd(info._pidfd);
+		mpp_impl::close_fd(info._capture_out);
+		mpp_impl::close_fd(info._capture_err);
 	}
 
 }
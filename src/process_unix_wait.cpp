@@ -18,16 +18,24 @@
 
 #include <mozart++/process>
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <optional>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #ifdef MOZART_PLATFORM_DARWIN
 #include <sys/sysctl.h>
 #endif
@@ -117,8 +125,47 @@ namespace mpp_impl {
 		}
 	}
 
+	mpp::ssize_t read_fully(int fd, void *buf, size_t nbyte);
+
+	/**
+	 * Fork-server children are reaped by the server, which writes their exit
+	 * code to info._status_fd.  Waits up to @p timeout_ms (negative: no
+	 * limit) for it and caches it in info._remote_exit.  A server that died
+	 * before reporting yields -1, as wait_for() does on error.
+	 */
+	static bool remote_status(const process_info &info, int timeout_ms)
+	{
+		if (info._remote_exit.has_value())
+			return true;
+		struct pollfd pfd = {info._status_fd, POLLIN, 0};
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while (true) {
+			int wait_ms = timeout_ms;
+			if (timeout_ms > 0) {
+				const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+				                      deadline - std::chrono::steady_clock::now()).count();
+				wait_ms = static_cast<int>(std::max<int64_t>(0, left));
+			}
+			const int r = poll(&pfd, 1, wait_ms);
+			if (r > 0)
+				break;
+			if (r == 0 || errno != EINTR)
+				return false;
+		}
+		int32_t code = -1;
+		if (read_fully(info._status_fd, &code, sizeof(code)) != sizeof(code))
+			code = -1;
+		info._remote_exit = code;
+		return true;
+	}
+
 	int wait_for(const process_info &info)
 	{
+		if (info._status_fd != FD_INVALID) {
+			remote_status(info, -1);
+			return info._remote_exit.value_or(-1);
+		}
+
 		// Block until the child exits, instead of polling with sched_yield().
 		// We deliberately do NOT pass WNOWAIT here: this call also reaps the
 		// zombie process, which previously was never collected (close_process()
@@ -154,9 +201,50 @@ namespace mpp_impl {
 		}
 	}
 
+#if defined(__linux__) && defined(SYS_pidfd_send_signal)
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1U << 2)
+#endif
+
+	/**
+	 * Signal through info._pidfd.  Returns 0 on delivery, ESRCH when the
+	 * child has already been reaped, or the errno that makes the caller
+	 * fall back to kill() (no pidfd, or an older kernel without the
+	 * requested flag).
+	 */
+	static int pidfd_signal(const process_info &info, int sig, unsigned int flags)
+	{
+		if (info._pidfd == FD_INVALID)
+			return EBADF;
+		if (syscall(SYS_pidfd_send_signal, info._pidfd, sig, nullptr, flags) == 0)
+			return 0;
+		return errno;
+	}
+#else
+	static int pidfd_signal(const process_info &, int, unsigned int)
+	{
+		return ENOSYS;
+	}
+#define PIDFD_SIGNAL_PROCESS_GROUP 0U
+#endif
+
+	fd_type exit_notify_fd(const process_info &info)
+	{
+		return info._status_fd != FD_INVALID ? info._status_fd : info._pidfd;
+	}
+
 	void terminate_process(const process_info &info, bool force)
 	{
-		kill(info._pid, force ? SIGKILL : SIGTERM);
+		const int sig = force ? SIGKILL : SIGTERM;
+		// A pidfd cannot hit a recycled pid.
+		const int err = pidfd_signal(info, sig, 0);
+		if (err == 0 || err == ESRCH)
+			return;
+		// The server reaps its children at once, so an exited child's PID
+		// may already be recycled: never signal one known to be gone.
+		if (info._status_fd != FD_INVALID && remote_status(info, 0))
+			return;
+		kill(info._pid, sig);
 	}
 
 	void terminate_process_tree(const process_info &info, bool force)
@@ -167,6 +255,23 @@ namespace mpp_impl {
 			return;
 		const int sig = force ? SIGKILL : SIGTERM;
 
+		// With a pidfd the identity question does not arise.  Linux 6.9+
+		// signals the group through it directly; on older kernels a
+		// successful null signal proves the leader is not yet reaped, so
+		// its pid (our PGID) cannot have been recycled.
+		switch (pidfd_signal(info, sig, PIDFD_SIGNAL_PROCESS_GROUP)) {
+		case 0:
+		case ESRCH:
+			return;
+		case EBADF:
+		case ENOSYS:
+			break;
+		default:
+			if (pidfd_signal(info, 0, 0) == 0)
+				kill(-info._pid, sig);
+			return;
+		}
+
 		// If we have a recorded start time, verify that the PID still
 		// belongs to the same process before targeting its process group.
 		// A mismatch means the PID was recycled — only kill the root PID,
@@ -190,6 +295,13 @@ namespace mpp_impl {
 	bool wait_timeout_ms(const process_info &info, int timeout_ms, int &exit_code,
 	                     int poll_interval_ms)
 	{
+		if (info._status_fd != FD_INVALID) {
+			if (!remote_status(info, timeout_ms))
+				return false;
+			exit_code = info._remote_exit.value_or(-1);
+			return true;
+		}
+
 		// Negative timeout: wait indefinitely (blocking wait_for).
 		if (timeout_ms < 0) {
 			exit_code = wait_for(info);
@@ -243,6 +355,9 @@ namespace mpp_impl {
 
 	bool process_exited(const process_info &info)
 	{
+		if (info._status_fd != FD_INVALID)
+			return remote_status(info, 0);
+
 		auto status = poll_process_status(info._pid);
 
 		if (status.has_value()) {
@@ -21,8 +21,11 @@
 #include <Windows.h>
 #include <cstddef>
 #include <cstring>
+#include <algorithm>
 #include <limits>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 namespace mpp_impl {
 
@@ -53,9 +56,179 @@ namespace mpp_impl {
 		}
 	}
 
+	struct environment_block {
+		// Raw copy of the parent block (GetEnvironmentStrings) the merge
+		// started from, compared in environment_block_current().
+		std::vector<char> parent;
+		bool inherit = false;
+		// Sorted "key=value\0...\0" block passed to CreateProcess.
+		std::vector<char> block;
+	};
+
+	// Copy the calling process's environment block up to and including the
+	// terminating double NUL.
+	static std::vector<char> snapshot_parent_environment()
+	{
+		std::vector<char> raw;
+		LPCH parent_env = GetEnvironmentStrings();
+		if (parent_env == nullptr)
+			return raw;
+		LPCH p = parent_env;
+		while (*p)
+			p += std::strlen(p) + 1;
+		raw.assign(parent_env, p + 1);
+		FreeEnvironmentStrings(parent_env);
+		return raw;
+	}
+
+	environment_ptr make_environment_block(const process_startup &startup)
+	{
+		if (startup._inherit_env && startup._env.empty())
+			return nullptr;
+
+		auto env_block = std::make_shared<environment_block>();
+		env_block->inherit = startup._inherit_env;
+
+		// Build effective env map.
+		std::unordered_map<std::string, std::string> effective;
+		if (startup._inherit_env) {
+			// Merge: read parent env block, then apply _env overrides.
+			env_block->parent = snapshot_parent_environment();
+			if (!env_block->parent.empty()) {
+				for (const char *p = env_block->parent.data(); *p; ) {
+					std::string entry(p);
+					auto eq = entry.find('=');
+					if (eq != std::string::npos && eq > 0)
+						effective.emplace(entry.substr(0, eq), entry.substr(eq + 1));
+					else if (eq == 0) {
+						// Windows hidden variable: =X:=value (current dir per drive)
+						auto eq2 = entry.find('=', 1);
+						if (eq2 != std::string::npos && eq2 > 1)
+							effective.emplace(entry.substr(0, eq2), entry.substr(eq2 + 1));
+					}
+					p += static_cast<ptrdiff_t>(entry.size()) + 1;
+				}
+			}
+			for (const auto &e : startup._env)
+				effective[e.first] = e.second;
+		}
+		else {
+			// inherit_env=false: only _env (empty env block if _env is also empty).
+			effective = startup._env;
+		}
+
+		// Windows requires the environment block to be sorted
+		// alphabetically by variable name (case-insensitive).
+		// Use CompareStringA with LOCALE_INVARIANT so that sort
+		// order is independent of the thread locale.  Also filter
+		// out entries with empty keys — they would produce ambiguous
+		// "=value\0" entries indistinguishable from Windows hidden
+		// drive variables.
+		std::vector<std::pair<std::string, std::string>> sorted_env;
+		sorted_env.reserve(effective.size());
+		for (const auto &e : effective) {
+			if (!e.first.empty())
+				sorted_env.emplace_back(e);
+		}
+		std::sort(sorted_env.begin(), sorted_env.end(),
+		[](const auto &a, const auto &b) {
+			return CompareStringA(
+			           LOCALE_INVARIANT,
+			           NORM_IGNORECASE,
+			           a.first.c_str(), -1,
+			           b.first.c_str(), -1) == CSTR_LESS_THAN;
+		});
+
+		const size_t max_object_size = static_cast<size_t>(std::numeric_limits<std::ptrdiff_t>::max());
+		// Non-empty blocks need one extra trailing NUL; empty blocks are just "\0\0".
+		size_t env_size = sorted_env.empty() ? 2 : 1;
+		for (const auto &e : sorted_env) {
+			const size_t key_size = e.first.length();
+			const size_t value_size = e.second.length();
+			// need 2 more, which is the '=' and variable terminator '\0'
+			// Guard against overflow in both the per-entry addition and
+			// the accumulated total before performing any arithmetic.
+			if (key_size > max_object_size - value_size - 2 ||
+			        env_size > max_object_size - key_size - value_size - 2) {
+				mpp::throw_ex<mpp::runtime_error>("environment block is too large");
+			}
+			env_size += key_size + value_size + 2;
+		}
+
+		env_block->block.resize(env_size);
+		char *envs = env_block->block.data();
+		char *p = envs;
+
+		for (const auto &e : sorted_env) {
+			const size_t key_size = e.first.length();
+			const size_t value_size = e.second.length();
+			std::memcpy(p, e.first.data(), key_size);
+			p += key_size;
+			*p++ = '=';
+			std::memcpy(p, e.second.data(), value_size);
+			p += value_size;
+			*p++ = '\0'; // variable terminator
+		}
+		*p++ = '\0'; // block terminator
+		if (sorted_env.empty())
+			*p++ = '\0'; // empty block needs a second NUL
+
+		// ensure envs are copied correctly
+		if (p != envs + env_size) {
+			mpp::throw_ex<mpp::runtime_error>("unable to copy environment variables");
+		}
+		return env_block;
+	}
+
+	bool environment_block_current(const environment_block &env)
+	{
+		if (!env.inherit)
+			return true;
+		// A byte compare is far cheaper than re-parsing and re-sorting.
+		return snapshot_parent_environment() == env.parent;
+	}
+
+	// CreateProcess never copies the parent, so there is nothing for a fork
+	// server to save on Win32.
+	bool fork_server_start()
+	{
+		return false;
+	}
+
+	void fork_server_stop() {}
+
+	bool fork_server_running()
+	{
+		return false;
+	}
+
+	std::unordered_map<std::string, std::string> parent_environment()
+	{
+		std::unordered_map<std::string, std::string> env;
+		const std::vector<char> raw = snapshot_parent_environment();
+		if (raw.empty())
+			return env;
+		for (const char *p = raw.data(); *p; p += std::strlen(p) + 1) {
+			// Skip the leading '=' of hidden =X: drive variables.
+			const char *eq = std::strchr(p + 1, '=');
+			if (eq != nullptr)
+				env.emplace(std::string(p, eq - p), std::string(eq + 1));
+		}
+		return env;
+	}
+
+	bool resolve_executable(const std::string &, std::string &)
+	{
+		// CreateProcess performs its own search (application directory,
+		// system directories, then PATH), which a plain PATH walk here
+		// would not reproduce.
+		return false;
+	}
+
 	void create_process_impl(const process_startup &startup,
 	                         process_info &info,
-	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr)
+	                         fd_type *pstdin, fd_type *pstdout, fd_type *pstderr,
+	                         const argv_block *argv)
 	{
 		STARTUPINFO si;
 		PROCESS_INFORMATION pi;
@@ -205,7 +378,10 @@ namespace mpp_impl {
 		// matter on the shell(true)/shell_cmd() path and are the user's
 		// responsibility there.
 		std::stringstream ss;
-		for (const auto &s : startup._cmdline) {
+		const size_t argc = argv ? argv->size() : startup._cmdline.size();
+		for (size_t a = 0; a < argc; ++a) {
+			const std::string_view s = argv ? std::string_view((*argv)[a])
+			                           : std::string_view(startup._cmdline[a]);
 			const bool need_quote = s.empty()
 			                        || s.find_first_of(" \t\n\v\"") != std::string::npos;
 
@@ -245,102 +421,13 @@ namespace mpp_impl {
 
 		std::string command = ss.str();
 
-		char *envs = nullptr;
-		std::unique_ptr<char[]> envs_owner;
-
 		// CreateProcess with nullptr lpEnvironment inherits the parent's full env.
-		// An explicit block (even "\0") replaces it entirely.
-		if (!(startup._inherit_env && startup._env.empty())) {
-			// Build effective env map.
-			std::unordered_map<std::string, std::string> effective;
-			if (startup._inherit_env) {
-				// Merge: read parent env block, then apply _env overrides.
-				LPCH parent_env = GetEnvironmentStrings();
-				if (parent_env) {
-					for (LPCH p = parent_env; *p; ) {
-						std::string entry(p);
-						auto eq = entry.find('=');
-						if (eq != std::string::npos && eq > 0)
-							effective.emplace(entry.substr(0, eq), entry.substr(eq + 1));
-						else if (eq == 0) {
-							// Windows hidden variable: =X:=value (current dir per drive)
-							auto eq2 = entry.find('=', 1);
-							if (eq2 != std::string::npos && eq2 > 1)
-								effective.emplace(entry.substr(0, eq2), entry.substr(eq2 + 1));
-						}
-						p += static_cast<ptrdiff_t>(entry.size()) + 1;
-					}
-					FreeEnvironmentStrings(parent_env);
-				}
-				for (const auto &e : startup._env)
-					effective[e.first] = e.second;
-			}
-			else {
-				// inherit_env=false: only _env (empty env block if _env is also empty).
-				effective = startup._env;
-			}
-
-			// Windows requires the environment block to be sorted
-			// alphabetically by variable name (case-insensitive).
-			// Use CompareStringA with LOCALE_INVARIANT so that sort
-			// order is independent of the thread locale.  Also filter
-			// out entries with empty keys — they would produce ambiguous
-			// "=value\0" entries indistinguishable from Windows hidden
-			// drive variables.
-			std::vector<std::pair<std::string, std::string>> sorted_env;
-			sorted_env.reserve(effective.size());
-			for (const auto &e : effective) {
-				if (!e.first.empty())
-					sorted_env.emplace_back(e);
-			}
-			std::sort(sorted_env.begin(), sorted_env.end(),
-			[](const auto &a, const auto &b) {
-				return CompareStringA(
-				           LOCALE_INVARIANT,
-				           NORM_IGNORECASE,
-				           a.first.c_str(), -1,
-				           b.first.c_str(), -1) == CSTR_LESS_THAN;
-			});
-
-			const size_t max_object_size = static_cast<size_t>(std::numeric_limits<std::ptrdiff_t>::max());
-			// Non-empty blocks need one extra trailing NUL; empty blocks are just "\0\0".
-			size_t env_size = sorted_env.empty() ? 2 : 1;
-			for (const auto &e : sorted_env) {
-				const size_t key_size = e.first.length();
-				const size_t value_size = e.second.length();
-				// need 2 more, which is the '=' and variable terminator '\0'
-				// Guard against overflow in both the per-entry addition and
-				// the accumulated total before performing any arithmetic.
-				if (key_size > max_object_size - value_size - 2 ||
-				        env_size > max_object_size - key_size - value_size - 2) {
-					mpp::throw_ex<mpp::runtime_error>("environment block is too large");
-				}
-				env_size += key_size + value_size + 2;
-			}
-
-			envs_owner = std::make_unique<char[]>(env_size);
-			envs = envs_owner.get();
-			char *p = envs;
-
-			for (const auto &e : sorted_env) {
-				const size_t key_size = e.first.length();
-				const size_t value_size = e.second.length();
-				std::memcpy(p, e.first.data(), key_size);
-				p += key_size;
-				*p++ = '=';
-				std::memcpy(p, e.second.data(), value_size);
-				p += value_size;
-				*p++ = '\0'; // variable terminator
-			}
-			*p++ = '\0'; // block terminator
-			if (sorted_env.empty())
-				*p++ = '\0'; // empty block needs a second NUL
-
-			// ensure envs are copied correctly
-			if (p != envs + env_size) {
-				mpp::throw_ex<mpp::runtime_error>("unable to copy environment variables");
-			}
-		}
+		// An explicit block (even "\0") replaces it entirely.  Builders hand
+		// us a cached block; direct callers get one built here.
+		environment_ptr env_block = startup._env_block;
+		if (!env_block)
+			env_block = make_environment_block(startup);
+		char *envs = env_block ? const_cast<char *>(env_block->block.data()) : nullptr;
 
 		// Only suppress the console window when not inheriting the parent's terminal.
 		// If the caller uses any inherit flag the child should be visible in the
@@ -397,6 +484,215 @@ namespace mpp_impl {
 		               ? FD_INVALID : pstderr[PIPE_READ];
 	}
 
+	void create_processes(const process_startup &startup, size_t count,
+	                      std::vector<process_info> &infos,
+	                      std::vector<std::string> &errors,
+	                      const argv_block *argv)
+	{
+		// CreateProcess reports failure synchronously, so there is no exec
+		// confirmation to overlap; the environment block is still shared.
+		infos.assign(count, process_info{});
+		errors.assign(count, std::string());
+		process_startup shared = startup;
+		if (!shared._env_block)
+			shared._env_block = make_environment_block(shared);
+		for (size_t i = 0; i < count; ++i) {
+			try {
+				create_process(shared, infos[i], argv);
+			}
+			catch (const std::exception &e) {
+				errors[i] = e.what();
+			}
+		}
+	}
+
+	bool create_chain_pipe(fd_type fds[2])
+	{
+		if (!create_pipe(fds))
+			return false;
+		// create_process_impl() marks a redirect target inheritable for the
+		// child it is given to; until then no other child may inherit it.
+		SetHandleInformation(fds[PIPE_READ], HANDLE_FLAG_INHERIT, 0);
+		SetHandleInformation(fds[PIPE_WRITE], HANDLE_FLAG_INHERIT, 0);
+		return true;
+	}
+
+	void ignore_sigpipe()
+	{
+		// Broken pipes surface as ERROR_NO_DATA from WriteFile.
+	}
+
+	unsigned available_cpus()
+	{
+		// Job object CPU rate limits are not consulted.
+		DWORD_PTR process_mask = 0, system_mask = 0;
+		unsigned n = 0;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+			for (; process_mask != 0; process_mask &= process_mask - 1)
+				++n;
+		}
+		if (n == 0) {
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			n = info.dwNumberOfProcessors;
+		}
+		return n > 0 ? n : 1;
+	}
+
+	uint64_t pump_file(fd_type src, uint64_t offset, int64_t length,
+	                   fd_type dst, int deadline_ms)
+	{
+		const bool has_deadline = deadline_ms >= 0;
+		const ULONGLONG deadline = GetTickCount64() + (has_deadline ? deadline_ms : 0);
+		constexpr DWORD chunk = 64 * 1024;
+		std::unique_ptr<char[]> buf(new char[chunk]);
+		uint64_t moved = 0;
+		while (length < 0 || moved < static_cast<uint64_t>(length)) {
+			DWORD want = chunk;
+			if (length >= 0)
+				want = static_cast<DWORD>(std::min<uint64_t>(static_cast<uint64_t>(length) - moved, chunk));
+			// An explicit offset leaves the file pointer alone, like pread().
+			OVERLAPPED ov {};
+			const uint64_t pos = offset + moved;
+			ov.Offset = static_cast<DWORD>(pos & 0xFFFFFFFFu);
+			ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+			DWORD got = 0;
+			if (!ReadFile(src, buf.get(), want, &got, &ov)) {
+				const DWORD le = GetLastError();
+				if (le == ERROR_HANDLE_EOF)
+					break;
+				mpp::throw_ex<mpp::runtime_error>("pump: read failed (err=" + std::to_string(le) + ")");
+			}
+			if (got == 0)
+				break;
+			DWORD done = 0;
+			while (done < got) {
+				DWORD put = 0;
+				if (!WriteFile(dst, buf.get() + done, got - done, &put, nullptr)) {
+					const DWORD le = GetLastError();
+					if (le == ERROR_NO_DATA || le == ERROR_BROKEN_PIPE)
+						return moved + done; // the child stopped reading
+					mpp::throw_ex<mpp::runtime_error>("pump: write failed (err=" + std::to_string(le) + ")");
+				}
+				done += put;
+			}
+			moved += done;
+			if (has_deadline && GetTickCount64() >= deadline)
+				break;
+		}
+		return moved;
+	}
+
+	mpp::ssize_t read_nonblock(fd_type fd, char *buf, size_t n)
+	{
+		DWORD avail = 0;
+		if (!PeekNamedPipe(fd, nullptr, 0, nullptr, &avail, nullptr))
+			return 0; // ERROR_BROKEN_PIPE: the writer has gone
+		if (avail == 0)
+			return -1;
+		DWORD got = 0;
+		const DWORD want = static_cast<DWORD>(std::min<size_t>(n, avail));
+		if (!ReadFile(fd, buf, want, &got, nullptr))
+			return 0;
+		return static_cast<mpp::ssize_t>(got);
+	}
+
+	mpp::ssize_t write_nonblock(fd_type fd, const char *buf, size_t n)
+	{
+		// Anonymous pipes accept PIPE_NOWAIT: a write then takes what fits.
+		DWORD mode = PIPE_READMODE_BYTE | PIPE_NOWAIT;
+		if (!SetNamedPipeHandleState(fd, &mode, nullptr, nullptr))
+			return -1;
+		DWORD put = 0;
+		const BOOL ok = WriteFile(fd, buf, static_cast<DWORD>(std::min<size_t>(n, MAXDWORD)), &put, nullptr);
+		const DWORD le = GetLastError();
+		mode = PIPE_READMODE_BYTE | PIPE_WAIT;
+		SetNamedPipeHandleState(fd, &mode, nullptr, nullptr);
+		if (!ok)
+			return (le == ERROR_NO_DATA || le == ERROR_BROKEN_PIPE) ? -1 : 0;
+		return static_cast<mpp::ssize_t>(put);
+	}
+
+	bool wait_pipe(fd_type fd, bool for_write, int timeout_ms)
+	{
+		const ULONGLONG deadline = GetTickCount64() + (timeout_ms < 0 ? 0 : timeout_ms);
+		for (;;) {
+			DWORD avail = 0;
+			// Readable data, EOF or a broken pipe.
+			if (!for_write && (!PeekNamedPipe(fd, nullptr, 0, nullptr, &avail, nullptr) || avail > 0))
+				return true;
+			if (timeout_ms >= 0 && GetTickCount64() >= deadline)
+				return false;
+			Sleep(1);
+			// Writability has no probe: let the caller retry the write.
+			if (for_write)
+				return true;
+		}
+	}
+
+	fd_type create_capture_file(const process_startup &startup)
+	{
+		// No anonymous memory files here: a temporary file that is never
+		// flushed while memory lasts (FILE_ATTRIBUTE_TEMPORARY) and goes
+		// away with its last handle.  _capture_memory_cap only changes
+		// the directory, as both kinds live in the same file cache.
+		std::string dir = startup._capture_dir;
+		if (dir.empty()) {
+			char tmp[MAX_PATH + 1];
+			const DWORD n = GetTempPathA(sizeof(tmp), tmp);
+			if (n == 0 || n > sizeof(tmp))
+				mpp::throw_ex<mpp::runtime_error>("unable to locate the temp directory (err=" + std::to_string(GetLastError()) + ")");
+			dir.assign(tmp, n);
+		}
+		char path[MAX_PATH];
+		if (GetTempFileNameA(dir.c_str(), "mpp", 0, path) == 0)
+			mpp::throw_ex<mpp::runtime_error>("unable to name capture file (err=" + std::to_string(GetLastError()) + ")");
+		SECURITY_ATTRIBUTES sa {};
+		sa.nLength = sizeof(sa);
+		sa.bInheritHandle = FALSE;
+		HANDLE h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+		                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		                       &sa, CREATE_ALWAYS,
+		                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (h == INVALID_HANDLE_VALUE) {
+			const DWORD le = GetLastError();
+			DeleteFileA(path);
+			mpp::throw_ex<mpp::runtime_error>("unable to create capture file (err=" + std::to_string(le) + ")");
+		}
+		return h;
+	}
+
+	void map_capture(fd_type fd, const char *&data, size_t &size, fd_type &mapping)
+	{
+		data = nullptr;
+		size = 0;
+		mapping = FD_INVALID;
+		LARGE_INTEGER len {};
+		if (!GetFileSizeEx(fd, &len))
+			mpp::throw_ex<mpp::runtime_error>("unable to size capture file (err=" + std::to_string(GetLastError()) + ")");
+		if (len.QuadPart <= 0)
+			return;
+		HANDLE m = CreateFileMappingA(fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m == nullptr)
+			mpp::throw_ex<mpp::runtime_error>("unable to map capture file (err=" + std::to_string(GetLastError()) + ")");
+		void *p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(len.QuadPart));
+		if (p == nullptr) {
+			const DWORD le = GetLastError();
+			CloseHandle(m);
+			mpp::throw_ex<mpp::runtime_error>("unable to map capture file (err=" + std::to_string(le) + ")");
+		}
+		data = static_cast<const char *>(p);
+		size = static_cast<size_t>(len.QuadPart);
+		mapping = m;
+	}
+
+	void unmap_capture(const char *data, size_t, fd_type mapping)
+	{
+		UnmapViewOfFile(data);
+		if (mapping != FD_INVALID)
+			CloseHandle(mapping);
+	}
+
 	void close_process(process_info &info)
 	{
 		mpp_impl::close_fd(info._pid);
@@ -404,6 +700,8 @@ namespace mpp_impl {
 		mpp_impl::close_fd(info._stdin);
 		mpp_impl::close_fd(info._stdout);
 		mpp_impl::close_fd(info._stderr);
+		mpp_impl::close_fd(info._capture_out);
+		mpp_impl::close_fd(info._capture_err);
 	}
 }
 
@@ -139,6 +139,12 @@ namespace mpp_impl {
 		return false; // WAIT_TIMEOUT or error
 	}
 
+	fd_type exit_notify_fd(const process_info &)
+	{
+		// Waits stay on the thread pool (WaitForSingleObject).
+		return FD_INVALID;
+	}
+
 	int get_pid(const process_info &info)
 	{
 		return static_cast<int>(GetProcessId(info._pid));
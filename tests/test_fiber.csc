@@ -45,6 +45,8 @@ var _fr05_1 = null
 var _fr05_2 = null
 var _fr06_poll = null  # F06
 var _fr06_exited = null
+var _fr07_next = 0  # F07 next fiber id
+var _fr07_out = {null, null, null, null, null, null, null, null}
 
 # --- Fiber bodies ---
 function f01_body()
@@ -100,6 +102,13 @@ function f06_body()
     _fr06_exited = p.has_exited()
 end
 
+function f07_body()
+    var id = _fr07_next
+    _fr07_next += 1
+    var r = process.shell("echo comm" + id).communicate()
+    _fr07_out[id] = r[0]
+end
+
 # Helper: resume a fiber until it finishes
 function run_fiber(fib)
     while !fib.is_finished()
@@ -184,6 +193,34 @@ catch _e
     check("F06 unexpected exception", false)
 end
 
+# --- F07: many communicate() calls in flight at once ---
+section("F07 concurrent communicate")
+try
+    var fibers = new array
+    var i = 0
+    while i < 8
+        fibers.push_back(fiber.create(f07_body))
+        i += 1
+    end
+    var all_done = false
+    while !all_done
+        all_done = true
+        foreach f in fibers
+            if !f.is_finished()
+                all_done = false
+                f.resume()
+            end
+        end
+    end
+    i = 0
+    while i < 8
+        check("fiber " + i + " stdout", _fr07_out[i] != null && _fr07_out[i].size >= 5)
+        i += 1
+    end
+catch _e
+    check("F07 unexpected exception", false)
+end
+
 system.out.println("")
 system.out.println("----------------------------------------")
 system.out.println("Results: " + _pass + " passed, " + _fail + " failed")
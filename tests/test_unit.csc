@@ -686,6 +686,785 @@ catch _e38
     check("T38 unexpected exception", false)
 end
 
+# --- T39: builder.prepare() reused with per-launch arguments ---
+section("T39 prepared spec")
+try
+    var _b39 = new process.builder
+    if system.is_platform_windows()
+        _b39.cmd("cmd")
+        _b39.arg({"/c", "exit /b 3"})
+    else
+        _b39.cmd("sh")
+        _b39.arg({"-c", "exit 3"})
+    end
+    var _s39 = _b39.prepare()
+    check_eq("prepared: captured args kept", _s39.args().size, 2)
+    check_eq("prepared: captured args exit code", _s39.start(_s39.args()).communicate()[2], 3)
+    var _k39 = 0
+    var _ok39 = true
+    while _k39 < 5
+        var _r39 = null
+        if system.is_platform_windows()
+            _r39 = _s39.start({"/c", "exit /b " + _k39}).communicate()
+        else
+            _r39 = _s39.start({"-c", "exit " + _k39}).communicate()
+        end
+        if _r39[2] != _k39
+            _ok39 = false
+        end
+        _k39 += 1
+    end
+    check("prepared: substituted args per launch", _ok39)
+
+    var _bs39 = new process.builder
+    _bs39.cmd("echo")
+    _bs39.shell(process.default_shell())
+    var _ss39 = _bs39.prepare()
+    var _rs39 = _ss39.start({"prepared_shell"}).communicate()
+    check("prepared shell: args appended to command", _rs39[0].size >= 14)
+catch _e39
+    check("T39 unexpected exception", false)
+end
+
+# --- T40: builder.start_many() ---
+section("T40 start_many")
+try
+    var _b40 = new process.builder
+    if system.is_platform_windows()
+        _b40.cmd("cmd")
+        _b40.arg({"/c", "exit /b 4"})
+    else
+        _b40.cmd("sh")
+        _b40.arg({"-c", "exit 4"})
+    end
+    var _r40 = _b40.start_many(8)
+    check_eq("start_many: one entry per child", _r40.size, 8)
+    var _ok40 = true
+    foreach _e40 in _r40
+        if _e40[0] == null || _e40[1] != ""
+            _ok40 = false
+        else
+            if _e40[0].communicate()[2] != 4
+                _ok40 = false
+            end
+        end
+    end
+    check("start_many: every child ran", _ok40)
+
+    var _bad40 = new process.builder
+    _bad40.cmd("csproc_no_such_command_t40")
+    var _rb40 = _bad40.start_many(2)
+    check("start_many: failure reported per child", _rb40[0][0] == null && _rb40[1][1] != "")
+catch _x40
+    check("T40 unexpected exception", false)
+end
+
+# --- T41: spawning through the fork server ---
+section("T41 fork server")
+try
+    if system.is_platform_windows()
+        check("fork server unavailable on Windows", !process.fork_server(true))
+    else
+        check("fork server started", process.fork_server(true))
+        var _b41 = new process.builder
+        _b41.cmd("sh")
+        _b41.arg({"-c", "echo via_server; exit 6"})
+        var _r41 = _b41.start().communicate()
+        check_eq("fork server: exit code", _r41[2], 6)
+        check_eq("fork server: stdout", _r41[0], "via_server\n")
+
+        var _p41 = start_sleeper(30)
+        check("fork server: sleeper running", !_p41.has_exited())
+        _p41.kill(true)
+        _p41.wait()
+        check("fork server: kill reaped", _p41.has_exited())
+
+        check("fork server stopped", !process.fork_server(false))
+        check_eq("local spawn after stop", _b41.start().communicate()[2], 6)
+    end
+catch _e41
+    process.fork_server(false)
+    check("T41 unexpected exception", false)
+end
+
+# --- T42: communicate_input() ---
+section("T42 communicate_input")
+try
+    var _b42 = new process.builder
+    _b42.cmd("sort")
+    var _r42 = _b42.start().communicate_input("b\na\n")
+    check_eq("communicate_input: exit code", _r42[2], 0)
+    check("communicate_input: sorted output", _r42[0].size >= 4 && _r42[0][0] == 'a')
+
+    if !system.is_platform_windows()
+        # Larger than any pipe buffer: cat echoes while it reads.
+        var _in42 = "0123456789abcdef"
+        var _k42 = 0
+        while _k42 < 14
+            _in42 = _in42 + _in42
+            _k42 += 1
+        end
+        var _bc42 = new process.builder
+        _bc42.cmd("cat")
+        var _rc42 = _bc42.start().communicate_input(_in42)
+        check_eq("communicate_input: 256 KiB echoed back", _rc42[0].size, _in42.size)
+
+        var _be42 = new process.builder
+        _be42.cmd("sh")
+        _be42.arg({"-c", "exit 5"})
+        check_eq("communicate_input: child ignoring stdin", _be42.start().communicate_input(_in42)[2], 5)
+    end
+catch _e42
+    check("T42 unexpected exception", false)
+end
+
+# --- T43: builder.stdin_buffer() ---
+section("T43 stdin_buffer")
+try
+    var _b43 = new process.builder
+    _b43.cmd("sort")
+    _b43.stdin_buffer(65536)
+    var _p43 = _b43.start()
+    var _in43 = _p43.in()
+    _in43.print("b")
+    _in43.print("\n")
+    _in43.print("a")
+    _in43.print("\n")
+    var _r43 = _p43.communicate()
+    check_eq("stdin_buffer: exit code", _r43[2], 0)
+    check("stdin_buffer: buffered writes delivered on close", _r43[0].size >= 4 && _r43[0][0] == 'a')
+
+    var _bi43 = new process.builder
+    _bi43.cmd("sort")
+    _bi43.stdin_buffer(4096)
+    var _pi43 = _bi43.start()
+    _pi43.in().print("b\n")
+    var _ri43 = _pi43.communicate_input("a\n")
+    check("stdin_buffer: buffered bytes kept by communicate_input", _ri43[0].size >= 4 && _ri43[0][0] == 'a')
+catch _e43
+    check("T43 unexpected exception", false)
+end
+
+# --- T44: read_buffer() / output_size_hint() ---
+section("T44 read buffer and size hint")
+try
+    var _b44 = new process.builder
+    _b44.read_buffer(65536)
+    _b44.output_size_hint(16)
+    if system.is_platform_windows()
+        _b44.cmd("cmd")
+        _b44.arg({"/c", "echo hinted"})
+    else
+        _b44.cmd("sh")
+        _b44.arg({"-c", "echo hinted"})
+    end
+    var _r44 = _b44.start().communicate()
+    check("size hint: output not padded", _r44[0].size >= 7 && _r44[0].size <= 8)
+
+    var _p44 = _b44.start()
+    var _l44 = _p44.out().getline()
+    _p44.wait()
+    check("read buffer: getline through a larger buffer", _l44.size >= 6)
+catch _e44
+    check("T44 unexpected exception", false)
+end
+
+# --- T45: process.pipeline ---
+section("T45 pipeline")
+try
+    var _src45 = new process.builder
+    var _mid45 = new process.builder
+    var _end45 = new process.builder
+    if system.is_platform_windows()
+        _src45.cmd("cmd")
+        _src45.arg({"/c", "echo b& echo a"})
+        _mid45.cmd("sort")
+        _end45.cmd("cmd")
+        _end45.arg({"/c", "more & exit /b 2"})
+    else
+        _src45.cmd("sh")
+        _src45.arg({"-c", "echo b; echo a"})
+        _mid45.cmd("sort")
+        _end45.cmd("sh")
+        _end45.arg({"-c", "cat; exit 2"})
+    end
+    var _pb45 = new process.pipeline
+    _pb45.add(_src45).add(_mid45).add(_end45)
+    check_eq("pipeline: stage count", _pb45.size(), 3)
+    var _r45 = _pb45.start().communicate()
+    check("pipeline: data flows through every stage", _r45[0].size >= 4 && _r45[0][0] == 'a')
+    check_eq("pipeline: one exit code per stage", _r45[2].size, 3)
+    check_eq("pipeline: first stage exit code", _r45[2][0], 0)
+    check_eq("pipeline: last stage exit code", _r45[2][2], 2)
+
+    var _pi45 = new process.pipeline
+    _pi45.add(_mid45).add(_end45)
+    var _ri45 = _pi45.start().communicate_input("d\nc\n")
+    check("pipeline: input fed to the first stage", _ri45[0].size >= 4 && _ri45[0][0] == 'c')
+
+    var _pk45 = new process.pipeline
+    _pk45.add(_mid45).add(_end45)
+    var _run45 = _pk45.start()
+    check("pipeline: running before kill", !_run45.has_exited())
+    _run45.kill(true)
+    _run45.wait()
+    check("pipeline: kill stops every stage", _run45.has_exited())
+catch _e45
+    check("T45 unexpected exception", false)
+end
+
+# --- T46: pump(file_t) into a running child ---
+section("T46 pump")
+try
+    var _path46 = "./.tmp_pump.txt"
+    var _fw46 = process.async.fstream(_path46, "w+")
+    _fw46.write("0123456789abcdef", 1000)
+    _fw46.flush(1000)
+    _fw46.close()
+
+    var _fr46 = process.async.fstream(_path46, "r")
+    var _b46 = new process.builder
+    if system.is_platform_windows()
+        _b46.cmd("findstr")
+        _b46.arg({"^"})
+    else
+        _b46.cmd("cat")
+    end
+    var _p46 = _b46.start()
+    check_eq("pump: byte range", _p46.pump(_fr46, 10, 3, -1), 3)
+    check_eq("pump: second range", _p46.pump(_fr46, 2, 2, 1000), 2)
+    check_eq("pump: up to EOF", _p46.pump(_fr46, 14, -1, -1), 2)
+    check_eq("pump: past EOF", _p46.pump(_fr46, 100, 5, -1), 0)
+    var _r46 = _p46.communicate()
+    check("pump: ranges arrive in order", _r46[0].size >= 7 && _r46[0][0] == 'a' && _r46[0][3] == '2' && _r46[0][5] == 'e')
+    check_eq("pump: exit code 0", _r46[2], 0)
+    check_eq("pump: file position untouched", _fr46.read(4, 1000), "0123")
+
+    var _closed46 = false
+    try
+        _p46.pump(_fr46, 0, -1, -1)
+    catch _ce46
+        _closed46 = true
+    end
+    check("pump: closed stdin throws", _closed46)
+    _fr46.close()
+catch _e46
+    check("T46 unexpected exception", false)
+end
+
+# --- T47: capture_mapped / mapped_out ---
+section("T47 capture_mapped")
+try
+    var _b47 = new process.builder
+    if system.is_platform_windows()
+        _b47.cmd("cmd")
+        _b47.arg({"/c", "echo mapped& echo oops 1>&2"})
+    else
+        _b47.cmd("sh")
+        _b47.arg({"-c", "echo mapped; echo oops >&2"})
+    end
+    _b47.capture_mapped(true)
+    var _p47 = _b47.start()
+    var _m47 = _p47.mapped_out()
+    check("capture: stdout captured", _m47.size() >= 6 && _m47.substr(0, 6) == "mapped")
+    check("capture: stderr captured", _p47.mapped_err().str().size >= 4)
+    check_eq("capture: exit code 0", _p47.wait(), 0)
+    check_eq("capture: substr past the end", _m47.substr(100, 5), "")
+
+    var _path47 = "./.tmp_capture.txt"
+    var _fw47 = process.async.fstream(_path47, "w+")
+    check_eq("capture: write_to file_t", _m47.write_to(_fw47), _m47.size())
+    _fw47.close()
+    var _fr47 = process.async.fstream(_path47, "r")
+    check_eq("capture: file holds the capture", _fr47.read(6, 1000), "mapped")
+    _fr47.close()
+
+    var _bm47 = new process.builder
+    if system.is_platform_windows()
+        _bm47.cmd("cmd")
+        _bm47.arg({"/c", "echo mapped& echo oops 1>&2"})
+    else
+        _bm47.cmd("sh")
+        _bm47.arg({"-c", "echo mapped; echo oops >&2"})
+    end
+    _bm47.merge_output(true).capture_mapped(true)
+    var _pm47 = _bm47.start()
+    check("capture: merged stderr lands in stdout", _pm47.mapped_out().size() >= 10)
+    check_eq("capture: no separate stderr when merged", _pm47.mapped_err().size(), 0)
+catch _e47
+    check("T47 unexpected exception", false)
+end
+
+# --- T48: keep_output bounded capture ---
+section("T48 keep_output")
+try
+    var _b48 = new process.builder
+    if system.is_platform_windows()
+        _b48.cmd("cmd")
+        _b48.arg({"/c", "for /L %i in (1,1,2000) do @echo line%i"})
+    else
+        _b48.cmd("sh")
+        _b48.arg({"-c", "i=1; while [ $i -le 2000 ]; do echo line$i; i=$((i+1)); done"})
+    end
+    _b48.keep_output(16, 6)
+    var _r48 = _b48.start().communicate()
+    check_eq("keep_output: exit code 0", _r48[2], 0)
+    check("keep_output: bounded out", _r48[0].size <= 22)
+    check("keep_output: head kept", _r48[0].size >= 5 && _r48[0][0] == 'l' && _r48[0][4] == '1')
+    var _n48 = _r48[0].size
+    check("keep_output: tail kept", _n48 >= 12 && (_r48[0][_n48 - 2] == '0' || _r48[0][_n48 - 3] == '0'))
+    check("keep_output: total counts everything", _r48[3][0] > 10000)
+    check("keep_output: truncated flag", _r48[4][0])
+    check("keep_output: stderr not truncated", !_r48[4][1])
+
+    var _bs48 = new process.builder
+    _bs48.cmd("echo").arg({"short"}).shell(process.default_shell()).keep_output(100, 0)
+    var _rs48 = _bs48.start().communicate()
+    check("keep_output: short output intact", !_rs48[4][0] && _rs48[3][0] == _rs48[0].size)
+catch _e48
+    check("T48 unexpected exception", false)
+end
+
+# --- T49: read_out / read_err / write_in with deadlines ---
+section("T49 non-blocking stdio")
+try
+    var _b49 = new process.builder
+    if system.is_platform_windows()
+        _b49.cmd("findstr")
+        _b49.arg({"^"})
+    else
+        _b49.cmd("cat")
+    end
+    var _p49 = _b49.start()
+    check_eq("stdio: write_in takes the data", _p49.write_in("ping\n", 1000), 5)
+    var _r49 = _p49.read_out(4096, 5000)
+    check("stdio: read_out returns the echo", _r49 != null && _r49.size >= 4 && _r49[0] == 'p')
+    check_null("stdio: read_out times out on a quiet pipe", _p49.read_out(4096, 100))
+    check_null("stdio: deadline 0 only polls", _p49.read_err(4096, 0))
+    _p49.close_stdin()
+    var _eof49 = _p49.read_out(4096, 5000)
+    while _eof49 != null && _eof49.size > 0
+        _eof49 = _p49.read_out(4096, 5000)
+    end
+    check_eq("stdio: EOF after close_stdin", _eof49, "")
+    check_eq("stdio: write_in after close_stdin", _p49.write_in("x", 0), -1)
+    check_eq("stdio: exit code 0", _p49.wait(), 0)
+catch _e49
+    check("T49 unexpected exception", false)
+end
+
+# --- T50: output subscriptions dispatched from async.poll ---
+section("T50 output subscriptions")
+var _t50_lines = new array
+var _t50_bytes = {0}
+function _t50_line(line)
+    _t50_lines.push_back(line)
+end
+function _t50_chunk(data)
+    _t50_bytes[0] = _t50_bytes[0] + data.size
+end
+try
+    var _b50 = new process.builder
+    if system.is_platform_windows()
+        _b50.cmd("cmd")
+        _b50.arg({"/c", "echo one&echo two&echo three"})
+    else
+        _b50.cmd("sh")
+        _b50.arg({"-c", "echo one; echo two; printf three"})
+    end
+    var _p50 = _b50.start()
+    _p50.on_out_line(_t50_line)
+    _p50.on_out_chunk(_t50_chunk)
+    check_eq("subscribe: nothing runs before poll", _t50_lines.size, 0)
+    var _spins50 = 0
+    while !_p50.output_done() && _spins50 < 5000
+        process.async.poll_once()
+        _spins50 = _spins50 + 1
+    end
+    check("subscribe: output_done", _p50.output_done())
+    check_eq("subscribe: three lines", _t50_lines.size, 3)
+    check("subscribe: first line without newline", _t50_lines.size == 3 && _t50_lines[0] == "one")
+    check("subscribe: unterminated last line", _t50_lines.size == 3 && _t50_lines[2].size >= 5 && _t50_lines[2][0] == 't')
+    check("subscribe: chunks cover the output", _t50_bytes[0] >= 13)
+    var _r50 = _p50.communicate()
+    check_eq("subscribe: communicate sees no stdout", _r50[0], "")
+    check_eq("subscribe: exit code 0", _r50[2], 0)
+catch _e50
+    check("T50 unexpected exception", false)
+end
+
+# --- T51: readline / lines on file_t and process stdout ---
+section("T51 readline and lines")
+try
+    var _path51 = "./.tmp_lines.txt"
+    var _fw51 = process.async.fstream(_path51, "w+")
+    _fw51.write("alpha\nbeta\r\n\ngamma", 1000)
+    _fw51.close()
+
+    var _fr51 = process.async.fstream(_path51, "r")
+    check_eq("readline: first line keeps its newline", _fr51.readline(1000), "alpha\n")
+    var _rest51 = _fr51.lines(1000)
+    check_eq("lines: rest of the file", _rest51.size, 3)
+    check("lines: CR LF stripped", _rest51.size == 3 && _rest51[0] == "beta")
+    check("lines: empty line kept", _rest51.size == 3 && _rest51[1] == "")
+    check("lines: unterminated last line", _rest51.size == 3 && _rest51[2] == "gamma")
+    check_eq("readline: EOF", _fr51.readline(1000), "")
+    _fr51.close()
+
+    var _fa51 = process.async.fstream(_path51, "r")
+    check_eq("lines: whole file", _fa51.lines(-1).size, 4)
+    _fa51.close()
+
+    var _fz51 = process.async.fstream(_path51, "r")
+    check_eq("readline(0): first block is still read", _fz51.readline(0), "alpha\n")
+    _fz51.close()
+
+    var _b51 = new process.builder
+    if system.is_platform_windows()
+        _b51.cmd("cmd")
+        _b51.arg({"/c", "echo one&echo two&echo three"})
+    else
+        _b51.cmd("sh")
+        _b51.arg({"-c", "echo one; echo two; echo three"})
+    end
+    var _p51 = _b51.start()
+    var _l51 = _p51.readline()
+    check("process readline: first line", _l51.size >= 4 && _l51[0] == 'o' && _l51[_l51.size - 1] == '\n')
+    var _pl51 = _p51.lines()
+    check_eq("process lines: the rest", _pl51.size, 2)
+    check("process lines: no newline kept", _pl51.size == 2 && _pl51[1] == "three")
+    check_eq("process readline: EOF", _p51.readline(), "")
+    check_eq("process lines: exit code 0", _p51.wait(), 0)
+catch _e51
+    check("T51 unexpected exception", false)
+end
+
+# --- T52: worker_pool ---
+section("T52 worker_pool")
+try
+    if !system.is_platform_windows()
+        var _b52 = new process.builder
+        _b52.cmd("sh")
+        _b52.arg({"-c", "while IFS= read -r l; do [ \"$l\" = die ] && exit 3; echo \"r:$l\"; done"})
+        var _pool52 = _b52.worker_pool(2, "line", 0)
+        check_eq("worker_pool: workers started", _pool52.workers(), 2)
+        var _q52 = {"a", "b", "c", "d", "e", "f"}
+        var _t52 = new array
+        var _i52 = 0
+        while _i52 < _q52.size
+            _t52.push_back(_pool52.submit(_q52[_i52]))
+            _i52 += 1
+        end
+        var _ok52 = 0
+        _i52 = 0
+        while _i52 < _q52.size
+            if _pool52.result(_t52[_i52]) == "r:" + _q52[_i52]
+                _ok52 += 1
+            end
+            _i52 += 1
+        end
+        check_eq("worker_pool: queued requests answered in order of tickets", _ok52, 6)
+        check_null("worker_pool: crashed worker gives null", _pool52.call("die"))
+        check_eq("worker_pool: replacement serves", _pool52.call("again"), "r:again")
+        check_eq("worker_pool: nothing outstanding", _pool52.outstanding(), 0)
+        _pool52.shutdown(1000)
+        check_eq("worker_pool: shut down", _pool52.workers(), 0)
+
+        var _br52 = new process.builder
+        _br52.cmd("sh")
+        _br52.arg({"-c", "while IFS= read -r l; do echo $$; done"})
+        var _pr52 = _br52.worker_pool(1, "line", 2)
+        var _a52 = _pr52.call("x")
+        check_eq("worker_pool: same worker before recycling", _pr52.call("x"), _a52)
+        check("worker_pool: new worker after recycle_after", _pr52.call("x") != _a52)
+        _pr52.shutdown(1000)
+
+        var _bc52 = new process.builder
+        _bc52.cmd("cat")
+        var _pc52 = _bc52.worker_pool(1, "line", 0)
+        var _big52 = "x"
+        while _big52.size < 1048576
+            _big52 = _big52 + _big52
+        end
+        check_eq("worker_pool: 1 MiB request past the pipe buffer", _pc52.call(_big52), _big52)
+        _pc52.shutdown(1000)
+    end
+catch _e52
+    check("T52 unexpected exception", false)
+end
+
+# --- T53: process.run_all ---
+section("T53 run_all")
+var _done53 = {0}
+function _on_done53(i, r)
+    _done53[0] = _done53[0] + 1
+end
+try
+    var _cmds53 = new array
+    var _i53 = 0
+    while _i53 < 12
+        _cmds53.push_back("echo job")
+        _i53 += 1
+    end
+    var _bx53 = new process.builder
+    if system.is_platform_windows()
+        _bx53.cmd("cmd")
+        _bx53.arg({"/c", "exit 3"})
+    else
+        _bx53.cmd("sh")
+        _bx53.arg({"-c", "exit 3"})
+    end
+    _cmds53.push_back(_bx53)
+    var _opts53 = new hash_map
+    _opts53.insert("on_done", _on_done53)
+    var _r53 = process.run_all(_cmds53, 4, _opts53)
+    check_eq("run_all: one result per command", _r53.size, 13)
+    var _ok53 = 0
+    _i53 = 0
+    while _i53 < 12
+        if _r53[_i53][2] == 0 && _r53[_i53][0].size >= 3 && _r53[_i53][0][0] == 'j'
+            _ok53 += 1
+        end
+        _i53 += 1
+    end
+    check_eq("run_all: shell jobs captured", _ok53, 12)
+    check_eq("run_all: builder job exit code", _r53[12][2], 3)
+    check_eq("run_all: on_done per job", _done53[0], 13)
+
+    var _bad53 = new process.builder
+    _bad53.cmd("./.no_such_program_53")
+    var _ff53 = new hash_map
+    _ff53.insert("fail_fast", true)
+    var _rf53 = process.run_all({_bad53, "echo late"}, 1, _ff53)
+    check_null("run_all: failed launch has null exit code", _rf53[0][2])
+    check_null("run_all: fail_fast skips the rest", _rf53[1][2])
+    check("run_all: error reported", _rf53[0][3].size > 0)
+catch _e53
+    check("T53 unexpected exception", false)
+end
+
+# --- T54: process.task_graph ---
+section("T54 task_graph")
+try
+    var _b54 = new process.builder
+    if system.is_platform_windows()
+        _b54.cmd("cmd")
+        _b54.arg({"/c", "exit 1"})
+    else
+        _b54.cmd("sh")
+        _b54.arg({"-c", "exit 1"})
+    end
+    var _g54 = new process.task_graph
+    _g54.add("link", "echo link", {"a", "b"})
+    _g54.add("a", "echo a", {"gen"})
+    _g54.add("b", "echo b", {})
+    _g54.add("gen", "echo gen", {})
+    _g54.add("broken", _b54, {})
+    _g54.add("after_broken", "echo never", {"broken"})
+    _g54.add("after_that", "echo never", {"after_broken", "b"})
+    check_eq("task_graph: size", _g54.size(), 7)
+    var _r54 = _g54.run(2, new hash_map)
+    var _n54 = _r54[0]
+    check_eq("task_graph: one entry per node", _n54.size, 7)
+    check_eq("task_graph: link succeeded", _n54[0][1], "succeeded")
+    check("task_graph: link started after its dependencies", _n54[0][6] >= _n54[1][7] && _n54[0][6] >= _n54[2][7])
+    check("task_graph: a started after gen", _n54[1][6] >= _n54[3][7])
+    check_eq("task_graph: failed node", _n54[4][1], "failed")
+    check_eq("task_graph: failed exit code", _n54[4][2], 1)
+    check_eq("task_graph: dependent skipped", _n54[5][1], "skipped")
+    check_eq("task_graph: indirect dependent skipped", _n54[6][1], "skipped")
+    check_null("task_graph: skipped node never ran", _n54[6][2])
+    check("task_graph: critical path ends at a node", _r54[1].size >= 1)
+
+    var _c54 = new process.task_graph
+    _c54.add("x", "echo x", {"y"})
+    _c54.add("y", "echo y", {"x"})
+    var _cycle54 = false
+    try
+        _c54.run(1, new hash_map)
+    catch _ce54
+        _cycle54 = true
+    end
+    check("task_graph: cycle rejected", _cycle54)
+catch _e54
+    check("T54 unexpected exception", false)
+end
+
+# --- T55: process.result_cache ---
+section("T55 result_cache")
+try
+    var _dir55 = "./.tmp_result_cache"
+    var _in55 = "./.tmp_cache_input.txt"
+    var _fw55 = process.async.fstream(_in55, "w+")
+    _fw55.write("v1", 1000)
+    _fw55.close()
+    var _c55 = process.result_cache(_dir55, 0)
+    _c55.clear()
+    _c55.reset_stats()
+    var _cmd55 = "echo cached"
+    var _r55 = _c55.run(_cmd55, {_in55}, "")
+    check("result_cache: first run is a miss", !_r55[3])
+    check_eq("result_cache: exit code", _r55[2], 0)
+    var _h55 = _c55.run(_cmd55, {_in55}, "")
+    check("result_cache: second run is a hit", _h55[3])
+    check_eq("result_cache: output replayed", _h55[0], _r55[0])
+
+    var _fv55 = process.async.fstream(_in55, "w+")
+    _fv55.write("v2", 1000)
+    _fv55.close()
+    check("result_cache: changed input misses", !_c55.run(_cmd55, {_in55}, "")[3])
+    check_eq("result_cache: hit count", _c55.hits(), 1)
+    check_eq("result_cache: miss count", _c55.misses(), 2)
+    check("result_cache: entries on disk", _c55.size() > 0)
+    _c55.clear()
+    check_eq("result_cache: cleared", _c55.size(), 0)
+catch _e55
+    check("T55 unexpected exception", false)
+end
+
+# --- T56: process.run ---
+section("T56 process.run")
+try
+    var _o56 = new hash_map
+    _o56.insert("input", "b\na\n")
+    _o56.insert("timeout", 10000)
+    var _r56 = process.run("sort", {}, _o56)
+    check_eq("run: exit code", _r56[2], 0)
+    check("run: stdin fed and output captured", _r56[0].size >= 4 && _r56[0][0] == 'a')
+    check_eq("run: no limit reached", _r56[5], "")
+    check("run: not timed out", !_r56[6])
+
+    var _e56 = new hash_map
+    _e56.insert("shell", true)
+    _e56.insert("capture", "merge")
+    var _m56 = process.run("echo out", {}, _e56)
+    check("run: shell mode", _m56[0].size >= 3 && _m56[0][0] == 'o')
+    check_eq("run: merged stderr is empty", _m56[1], "")
+
+    if !system.is_platform_windows()
+        var _t56 = new hash_map
+        _t56.insert("timeout", 200)
+        var _s56 = process.run("sh", {"-c", "echo early; sleep 10"}, _t56)
+        check("run: timed out", _s56[6])
+        check_eq("run: output before the timeout kept", _s56[0], "early\n")
+
+        var _v56 = new hash_map
+        var _env56 = new hash_map
+        _env56.insert("MPP_T56", "value")
+        _v56.insert("env", _env56)
+        _v56.insert("cwd", "/")
+        var _w56 = process.run("sh", {"-c", "echo $MPP_T56; pwd"}, _v56)
+        check_eq("run: env and cwd applied", _w56[0], "value\n/\n")
+    end
+catch _e56x
+    check("T56 unexpected exception", false)
+end
+
+# --- T57: builder timeout / idle_timeout / kill_grace ---
+section("T57 builder limits")
+try
+    if !system.is_platform_windows()
+        var _b57 = new process.builder
+        _b57.cmd("sh")
+        _b57.arg({"-c", "echo early; sleep 10"})
+        _b57.timeout(200)
+        var _p57 = _b57.start()
+        var _r57 = _p57.communicate()
+        check_eq("timeout: output before the limit kept", _r57[0], "early\n")
+        check_eq("timeout: reported in communicate", _r57[5], "timeout")
+        check_eq("timeout: limit_reached", _p57.limit_reached(), "timeout")
+
+        var _g57 = new process.builder
+        _g57.cmd("sh")
+        _g57.arg({"-c", "trap '' TERM; sleep 10"})
+        _g57.timeout(100)
+        _g57.kill_grace(200)
+        var _q57 = _g57.start()
+        check("kill_grace: SIGTERM ignored, then killed", _q57.wait() != 0)
+        check_eq("kill_grace: limit reported after wait", _q57.limit_reached(), "timeout")
+
+        var _i57 = new process.builder
+        _i57.cmd("sh")
+        _i57.arg({"-c", "echo a; sleep 10"})
+        _i57.idle_timeout(200)
+        _i57.kill_grace(0)
+        check_eq("idle_timeout: silent child stopped", _i57.start().communicate()[5], "idle_timeout")
+
+        var _c57 = new process.builder
+        _c57.cmd("sh")
+        _c57.arg({"-c", "for i in 1 2 3 4; do echo $i; sleep 0.1; done"})
+        _c57.idle_timeout(1000)
+        _c57.timeout(10000)
+        var _cr57 = _c57.start().communicate()
+        check_eq("limits: chatty child exits normally", _cr57[2], 0)
+        check_eq("limits: none fired", _cr57[5], "")
+
+        var _o57 = new hash_map
+        _o57.insert("idle_timeout", 200)
+        var _s57 = process.run("sh", {"-c", "sleep 10"}, _o57)
+        check("run: idle_timeout counts as timed out", _s57[6])
+        check_eq("run: limit named", _s57[5], "idle_timeout")
+
+        var _m57 = new process.builder
+        _m57.cmd("sh")
+        _m57.arg({"-c", "for i in 1 2 3 4; do echo $i; sleep 0.1; done"})
+        _m57.idle_timeout(150)
+        var _t57 = new process.builder
+        _t57.cmd("sh")
+        _t57.arg({"-c", "cat; sleep 10"})
+        _t57.idle_timeout(200)
+        _t57.kill_grace(0)
+        var _pl57 = new process.pipeline
+        var _pr57 = _pl57.add(_m57).add(_t57).start().communicate()
+        check_eq("pipeline: streaming middle stage not idle", _pr57[2][0], 0)
+        check_eq("pipeline: output of the middle stage", _pr57[0], "1\n2\n3\n4\n")
+        check_eq("pipeline: limit of the last stage reported", _pr57[5], "idle_timeout")
+    end
+catch _e57
+    check("T57 unexpected exception", false)
+end
+
+# --- T58: process.wait_any / wait_all ---
+section("T58 wait_any / wait_all")
+try
+    if !system.is_platform_windows()
+        var _procs58 = new array
+        _procs58.push_back(process.exec("sh", {"-c", "sleep 0.3; exit 3"}))
+        _procs58.push_back(process.exec("sh", {"-c", "sleep 0.05; exit 1"}))
+        _procs58.push_back(null)
+        var _a58 = process.wait_any(_procs58, -1)
+        check("wait_any: at least one child reported", _a58.size >= 1)
+        check_eq("wait_any: fastest child first", _a58[0][0], 1)
+        check_eq("wait_any: its exit code", _a58[0][1], 1)
+        _procs58[1] = null
+        var _n58 = process.wait_any(_procs58, 10)
+        check_eq("wait_any: empty on timeout", _n58.size, 0)
+        var _l58 = process.wait_all(_procs58, -1)
+        check_eq("wait_all: remaining child reported", _l58.size, 1)
+        check("wait_all: index and exit code", _l58[0][0] == 0 && _l58[0][1] == 3)
+
+        var _cmds58 = {"exit 0", "exit 1", "exit 2", "exit 3"}
+        var _b58 = new array
+        var _i58 = 0
+        while _i58 < _cmds58.size
+            _b58.push_back(process.exec("sh", {"-c", _cmds58[_i58]}))
+            ++_i58
+        end
+        var _all58 = process.wait_all(_b58, 5000)
+        check_eq("wait_all: every child reported", _all58.size, 4)
+        var _sum58 = 0
+        _i58 = 0
+        while _i58 < _all58.size
+            _sum58 += _all58[_i58][1]
+            ++_i58
+        end
+        check_eq("wait_all: exit codes", _sum58, 6)
+        check_eq("wait_any: nothing left", process.wait_any({null}, -1).size, 0)
+    end
+catch _e58
+    check("T58 unexpected exception", false)
+end
+
 # --- Summary ---
 
 system.out.println("")